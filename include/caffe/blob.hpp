@@ -24,7 +24,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), int8_version_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -216,6 +216,16 @@ class Blob {
     return diff_;
   }
 
+  /**
+   * @brief The int8 data the blob was loaded from (BlobProto::int8_data),
+   *        with one scale per slice in int8_scale(), or NULL if it was not
+   *        loaded from int8 data or its data has changed since.
+   *
+   * INT8 layers use it as it is instead of quantizing the data again.
+   */
+  shared_ptr<SyncedMemory> int8_data() const;
+  inline const vector<float>& int8_scale() const { return int8_scale_; }
+
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
   const int* gpu_shape() const;
@@ -272,6 +282,10 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  // The int8 data of FromProto, valid while data_ is at int8_version_.
+  shared_ptr<SyncedMemory> int8_data_;
+  vector<float> int8_scale_;
+  unsigned int int8_version_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
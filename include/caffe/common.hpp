@@ -163,6 +163,12 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // NUMA placement of the calling thread: the CPUTopology node it is pinned
+  // to, or -1 if it may run on any CPU. Memory first touched by the thread
+  // then lands on that node. InternalThreads inherit the node of the thread
+  // that starts them.
+  inline static int numa_node() { return Get().numa_node_; }
+  static void set_numa_node(int node);
 
  protected:
 #ifndef CPU_ONLY
@@ -174,6 +180,7 @@ class Caffe {
   Brew mode_;
   int solver_count_;
   bool root_solver_;
+  int numa_node_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
@@ -19,6 +19,10 @@ namespace caffe {
  * databases are read sequentially, and that each solver accesses a different
  * subset of the database. Data is distributed to solvers in a round-robin
  * way to keep parallel training deterministic.
+ *
+ * With data_param().reader_threads() > 1, the body hands the datums to
+ * shards, each walking its own cursor over a stride of the records and
+ * parsing them, and collects them back in the order of the database.
  */
 class DataReader {
  public:
@@ -45,6 +49,26 @@ class DataReader {
   DISABLE_COPY_AND_ASSIGN(QueuePair);
   };
 
+  // Parses the records index, index + stride, ... of the source into the
+  // datums pushed to in_, and pushes them to out_ in the same order
+  class Shard : public InternalThread {
+   public:
+    Shard(db::Cursor* cursor, int index, int stride);
+    virtual ~Shard();
+
+    BlockingQueue<Datum*> in_;
+    BlockingQueue<Datum*> out_;
+
+   protected:
+    void InternalThreadEntry();
+
+    shared_ptr<db::Cursor> cursor_;
+    const int index_;
+    const int stride_;
+
+  DISABLE_COPY_AND_ASSIGN(Shard);
+  };
+
   // A single body is created per source
   class Body : public InternalThread {
    public:
@@ -54,6 +78,9 @@ class DataReader {
    protected:
     void InternalThreadEntry();
     void read_one(db::Cursor* cursor, QueuePair* qp);
+    // Reads through reader_threads() shards, record k going to shard
+    // k % shards.size() and to solver k % qps.size().
+    void read_sharded(db::DB* db, vector<shared_ptr<QueuePair> >* qps);
 
     const LayerParameter param_;
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
@@ -75,6 +75,13 @@ class DataTransformer {
    *    set_cpu_data() is used. See image_data_layer.cpp for an example.
    */
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
+
+  /**
+   * @brief Decodes an encoded Datum as Transform does, in color or in gray
+   *    if transform_param sets force_color or force_gray. Data layers that
+   *    time the decoding apart call it, then Transform on the cv::Mat.
+   */
+  cv::Mat DecodeToCVMat(const Datum& datum);
 #endif  // USE_OPENCV
 
   /**
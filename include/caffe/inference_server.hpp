@@ -0,0 +1,108 @@
+#ifndef CAFFE_INFERENCE_SERVER_HPP_
+#define CAFFE_INFERENCE_SERVER_HPP_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net_pool.hpp"
+#include "caffe/util/benchmark.hpp"
+
+namespace caffe {
+
+/// @brief Statistics of an InferenceServer over an interval.
+struct InferenceServerStats {
+  int requests;
+  int items;
+  int batches;
+  double seconds;
+  // Latency from the arrival of a request to its outputs being ready
+  double p50_ms;
+  double p99_ms;
+};
+
+/**
+ * @brief Serves the nets of a NetPool over a socket, running the requests
+ *        of all clients in dynamic batches.
+ *
+ * Each thread of the server holds a net of the pool. The waiting requests
+ * are gathered into a batch of at most max_batch_size items, stopping
+ * max_batch_delay_us after the first of them arrived, and the batch is
+ * run through the first input of the net.
+ *
+ * The protocol is binary, in host byte order. A request is a uint32 number
+ * of items n, followed by n items of the first input blob of the net, as
+ * float32 values in the layout of the blob. The response is a uint32
+ * status, 0 on success, followed for each of the requested output blobs by
+ * a uint32 count and the count float32 values of the n items. A client may
+ * send its requests one after the other on a connection; a request with
+ * a bad size is answered with status 1, and the connection is closed. The
+ * requests of a batch whose outputs do not have an item per input item are
+ * answered with status 2 alone, and the connection stays open.
+ */
+class InferenceServer {
+ public:
+  /**
+   * @brief Serves the nets of pool, with a thread per net, returning the
+   *        blobs named by outputs, or the outputs of the net if empty.
+   *        Each of them must have an item per item of the input.
+   */
+  InferenceServer(NetPool<float>* pool, const vector<string>& outputs,
+      int max_batch_size, int max_batch_delay_us);
+  ~InferenceServer();
+
+  /**
+   * @brief Starts serving on address, either unix:PATH for a Unix domain
+   *        socket or tcp:PORT for a port of localhost, 0 picking a free one.
+   */
+  void Listen(const string& address);
+  /// @brief Stops serving, closing the connections.
+  void Stop();
+  /// @brief Returns the port listened on with tcp:PORT.
+  inline int port() const { return port_; }
+  /// @brief Returns the statistics since the previous call, and resets them.
+  void TakeStats(InferenceServerStats* stats);
+
+ protected:
+  struct Request;
+  class Sync;
+  class Acceptor;
+  class Connection;
+  class Worker;
+
+  void Accept(Acceptor* acceptor);
+  void Serve(Connection* connection, int fd);
+  void Work();
+  // Returns false if the outputs do not split into the requests.
+  bool Run(Net<float>* net, const vector<shared_ptr<Request> >& batch,
+      int items);
+
+  NetPool<float>* pool_;
+  vector<string> outputs_;
+  const int max_batch_size_;
+  const int max_batch_delay_us_;
+  int item_size_;
+  int listen_fd_;
+  int port_;
+  string unix_path_;
+
+  shared_ptr<Sync> sync_;
+  std::deque<shared_ptr<Request> > queue_;
+  vector<shared_ptr<Worker> > workers_;
+  vector<shared_ptr<Connection> > connections_;
+  shared_ptr<Acceptor> acceptor_;
+
+  // Statistics since the last TakeStats, guarded by the mutex of sync_
+  vector<float> latencies_ms_;
+  int stats_items_;
+  int stats_batches_;
+  CPUTimer stats_timer_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceServer);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_SERVER_HPP_
@@ -316,6 +316,21 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns the rows (indices along the first axis) of the param at
+   *        param_id that Backward_cpu has written gradients to since the last
+   *        ClearSparseParamRows(), or NULL if any row may have one.
+   *
+   * Layers that only touch a few rows of a large param, like EmbedLayer, can
+   * track them so that Net::ClearParamDiffs and the solver visit only those
+   * rows. Every row not listed must have a zero diff.
+   */
+  virtual const vector<int>* sparse_param_rows(const int param_id) const {
+    return NULL;
+  }
+  /// @brief Forgets the rows tracked by sparse_param_rows().
+  virtual void ClearSparseParamRows() {}
+
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
 #include "caffe/util/im2col.hpp"
 
 namespace caffe {
@@ -40,6 +41,11 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Same as forward_cpu_gemm, but with int8 weights and inputs (see
+  // QuantizationParameter). Weights loaded as int8 are used as they are;
+  // others are quantized on first use, and again whenever they change; in
+  // TRAIN phase on every use.
+  void forward_cpu_gemm_int8(const Dtype* input, Dtype* output);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,6 +98,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  bool int8_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -167,6 +174,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  // INT8 inference state
+  Dtype bottom_scale_;
+  const SyncedMemory* quantized_weight_mem_;
+  unsigned int quantized_weight_version_;
+  shared_ptr<SyncedMemory> weight_int8_;
+  Blob<Dtype> weight_inv_scale_;
+  shared_ptr<SyncedMemory> col_int8_;
+  shared_ptr<SyncedMemory> output_int32_;
 };
 
 }  // namespace caffe
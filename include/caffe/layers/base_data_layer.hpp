@@ -8,7 +8,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/spsc_queue.hpp"
 
 namespace caffe {
 
@@ -49,6 +49,30 @@ template <typename Dtype>
 class Batch {
  public:
   Blob<Dtype> data_, label_;
+  // The tops after data and label, for layers that have more than two.
+  vector<shared_ptr<Blob<Dtype> > > extra_;
+};
+
+/**
+ * @brief Counters kept by a BasePrefetchingDataLayer to tell whether the net
+ *        is starved by data loading. Times are in milliseconds.
+ */
+struct PrefetchStats {
+  /// Batches taken by Forward, and the time Forward spent waiting for them.
+  int batches;
+  double wait_ms;
+  /// Forwards that found no batch ready and had to wait.
+  int stalls;
+  /// occupancy[k] counts the Forwards that found k batches ready, for k up to
+  /// the prefetch depth.
+  vector<int> occupancy;
+  /// Batches loaded by the prefetch thread, and the time spent in load_batch.
+  int loaded;
+  double load_ms;
+  /// Time spent in the stages of load_batch, as reported by the layer.
+  double read_ms;
+  double decode_ms;
+  double transform_ms;
 };
 
 template <typename Dtype>
@@ -67,18 +91,34 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  /// @brief Returns the data starvation counters since the last reset.
+  PrefetchStats prefetch_stats() const;
+  void ResetPrefetchStats();
+  /// @brief Logs a one-line summary of prefetch_stats().
+  void LogPrefetchStats() const;
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Pops the next loaded batch, counting the time spent waiting for it.
+  Batch<Dtype>* PopFullBatch();
+  // load_batch implementations report the time spent in each of their
+  // stages (in milliseconds) for the batch they loaded.
+  void AddStageTimes(double read_ms, double decode_ms, double transform_ms);
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
-  BlockingQueue<Batch<Dtype>*> prefetch_free_;
-  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // Prefetches transform_param().prefetch() batches (asynchronously if to GPU
+  // memory). The prefetch thread is the only producer of prefetch_full_ and
+  // consumer of prefetch_free_, and Forward the other way around.
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
+  SpscQueue<Batch<Dtype>*> prefetch_free_;
+  SpscQueue<Batch<Dtype>*> prefetch_full_;
 
   Blob<Dtype> transformed_data_;
+
+ private:
+  PrefetchStats stats_;
+  // Guards stats_, which both the prefetch thread and Forward update.
+  shared_ptr<boost::mutex> stats_mutex_;
 };
 
 }  // namespace caffe
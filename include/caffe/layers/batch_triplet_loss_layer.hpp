@@ -27,6 +27,11 @@ class Triplet {
  * @brief Computes the hinge loss for learning to rank with triplet sampling.
  *        The triplet sampling scheme is similar with FaceNet.
  *
+ * With triplet_loss_param().precomputed_distance(), bottom[0] is instead the
+ * @f$ (N \times N \times 1 \times 1) @f$ matrix of squared Euclidean
+ * distances, e.g. the top of a PairwiseDistanceLayer shared with other
+ * losses, and the gradients w.r.t. the distances are backpropagated to it.
+ *
  * @param bottom input Blob vector (length 2)
  *   -# @f$ (N \times C \times 1 \times 1) @f$
  *      the features @f$ x \in [-\infty, +\infty]@f$
@@ -77,6 +82,7 @@ class BatchTripletLossLayer : public LossLayer<Dtype> {
   shared_ptr<SyncedMemory> aggregator_;
   Dtype margin_;
   Dtype mu_;
+  bool precomputed_distance_;
 };
 
 
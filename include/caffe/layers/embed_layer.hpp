@@ -14,6 +14,10 @@ namespace caffe {
  *        Equivalent to an InnerProductLayer with one-hot vectors as input, but
  *        for efficiency the input is the "hot" index of each column itself.
  *
+ * With embed_param().sparse_gradient(), Backward_cpu records the rows of the
+ * weight it writes to (see Layer::sparse_param_rows), so that training
+ * touches only the rows of the inputs seen since the last update.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -30,6 +34,11 @@ class EmbedLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual const vector<int>* sparse_param_rows(const int param_id) const {
+    return sparse_gradient_ && param_id == 0 ? &touched_rows_ : NULL;
+  }
+  virtual void ClearSparseParamRows();
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -45,6 +54,10 @@ class EmbedLayer : public Layer<Dtype> {
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+  bool sparse_gradient_;
+  // The rows of the weight with a gradient, listed once each.
+  vector<int> touched_rows_;
+  vector<bool> row_touched_;
 };
 
 }  // namespace caffe
@@ -17,44 +17,56 @@ namespace caffe {
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * The files listed in the source are streamed by the prefetch thread, which
+ * reads hdf5_data_param().chunk_size() rows of every dataset at a time with
+ * hyperslab selections. Only a chunk of a file is held in memory, and moving
+ * to the next file happens ahead of Forward. If shuffle is set, the files and
+ * the chunks of each file are visited in random order, and if
+ * shuffle_buffer_size() is set the rows are drawn at random from a buffer of
+ * that many rows (at most the rows of the source) that is refilled from the
+ * stream.
+ *
+ * The HDF5 library is usually built without thread safety, so the reads of
+ * all HDF5DataLayer%s are serialized.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : BasePrefetchingDataLayer<Dtype>(param), file_id_(-1) {}
   virtual ~HDF5DataLayer();
-  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Data layers should be shared by multiple solvers in parallel
-  virtual inline bool ShareInParallel() const { return true; }
-  // Data layers have no bottoms, so reshaping is trivial.
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "HDF5Data"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
-  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
-  virtual void LoadHDF5FileData(const char* filename);
+  virtual void load_batch(Batch<Dtype>* batch);
+  // Opens a file, closing the current one, and lists its chunks.
+  virtual void OpenHDF5File(const char* filename);
+  // Reads the next chunk, moving to the next file at the end of this one.
+  void NextChunk();
+  // Copies the next row of the stream to row index of each of blobs.
+  void NextRow(const vector<Blob<Dtype>*>& blobs, int index);
+  void ShuffleChunks();
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
   unsigned int current_file_;
-  hsize_t current_row_;
-  std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
-  std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
+  hid_t file_id_;
+  hsize_t file_rows_;
+  std::vector<unsigned int> chunk_permutation_;
+  unsigned int current_chunk_;
+  // The rows of the current chunk, one blob per top.
+  std::vector<shared_ptr<Blob<Dtype> > > chunk_;
+  int current_row_;
+  // The rows drawn from when shuffling, one blob per top.
+  std::vector<shared_ptr<Blob<Dtype> > > shuffle_buffer_;
+  int buffered_rows_;
+  shared_ptr<Caffe::RNG> prefetch_rng_;
 };
 
 }  // namespace caffe
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
 
 namespace caffe {
 
@@ -13,6 +14,13 @@ namespace caffe {
  * @brief Also known as a "fully-connected" layer, computes an inner product
  *        with a set of learned weights, and (optionally) adds biases.
  *
+ * With quantization_param { precision: INT8 } the CPU forward pass runs on
+ * int8 weights (one scale per output) and int8 bottom data, accumulating in
+ * int32. Weights loaded as int8 (BlobProto::int8_data, one scale per output)
+ * are used as they are; others are quantized on the first such pass, and
+ * again whenever they change (see SyncedMemory::version); in TRAIN phase on
+ * every pass.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -38,6 +46,9 @@ class InnerProductLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void Forward_cpu_int8(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void QuantizeWeights();
 
   int M_;
   int K_;
@@ -45,6 +56,17 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+
+  bool int8_;  ///< if true, Forward_cpu runs in int8
+  Dtype bottom_scale_;
+  /// The source of weight_int8_ and its version, to detect weights replaced
+  /// or changed in place since they were quantized
+  const SyncedMemory* quantized_weight_mem_;
+  unsigned int quantized_weight_version_;
+  shared_ptr<SyncedMemory> weight_int8_;  ///< N_ x K_ int8 weights
+  Blob<Dtype> weight_inv_scale_;
+  shared_ptr<SyncedMemory> bottom_int8_;
+  shared_ptr<SyncedMemory> top_int32_;
 };
 
 }  // namespace caffe
@@ -32,6 +32,11 @@ template <typename Dtype> class RecurrentLayer;
  * In the implementation, the i, f, o, and g computations are performed as a
  * single inner product.
  *
+ * With recurrent_param().engine() == FUSED, the LSTM runs on the CPU without
+ * unrolling: the input projections of all timesteps are one GEMM, followed
+ * per timestep by the recurrent GEMM and the LSTMUnit nonlinearities, over
+ * buffers allocated once for all timesteps.
+ *
  * Notably, this implementation lacks the "diagonal" gates, as used in the
  * LSTM architectures described by Alex Graves [3] and others.
  *
@@ -58,6 +63,28 @@ class LSTMLayer : public RecurrentLayer<Dtype> {
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
+
+  virtual void FusedSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void FusedReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void FusedForward(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const vector<Blob<Dtype>*>& hidden_in);
+  virtual void FusedBackward(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // The buffers of the FUSED engine.
+  /// The gate inputs (i, f, o, g) of all timesteps, then their activations.
+  Blob<Dtype> gates_;
+  /// The cell states c_0 to c_T.
+  Blob<Dtype> cell_;
+  /// cont_t * h_{t-1} for all timesteps, the input of the recurrent GEMM.
+  Blob<Dtype> h_conted_;
+  /// The projection of the static input, and the diff of its gate inputs.
+  Blob<Dtype> static_gates_;
+  /// The diffs of h_{t-1} and c_{t-1} flowing back from timestep t.
+  Blob<Dtype> state_diff_;
+  Blob<Dtype> bias_multiplier_;
 };
 
 /**
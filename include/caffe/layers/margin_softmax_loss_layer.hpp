@@ -0,0 +1,90 @@
+#ifndef CAFFE_MARGIN_SOFTMAX_LOSS_LAYER_HPP_
+#define CAFFE_MARGIN_SOFTMAX_LOSS_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/loss_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes the softmax loss of the cosine similarities between the
+ *        features and the weight of each class, with a margin on the target
+ *        class, as in CosFace and ArcFace.
+ *
+ * The logit of class c for a feature x is @f$ s \cos\theta_c @f$, where
+ * @f$ \theta_c @f$ is the angle between x and the row @f$ w_c @f$ of the
+ * weight, and the logit of the label y is @f$ s (\cos\theta_y - m) @f$ with
+ * the ADDITIVE margin, or @f$ s \cos(\theta_y + m) @f$ with the ANGULAR one.
+ *
+ * This is the chain of an LpNormLayer, an InnerProductLayer on normalized
+ * weights, a margin, a ScaleLayer and a SoftmaxWithLossLayer in one layer.
+ * The classes are visited in blocks of margin_softmax_param().block_size(),
+ * keeping a running logsumexp, so that the N x C logits are never stored;
+ * Backward computes the logits of each block again along with its gradients.
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (N \times D) @f$, or any shape flattened from the axis of
+ *      margin_softmax_param().axis() on: the features @f$ x @f$
+ *   -# @f$ (N) @f$ the labels, integers in @f$ [0, C) @f$
+ * @param top output Blob vector (length 1)
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$ the softmax loss
+ */
+template <typename Dtype>
+class MarginSoftmaxLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit MarginSoftmaxLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "MarginSoftmaxLoss"; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Computes the logits of classes [begin, begin + cols) into block_, and
+  // keeps their cosines in block_ diff.
+  void BlockLogits(int begin, int cols);
+  // The target logit for a cosine, and its derivative w.r.t. the cosine.
+  Dtype MarginLogit(Dtype cosine, Dtype* derivative) const;
+  Dtype get_normalizer(int valid_count) const;
+
+  int M_;  // The number of samples.
+  int K_;  // The dimension of the features.
+  int N_;  // The number of classes.
+  int block_size_;
+  Dtype scale_;
+  Dtype margin_;
+  bool angular_;
+  bool has_ignore_label_;
+  int ignore_label_;
+  LossParameter_NormalizationMode normalization_;
+
+  // The normalized features, and the norms of the features and weight rows.
+  Blob<Dtype> x_hat_;
+  Blob<Dtype> x_norm_;
+  Blob<Dtype> w_norm_;
+  // The logits of a block of classes.
+  Blob<Dtype> block_;
+  // The gradients w.r.t. the weight rows of a block.
+  Blob<Dtype> block_weight_diff_;
+  // The logsumexp of the logits of each sample, and the label, or -1.
+  Blob<Dtype> logsumexp_;
+  vector<int> target_;
+  int valid_count_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_MARGIN_SOFTMAX_LOSS_LAYER_HPP_
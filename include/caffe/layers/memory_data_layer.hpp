@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 #include "caffe/layers/base_data_layer.hpp"
 
@@ -20,7 +21,8 @@ template <typename Dtype>
 class MemoryDataLayer : public BaseDataLayer<Dtype> {
  public:
   explicit MemoryDataLayer(const LayerParameter& param)
-      : BaseDataLayer<Dtype>(param), has_new_data_(false) {}
+      : BaseDataLayer<Dtype>(param), has_new_data_(false),
+        ring_current_(NULL) {}
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
@@ -39,6 +41,20 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   void Reset(Dtype* data, Dtype* label, int n);
   void set_batch_size(int new_size);
 
+  /**
+   * @brief Returns a free slot of the ring of memory_data_param().ring_size()
+   *        batches, blocking until Forward has released one.
+   *
+   * The data_ and label_ blobs of the slot are shaped as the tops, and are
+   * filled in place by the caller before handing the slot to CommitBatch.
+   * Several threads may fill slots at once. Forward takes the slots in the
+   * order they were committed and points the tops at their memory, without
+   * copying; a slot is released by the following Forward.
+   */
+  Batch<Dtype>* ReserveBatch();
+  /// @brief Makes a slot returned by ReserveBatch available to Forward.
+  void CommitBatch(Batch<Dtype>* batch);
+
   int batch_size() { return batch_size_; }
   int channels() { return channels_; }
   int height() { return height_; }
@@ -56,6 +72,11 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+  // The slots of ReserveBatch, and the one the tops point at.
+  vector<shared_ptr<Batch<Dtype> > > ring_;
+  BlockingQueue<Batch<Dtype>*> ring_free_;
+  BlockingQueue<Batch<Dtype>*> ring_full_;
+  Batch<Dtype>* ring_current_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,68 @@
+#ifndef CAFFE_PAIRWISE_DISTANCE_LAYER_HPP_
+#define CAFFE_PAIRWISE_DISTANCE_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Computes the distances @f$ D_{ij} = d(x_i, x_j) @f$ between all
+ *        pairs of features of a batch, so that several losses and metrics
+ *        can share them (e.g. BatchTripletLossLayer with
+ *        triplet_loss_param().precomputed_distance(), and
+ *        RetrievalAccuracyLayer).
+ *
+ * The metric is one of
+ *   - EUCLIDEAN: @f$ \left| \left| x_i - x_j \right| \right|_2^2 @f$
+ *   - COSINE: @f$ 1 - \frac{x_i \cdot x_j}{|x_i| |x_j|} @f$
+ *   - DOT: @f$ -x_i \cdot x_j @f$, so that smaller is more similar
+ * All of them are one GEMM, of cost O(N^2 D) for N features of dimension D.
+ *
+ * @param bottom input Blob vector (length 1 or 2)
+ *   -# @f$ (N \times D \times 1 \times 1) @f$ the features @f$ x @f$
+ *   -# @f$ (N \times 1 \times 1 \times 1) @f$ (optional) the labels
+ * @param top output Blob vector (length 1, or 3 with the labels)
+ *   -# @f$ (N \times N \times 1 \times 1) @f$ the distances @f$ D @f$
+ *   -# @f$ (N \times N \times 1 \times 1) @f$ the mask of the pairs of
+ *      distinct features of the same label
+ *   -# @f$ (N \times N \times 1 \times 1) @f$ the mask of the pairs of
+ *      features of different labels
+ */
+template <typename Dtype>
+class PairwiseDistanceLayer : public Layer<Dtype> {
+ public:
+  explicit PairwiseDistanceLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "PairwiseDistance"; }
+  virtual inline int MinBottomBlobs() const { return 1; }
+  virtual inline int MaxBottomBlobs() const { return 2; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 3; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  PairwiseDistanceParameter_Metric metric_;
+  // The features the metric is computed on: normalized for COSINE, as they
+  // are otherwise.
+  Blob<Dtype> x_hat_;
+  Blob<Dtype> norm_;
+  // The symmetrized gradient w.r.t. the distances.
+  Blob<Dtype> sym_diff_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_PAIRWISE_DISTANCE_LAYER_HPP_
@@ -0,0 +1,95 @@
+#ifndef CAFFE_PROXY_LOSS_LAYER_HPP_
+#define CAFFE_PROXY_LOSS_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/loss_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes a proxy-based metric learning loss, with a learnable proxy
+ *        for each class, from the cosine similarities @f$ s(x, p) @f$ of the
+ *        features to the proxies.
+ *
+ * With the NCA method (ProxyNCA, with the positive proxy in the denominator
+ * as in ProxyNCA++), the loss of a feature x of class y is
+ * @f$ -\log \frac{\exp(\alpha s(x, p_y))}{\sum_p \exp(\alpha s(x, p))} @f$,
+ * averaged over the batch. With the ANCHOR method (ProxyAnchor), it is
+ * @f$ \frac{1}{|P^+|} \sum_{p \in P^+} \log(1 + \sum_{x \in X_p^+}
+ *    e^{-\alpha (s(x, p) - \delta)}) + \frac{1}{|P|} \sum_{p \in P}
+ *    \log(1 + \sum_{x \in X_p^-} e^{\alpha (s(x, p) + \delta)}) @f$,
+ * where @f$ P^+ @f$ are the proxies of the classes in the batch, and
+ * @f$ X_p^+ @f$ and @f$ X_p^- @f$ the features of the class of p and of the
+ * other classes.
+ *
+ * The similarities of all features to all proxies are one GEMM, so the cost
+ * is O(N C D) for N features of dimension D and C classes, without any
+ * sampling of pairs or triplets. With proxy_loss_param().batch_proxies_only(),
+ * only the proxies of the classes of the batch take part in the loss and
+ * receive gradients (see Layer::sparse_param_rows).
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (N \times D \times 1 \times 1) @f$ the features @f$ x @f$
+ *   -# @f$ (N \times 1 \times 1 \times 1) @f$ the labels, in @f$ [0, C) @f$
+ * @param top output Blob vector (length 1 or 2)
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$ the loss
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$ (optional) the rate of
+ *      features whose most similar proxy is that of their class
+ */
+template <typename Dtype>
+class ProxyLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit ProxyLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "ProxyLoss"; }
+  virtual inline int ExactNumTopBlobs() const { return -1; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+  virtual const vector<int>* sparse_param_rows(const int param_id) const {
+    return batch_proxies_only_ ? &used_rows_ : NULL;
+  }
+  virtual void ClearSparseParamRows();
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  int M_;  // The number of features.
+  int K_;  // The dimension of the features.
+  int N_;  // The number of classes.
+  bool anchor_;
+  Dtype alpha_;
+  Dtype margin_;
+  bool batch_proxies_only_;
+
+  // The normalized features and proxies, and their norms.
+  Blob<Dtype> x_hat_;
+  Blob<Dtype> x_norm_;
+  Blob<Dtype> p_hat_;
+  Blob<Dtype> p_norm_;
+  // The similarities of the features to the proxies, then the gradients
+  // w.r.t. them.
+  Blob<Dtype> sim_;
+  // The classes taking part in the loss.
+  vector<bool> class_used_;
+  // The rows of the proxies with a gradient, with batch_proxies_only.
+  vector<int> used_rows_;
+  vector<bool> row_used_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_PROXY_LOSS_LAYER_HPP_
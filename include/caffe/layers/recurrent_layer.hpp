@@ -26,7 +26,7 @@ template <typename Dtype>
 class RecurrentLayer : public Layer<Dtype> {
  public:
   explicit RecurrentLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), fused_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -95,6 +95,39 @@ class RecurrentLayer : public Layer<Dtype> {
    */
   virtual void OutputBlobNames(vector<string>* names) const = 0;
 
+  /**
+   * @brief Sets up the FUSED engine, which runs the recurrence in a loop over
+   *        preallocated buffers rather than in the unrolled net: fills blobs_
+   *        with the parameters the unrolled net would have, in the same order
+   *        and shapes.  Subclasses supporting the FUSED engine should define
+   *        this and the Fused* methods below -- see RNNLayer and LSTMLayer.
+   */
+  virtual void FusedSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Reshapes top[0] and the buffers of the FUSED engine.
+  virtual void FusedReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {}
+
+  /**
+   * @brief Runs the FUSED engine forward from the hidden state hidden_in,
+   *        leaving the hidden state at the last timestep in hidden_.
+   *        hidden_in may be hidden_ itself, and is read before hidden_ is
+   *        written.
+   */
+  virtual void FusedForward(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& hidden_in) {}
+
+  /**
+   * @brief Runs the FUSED engine backward through the timesteps of the last
+   *        FusedForward. As with the unrolled net, no gradient flows to the
+   *        hidden state inputs, nor from the hidden state outputs.
+   */
+  virtual void FusedBackward(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {}
+
   /**
    * @param bottom input Blob vector (length 2-3)
    *
@@ -174,6 +207,15 @@ class RecurrentLayer : public Layer<Dtype> {
    */
   bool expose_hidden_;
 
+  /// @brief Whether the layer runs on the FUSED engine, without unrolled_net_.
+  bool fused_;
+
+  /**
+   * @brief The hidden state of the FUSED engine at the last timestep, which
+   *        is the initial state of the next batch unless expose_hidden_.
+   */
+  vector<shared_ptr<Blob<Dtype> > > hidden_;
+
   vector<Blob<Dtype>* > recur_input_blobs_;
   vector<Blob<Dtype>* > recur_output_blobs_;
   vector<Blob<Dtype>* > output_blobs_;
@@ -0,0 +1,71 @@
+#ifndef CAFFE_RETRIEVAL_ACCURACY_LAYER_HPP_
+#define CAFFE_RETRIEVAL_ACCURACY_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Computes the in-batch retrieval accuracy (Recall@K) from the
+ *        distances and label masks of a PairwiseDistanceLayer: the fraction
+ *        of the queries whose K nearest neighbours in the batch include one
+ *        of the same label.
+ *
+ * Each feature of the batch is a query against the others. A query with no
+ * feature of the same label is left out. A feature of a different label at
+ * the same distance as the nearest one of the same label ranks before it.
+ */
+template <typename Dtype>
+class RetrievalAccuracyLayer : public Layer<Dtype> {
+ public:
+  /**
+   * @param param provides AccuracyParameter accuracy_param,
+   *     with RetrievalAccuracyLayer options:
+   *   - top_k (\b optional, default 1).
+   *     The number of nearest neighbours @f$ K @f$ retrieved per query.
+   */
+  explicit RetrievalAccuracyLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "RetrievalAccuracy"; }
+  virtual inline int ExactNumBottomBlobs() const { return 3; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  /**
+   * @param bottom input Blob vector (length 3)
+   *   -# @f$ (N \times N \times 1 \times 1) @f$
+   *      the distances @f$ D @f$, smaller being more similar
+   *   -# @f$ (N \times N \times 1 \times 1) @f$
+   *      the mask of the pairs of distinct features of the same label
+   *   -# @f$ (N \times N \times 1 \times 1) @f$
+   *      the mask of the pairs of features of different labels
+   * Pairs in neither mask, such as a feature and itself, are not retrieved.
+   * @param top output Blob vector (length 1)
+   *   -# @f$ (1 \times 1 \times 1 \times 1) @f$
+   *      the Recall@K over the queries with a feature of the same label
+   */
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Not implemented -- RetrievalAccuracyLayer cannot be used as a loss.
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    for (int i = 0; i < propagate_down.size(); ++i) {
+      if (propagate_down[i]) { NOT_IMPLEMENTED; }
+    }
+  }
+
+  int top_k_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_RETRIEVAL_ACCURACY_LAYER_HPP_
@@ -25,6 +25,11 @@ template <typename Dtype> class RecurrentLayer;
  * @f$, and outputs @f$
  *     o_t := \tanh[ W_{ho} h_t + b_o ]
  * @f$.
+ *
+ * With recurrent_param().engine() == FUSED, the RNN runs on the CPU without
+ * unrolling: the input projections of all timesteps are one GEMM, followed
+ * by the recurrent GEMM of each timestep, and the outputs of all timesteps
+ * are one GEMM again.
  */
 template <typename Dtype>
 class RNNLayer : public RecurrentLayer<Dtype> {
@@ -40,6 +45,28 @@ class RNNLayer : public RecurrentLayer<Dtype> {
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
+
+  virtual void FusedSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void FusedReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void FusedForward(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top, const vector<Blob<Dtype>*>& hidden_in);
+  virtual void FusedBackward(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // The buffers of the FUSED engine.
+  /// The hidden states h_1 to h_T, with the diffs of their inputs.
+  Blob<Dtype> h_;
+  /// cont_t * h_{t-1} for all timesteps, the input of the recurrent GEMM.
+  Blob<Dtype> h_conted_;
+  /// The diff of the inputs of the output tanh.
+  Blob<Dtype> o_input_diff_;
+  /// The projection of the static input, and the diff of its hidden inputs.
+  Blob<Dtype> static_h_;
+  /// The diff of h_{t-1} flowing back from timestep t.
+  Blob<Dtype> h_next_diff_;
+  Blob<Dtype> bias_multiplier_;
 };
 
 }  // namespace caffe
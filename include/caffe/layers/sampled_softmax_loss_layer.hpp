@@ -0,0 +1,150 @@
+#ifndef CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+#define CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+
+#include <boost/function.hpp>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/layers/loss_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes the softmax loss of a linear classifier over a large number
+ *        of classes, equivalent to an InnerProductLayer followed by a
+ *        SoftmaxWithLossLayer, with the classifier weight as a param of this
+ *        layer.
+ *
+ * The classes are split into sampled_softmax_param().num_shards() shards,
+ * computed in parallel on ThreadPool::Shared(): a shard computes the logits
+ * of its classes and their partial logsumexp, and only those are combined
+ * across shards. The gradients w.r.t. the weight of a shard are computed by
+ * its task as well. A shard computes its logits in blocks of at most
+ * block_size() values, recomputing them in the backward pass when they take
+ * more than one block, so the logits of the whole batch are never held.
+ *
+ * With num_sampled() > 0, each training batch only uses the classes of its
+ * labels and num_sampled() other classes drawn uniformly. The sum of the
+ * exponentiated logits of the classes not in the batch is estimated from the
+ * drawn ones, and only the rows of the weight of the used classes receive
+ * gradients (see Layer::sparse_param_rows). The exact loss over all classes
+ * is computed in the TEST phase.
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (N \times D) @f$, or any shape flattened from the axis of
+ *      sampled_softmax_param().axis() on: the features @f$ x @f$
+ *   -# @f$ (N) @f$ the labels, integers in @f$ [0, C) @f$
+ * @param top output Blob vector (length 1)
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$ the softmax loss
+ */
+template <typename Dtype>
+class SampledSoftmaxLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit SampledSoftmaxLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "SampledSoftmaxLoss"; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+  virtual const vector<int>* sparse_param_rows(const int param_id) const {
+    return num_sampled_ > 0 ? &used_rows_ : NULL;
+  }
+  virtual void ClearSparseParamRows();
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Draws the classes of the batch, and gathers their weight and bias.
+  void SampleClasses(const Dtype* label);
+  // Computes the M_ x cols logits of the classes [begin, begin + cols).
+  void ComputeLogits(int begin, int cols, Dtype* logits);
+  // Computes the logits of the classes of shard block by block, their
+  // partial logsumexp for each sample, and the logits of the labels.
+  void ForwardShard(int shard);
+  // Turns the logits of shard into gradients w.r.t. them, block by block,
+  // and backpropagates those to the weight, the bias and the bottom diff of
+  // the shard.
+  void BackwardShard(int shard);
+  // Runs fn for each shard on shard_pool_, the calling thread taking part.
+  void RunShards(const boost::function<void(int)>& fn);
+  Dtype get_normalizer(int valid_count) const;
+
+  int M_;  // The number of samples.
+  int K_;  // The dimension of the features.
+  int N_;  // The number of classes.
+  int num_sampled_;
+  int num_shards_;
+  int block_size_;
+  bool bias_term_;
+  bool has_ignore_label_;
+  int ignore_label_;
+  LossParameter_NormalizationMode normalization_;
+  Blob<Dtype> bias_multiplier_;
+
+  // The classes of the current batch: all of them, or when sampling, the
+  // classes of the labels followed by the drawn ones, whose logits are
+  // offset by sampled_log_weight_.
+  bool sampling_;
+  int num_classes_;
+  int num_labels_;
+  vector<int> classes_;
+  vector<int> class_index_;
+  Dtype sampled_log_weight_;
+  // The gathered weight and bias of classes_ when sampling.
+  Blob<Dtype> sampled_weight_;
+  Blob<Dtype> sampled_bias_;
+  // The column of the label of each sample among the classes, or -1.
+  vector<int> target_;
+  int valid_count_;
+  // The first class of each shard, and the number of classes last.
+  vector<int> shard_begin_;
+  // The classes of a block of logits, at most block_size_ / M_.
+  int block_cols_;
+  // The logits, then the gradients w.r.t. them, of a block of classes of
+  // each shard, each an M_ x (classes of the block) matrix.
+  Blob<Dtype> logits_;
+  // The logit of the label of each sample.
+  Blob<Dtype> target_logit_;
+  // The max logit and the sum of exp(logit - max) of each shard and sample.
+  Blob<Dtype> shard_max_;
+  Blob<Dtype> shard_sum_;
+  // The logsumexp over all classes of each sample.
+  Blob<Dtype> logsumexp_;
+  // The bottom diff computed by each shard but the first.
+  Blob<Dtype> shard_bottom_diff_;
+  // The rows of the weight and bias with a gradient, when sampling.
+  vector<int> used_rows_;
+  vector<bool> row_used_;
+
+  shared_ptr<ThreadPool> shard_pool_;
+  // The buffers of the current pass, taken before the shards run, so that
+  // the threads do not touch the blobs.
+  const Dtype* bottom_data_;
+  const Dtype* weight_;
+  const Dtype* bias_;
+  Dtype* logits_data_;
+  Dtype* target_logit_data_;
+  Dtype* shard_max_data_;
+  Dtype* shard_sum_data_;
+  const Dtype* logsumexp_data_;
+  Dtype* weight_diff_;
+  Dtype* bias_diff_;
+  Dtype* bottom_diff_;
+  Dtype* shard_bottom_diff_data_;
+  Dtype loss_scale_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
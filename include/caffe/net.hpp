@@ -14,6 +14,9 @@
 
 namespace caffe {
 
+class FlatWeights;
+template <typename Dtype> class NetProfiler;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -61,8 +64,18 @@ class Net {
   /**
    * @brief Zeroes out the diffs of all net parameters.
    *        Should be run before Backward.
+   *
+   * Only the tracked rows of the params with SparseParamRows are zeroed.
    */
   void ClearParamDiffs();
+  /**
+   * @brief Returns whether the diff of learnable param param_id is nonzero
+   *        only in some rows, filling rows with them in increasing order.
+   *
+   * This holds on the CPU, with a single solver, when all the layers using
+   * the param track the rows they write to (see Layer::sparse_param_rows).
+   */
+  bool SparseParamRows(int param_id, vector<int>* rows) const;
 
   /**
    * The network backward should take no input and output, since it solely
@@ -104,6 +117,11 @@ class Net {
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief For an already initialized net, copies the values of the trained
+   *        layers of another Net into its own params, which stay unshared.
+   */
+  void CopyTrainedLayersFrom(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -114,6 +132,16 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Loads the pre-trained layers from a memory mapped flat weights file
+   *        (see caffe/util/flat_weights.hpp).
+   *
+   * If alias is set and the file stores Dtype, the params point into the
+   * mapping instead of holding a copy, and the net keeps the mapping open;
+   * the params must then not be kept beyond the net.
+   */
+  void CopyTrainedLayersFromFlat(const string trained_filename,
+      bool alias = false);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
@@ -215,6 +243,18 @@ class Net {
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
   void set_debug_info(const bool value) { debug_info_ = value; }
+  /**
+   * @brief Starts or stops recording every layer call into profiler().
+   *
+   * The profiler is created on first use and keeps its statistics while
+   * profiling is off; call profiler()->Reset() to clear them.
+   */
+  void set_profiling(const bool value);
+  inline bool profiling() const { return profiling_; }
+  /// @brief The profiler, or NULL if profiling was never enabled.
+  inline const shared_ptr<NetProfiler<Dtype> >& profiler() const {
+    return profiler_;
+  }
 
   // Helpers for Init.
   /**
@@ -305,6 +345,11 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether to record layer calls into profiler_.
+  bool profiling_;
+  shared_ptr<NetProfiler<Dtype> > profiler_;
+  /// The flat weights files the params alias.
+  vector<shared_ptr<FlatWeights> > mapped_weights_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
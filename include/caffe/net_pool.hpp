@@ -0,0 +1,61 @@
+#ifndef CAFFE_NET_POOL_HPP_
+#define CAFFE_NET_POOL_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A pool of nets sharing the same params, for concurrent inference.
+ *
+ * The trained weights are loaded once, into the first net, and the other
+ * nets share them through Net::ShareTrainedLayersWith, so the pool holds the
+ * weights once and the activations of each net. A thread runs Forward on a
+ * net taken with Acquire, and gives it back with Release. The params must
+ * not be modified while the nets are in use. The mode and device of the
+ * threads are those of their own Caffe singleton.
+ */
+template <typename Dtype>
+class NetPool {
+ public:
+  /**
+   * @brief Creates size nets from param, with the weights of
+   *        trained_filename if not empty.
+   */
+  NetPool(const NetParameter& param, const string& trained_filename,
+      int size);
+  NetPool(const string& param_file, Phase phase,
+      const string& trained_filename, int size);
+
+  /// @brief Takes a net from the pool, waiting for one to be released.
+  Net<Dtype>* Acquire();
+  /// @brief Takes a net from the pool if one is free, else returns NULL.
+  Net<Dtype>* TryAcquire();
+  /// @brief Returns a net taken with Acquire to the pool.
+  void Release(Net<Dtype>* net);
+
+  inline int size() const { return nets_.size(); }
+  /// @brief Returns the net holding the weights, shared by the others.
+  inline const shared_ptr<Net<Dtype> >& weights_net() const {
+    return nets_[0];
+  }
+
+ protected:
+  void Init(const NetParameter& param, const string& trained_filename,
+      int size);
+
+  vector<shared_ptr<Net<Dtype> > > nets_;
+  BlockingQueue<Net<Dtype>*> free_;
+
+  DISABLE_COPY_AND_ASSIGN(NetPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_NET_POOL_HPP_
@@ -14,6 +14,8 @@
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
+namespace boost { class barrier; }
+
 namespace caffe {
 
 // Represents a net parameters. Once a net is created, its parameter buffers can
@@ -59,6 +61,25 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::diff_;
 };
 
+// Params stored in host memory. Solvers configured with params built on an
+// existing CPUParams share its weights, and only own their gradients.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  CPUParams(shared_ptr<Solver<Dtype> > root_solver,
+            const CPUParams<Dtype>* shared);
+  virtual ~CPUParams();
+
+  void configure(Solver<Dtype>* solver) const;
+
+ protected:
+  const bool owns_data_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 class DevicePair {
  public:
   DevicePair(int parent, int device)
@@ -116,6 +137,54 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
   using Params<Dtype>::diff_;
 };
 
+// Synchronous data parallelism between threads of a CPU host. All solvers
+// run on the root's weights, and each gradient buffer is reduced in shared
+// memory: every worker sums its own slice of the gradients of all solvers
+// into the root's, which then applies the update alone.
+//
+// If the root thread is placed on a NUMA node, workers are spread over the
+// nodes round robin, and each is built and run pinned to its node so that
+// its net, gradients and data threads live in local memory.
+template<typename Dtype>
+class CPUSync : public CPUParams<Dtype>, public Solver<Dtype>::Callback,
+    public InternalThread {
+ public:
+  explicit CPUSync(shared_ptr<Solver<Dtype> > root_solver);
+  virtual ~CPUSync();
+
+  inline const shared_ptr<Solver<Dtype> >& solver() const {
+    return solver_;
+  }
+
+  // Trains with the root solver and workers - 1 worker solvers, each on its
+  // own thread. Caffe::solver_count() should be set to workers beforehand.
+  void Run(int workers);
+  void Prepare(int workers, vector<shared_ptr<CPUSync<Dtype> > >* syncs);
+  inline const int initial_iter() const { return initial_iter_; }
+
+ protected:
+  CPUSync(shared_ptr<Solver<Dtype> > root_solver, CPUSync<Dtype>* root,
+          int rank, int numa_node);
+
+  void on_start();
+  void on_gradients_ready();
+
+  void InternalThreadEntry();
+
+  CPUSync<Dtype>* root_;
+  const int rank_;
+  const int numa_node_;
+  // Set on the root only: all solvers by rank, and the barrier they meet at.
+  vector<CPUSync<Dtype>*> syncs_;
+  shared_ptr<boost::barrier> barrier_;
+  const int initial_iter_;
+  shared_ptr<Solver<Dtype> > solver_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 }  // namespace caffe
 
 #endif
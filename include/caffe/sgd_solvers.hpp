@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -36,11 +37,59 @@ class SGDSolver : public Solver<Dtype> {
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
+  virtual bool StageSolverState(SolverState* state,
+      vector<shared_ptr<Blob<Dtype> > >* history);
+
+  // The fused CPU update (SolverParameter.fused_update). FusedPreSolve lays
+  // out the params, diffs and history in flat buffers before the first
+  // update. FusedUpdate then computes and applies the update of elements
+  // [begin, end) of them, which all belong to param param_id, in one pass;
+  // solvers override it along with ComputeUpdateValue. The params with
+  // Net::SparseParamRows are always updated this way, calling FusedUpdate on
+  // their rows with a gradient only: momentum and regularization are lazy.
+  void FusedPreSolve();
+  void FusedApplyUpdate(Dtype rate);
+  void FusedUpdateRange(int begin, int end, Dtype rate);
+  // Updates part part of parts equal ranges of the flat buffers.
+  void FusedUpdatePart(int parts, Dtype rate, int part);
+  void FusedSparseUpdate(int param_id, int begin, int end, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end, Dtype rate);
+  // The normalized and regularized gradient of element i of the flat buffers.
+  inline Dtype FusedGradient(int i, Dtype local_decay) const {
+    const Dtype w = fused_data_[i];
+    const Dtype decay_term = fused_l1_ ?
+        Dtype((Dtype(0) < w) - (w < Dtype(0))) : w;
+    return fused_normalization_ * fused_diff_[i] + local_decay * decay_term;
+  }
+  inline Dtype LocalDecay(int param_id) const {
+    return this->param_.weight_decay() *
+        this->net_->params_weight_decay()[param_id];
+  }
+
   // history maintains the historical momentum data.
   // update maintains update related data and is not needed in snapshots.
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // The flat buffers of the fused update. The params are only moved into
+  // flat_data_ and flat_diff_ if they are not contiguous already, e.g. in
+  // the buffers of CPUParams.
+  shared_ptr<Blob<Dtype> > flat_data_, flat_diff_;
+  vector<shared_ptr<Blob<Dtype> > > flat_history_;
+  // The offset of each param in the flat buffers, and their total size last.
+  vector<int> fused_offsets_;
+  Dtype* fused_data_;
+  Dtype* fused_diff_;
+  vector<Dtype*> fused_history_;
+  Dtype fused_normalization_;
+  bool fused_l1_;
+  // Whether each param is sparse in this update, and its rows if so, for
+  // ClipGradients and the fused update.
+  vector<bool> fused_sparse_;
+  vector<vector<int> > fused_rows_;
+  // The workers the fused update is split over, kept from one update to the
+  // next: ThreadPool::Shared().
+  shared_ptr<ThreadPool> update_pool_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -56,6 +105,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +121,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +142,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +167,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +192,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -31,6 +31,8 @@ namespace caffe {
  */
 typedef boost::function<SolverAction::Enum()> ActionCallback;
 
+template <typename Dtype> class SnapshotWriter;
+
 /**
  * @brief An interface for classes that perform optimization on Net%s.
  *
@@ -66,6 +68,8 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
+  // Waits for the snapshots written in the background (snapshot_async).
+  void FlushSnapshots();
   virtual ~Solver() {}
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
@@ -73,6 +77,11 @@ class Solver {
     return test_nets_;
   }
   int iter() { return iter_; }
+  // Profiling of the train net can be turned on, off or changed during
+  // training; see SolverParameter::profile_interval.
+  void set_profile_interval(int interval) {
+    param_.set_profile_interval(interval);
+  }
 
   // Invoked at specific points during an iteration
   class Callback {
@@ -103,11 +112,38 @@ class Solver {
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
+  // Copies the weights into a test net and tests it in the background
+  // (test_async).
+  void TestAsync(const int test_net_id);
+  // Waits for the tests running in the background.
+  void WaitForTests();
+  // Runs the test_iter forward passes of a test net, summing its outputs.
+  // Returns false if a stop was requested; requests are only checked if
+  // check_requests is set.
+  bool TestForward(const int test_net_id, bool check_requests,
+      vector<Dtype>* test_score, vector<int>* test_score_output_id,
+      Dtype* loss);
+  // Logs the mean test outputs, each line starting with prefix.
+  void DisplayTestScores(const int test_net_id,
+      const vector<Dtype>& test_score, const vector<int>& test_score_output_id,
+      Dtype loss, const string& prefix);
   virtual void SnapshotSolverState(const string& model_filename) = 0;
+  // Hands a copy of the snapshot to snapshot_writer_; returns false if the
+  // solver state cannot be staged.
+  bool SnapshotAsync();
+  // Fills state with the solver state to snapshot, except for its history,
+  // whose blobs are copied into history instead. Solvers that support
+  // snapshot_async implement it and return true.
+  virtual bool StageSolverState(SolverState* state,
+      vector<shared_ptr<Blob<Dtype> > >* history) { return false; }
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
+  // Logs the profile of the train net, writes its trace and resets it.
+  void ReportProfile();
+  // Logs and resets the prefetch counters of the train net's data layers.
+  void ReportDataStats();
 
   SolverParameter param_;
   int iter_;
@@ -129,6 +165,14 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Writes snapshots in the background, if snapshot_async is set.
+  shared_ptr<SnapshotWriter<Dtype> > snapshot_writer_;
+
+  // Tests a test net in the background, if test_async is set. Declared last
+  // so that the threads stop before the nets they use are destroyed.
+  class TestThread;
+  vector<shared_ptr<TestThread> > test_threads_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
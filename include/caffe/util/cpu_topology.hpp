@@ -0,0 +1,51 @@
+#ifndef CAFFE_UTIL_CPU_TOPOLOGY_HPP_
+#define CAFFE_UTIL_CPU_TOPOLOGY_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The NUMA nodes of the host and the CPUs of each, as listed under
+ *        /sys/devices/system/node. Hosts without that information are seen
+ *        as a single node holding all online CPUs.
+ */
+class CPUTopology {
+ public:
+  static const CPUTopology& Get();
+
+  inline int num_nodes() const { return node_cpus_.size(); }
+  inline const vector<int>& cpus(int node) const {
+    CHECK_GE(node, 0);
+    CHECK_LT(node, num_nodes());
+    return node_cpus_[node];
+  }
+  int num_cpus() const;
+  /// @brief Describes the nodes, e.g. "node 0: CPUs 0-7, node 1: CPUs 8-15".
+  string Describe() const;
+
+ private:
+  CPUTopology();
+
+  vector<vector<int> > node_cpus_;
+
+  DISABLE_COPY_AND_ASSIGN(CPUTopology);
+};
+
+/// @brief Parses a kernel CPU list such as "0-3,8,10-11".
+bool ParseCPUList(const string& list, vector<int>* cpus);
+/// @brief Formats CPUs back into the kernel list format.
+string FormatCPUList(const vector<int>& cpus);
+
+/**
+ * @brief Restricts the calling thread to the given CPUs, or lets it run on
+ *        any CPU if cpus is empty. Returns false where unsupported.
+ */
+bool SetThreadAffinity(const vector<int>& cpus);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CPU_TOPOLOGY_HPP_
@@ -83,6 +83,9 @@ class LMDB : public DB {
   }
   virtual LMDBCursor* NewCursor();
   virtual LMDBTransaction* NewTransaction();
+  // Sets the size of the map, e.g. to avoid growing it repeatedly while
+  // writing a large db. Must be called with no transaction active.
+  void SetMapSize(size_t size);
 
  private:
   MDB_env* mdb_env_;
@@ -0,0 +1,60 @@
+#ifndef CAFFE_UTIL_FLAT_WEIGHTS_HPP_
+#define CAFFE_UTIL_FLAT_WEIGHTS_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A memory mapped file of trained weights in the flat format.
+ *
+ * The file starts with a header holding the magic "CAFFEFLT" and the offset
+ * and size of a FlatWeightsIndex message, which is stored at its end. The
+ * data of every param blob is stored in between as a raw array of the type
+ * of the index, in host byte order, starting at an offset aligned to
+ * kFlatWeightsAlignment. Loading the weights thus takes a single copy from
+ * the page cache, or none when the blobs alias the mapping, in which case
+ * processes loading the same file share its pages.
+ */
+class FlatWeights {
+ public:
+  explicit FlatWeights(const string& filename);
+  ~FlatWeights();
+
+  inline const string& filename() const { return filename_; }
+  inline const FlatWeightsIndex& index() const { return index_; }
+  /// @brief Returns the mapped data of a param, of the type of the index.
+  const void* data(const FlatWeightsIndex::Param& param) const;
+  /// @brief Copies the data of a param to dst, converting it to Dtype.
+  template <typename Dtype>
+  void CopyTo(const FlatWeightsIndex::Param& param, Dtype* dst) const;
+
+ private:
+  string filename_;
+  int fd_;
+  char* map_;
+  size_t size_;
+  FlatWeightsIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(FlatWeights);
+};
+
+const int kFlatWeightsAlignment = 64;
+const char kFlatWeightsExtension[] = ".caffeflat";
+
+/// @brief Returns true if filename has the flat weights extension.
+bool IsFlatWeightsFilename(const string& filename);
+
+/**
+ * @brief Writes the params of the layers of param to filename in the flat
+ *        format, stored as Dtype.
+ */
+template <typename Dtype>
+void WriteFlatWeights(const NetParameter& param, const string& filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FLAT_WEIGHTS_HPP_
@@ -0,0 +1,77 @@
+#ifndef CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+#define CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+
+#include <cstddef>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A process-wide cache of host memory blocks, used by SyncedMemory
+ *        for its CPU buffers.
+ *
+ * Requests are rounded up to a size class (a multiple of a quarter of their
+ * power of two, so at most 25% is wasted) and freed blocks are kept per class
+ * for reuse, which saves the allocator round trips of Blobs that are
+ * reshaped every batch. Blocks are aligned to 64 bytes. Blocks of
+ * kHugePageSize and more are mapped directly and, if enabled, backed by
+ * transparent huge pages.
+ *
+ * The pool can be disabled, in which case freed blocks are released at
+ * once; blocks allocated while it was enabled can still be freed.
+ *
+ * Freed blocks are only reused by threads on the same Caffe::numa_node().
+ */
+class HostMemoryPool {
+ public:
+  struct Stats {
+    /// Bytes of blocks handed out and not yet freed.
+    size_t in_use_bytes;
+    /// Bytes of freed blocks kept for reuse.
+    size_t cached_bytes;
+    /// The largest in_use_bytes + cached_bytes seen.
+    size_t peak_bytes;
+    /// Allocations served from the cache, and those that were not.
+    size_t hits;
+    size_t misses;
+
+    inline double hit_rate() const {
+      return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses)
+          : 0;
+    }
+  };
+
+  static const size_t kAlignment = 64;
+  static const size_t kHugePageSize = 2 << 20;
+
+  /// @brief Returns a 64-byte aligned block of at least size bytes.
+  static void* Allocate(size_t size);
+  /// @brief Returns a block obtained with Allocate(size) to the pool.
+  static void Free(void* ptr, size_t size);
+  /// @brief The number of bytes actually reserved for a request of size.
+  static size_t SizeClass(size_t size);
+
+  static Stats stats();
+  /// @brief Releases all cached blocks to the system.
+  static void Trim();
+
+  static void set_enabled(bool enabled);
+  static bool enabled();
+  /// @brief Freed blocks beyond this many cached bytes are released instead
+  ///        of cached. Defaults to 1 GB.
+  static void set_max_cached_bytes(size_t bytes);
+  /// @brief Advises the kernel to back large blocks with huge pages.
+  static void set_use_huge_pages(bool use);
+
+ private:
+  class Impl;
+  static Impl& Get();
+
+  HostMemoryPool();
+  DISABLE_COPY_AND_ASSIGN(HostMemoryPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
@@ -0,0 +1,86 @@
+#ifndef CAFFE_UTIL_NET_PROFILER_HPP_
+#define CAFFE_UTIL_NET_PROFILER_HPP_
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+
+namespace caffe {
+
+template <typename Dtype> class Net;
+
+/**
+ * @brief Records per-layer wall time, estimated FLOPs, bytes moved and blob
+ *        memory of the Forward and Backward passes of a Net.
+ *
+ * Enabled with Net::set_profiling (or SolverParameter::profile_interval during
+ * training), the profiler sees every layer call the net makes, so data layer
+ * stalls on the prefetch queue show up as time spent in the data layer.
+ * FLOPs and bytes are estimates derived from the blob shapes at call time.
+ * The statistics can be printed as a table with Summary() and the individual
+ * calls exported as a Chrome trace (chrome://tracing) with WriteChromeTrace().
+ */
+template <typename Dtype>
+class NetProfiler {
+ public:
+  struct LayerStats {
+    string name;
+    string type;
+    int forward_count;
+    int backward_count;
+    double forward_ms;
+    double backward_ms;
+    double forward_flops;
+    double backward_flops;
+    double bytes_read;
+    double bytes_written;
+    /// Bytes held by the top blobs and params (data and diff) of the layer.
+    size_t memory_bytes;
+  };
+
+  /// @param max_trace_events bounds the memory used by the Chrome trace;
+  ///        further calls are still counted in the statistics.
+  explicit NetProfiler(const Net<Dtype>& net, int max_trace_events = 1000000);
+
+  /// @brief Marks the beginning of a layer call.
+  void Start();
+  /// @brief Marks the end of the call of layer layer_id started by Start().
+  void Stop(int layer_id, bool backward);
+  /// @brief Clears the statistics and the trace.
+  void Reset();
+
+  inline const vector<LayerStats>& stats() const { return stats_; }
+  /// @brief Estimated forward FLOPs of layer layer_id at its current shapes.
+  double ForwardFlops(int layer_id) const;
+  /// @brief Returns a table of the statistics, sorted by total time.
+  string Summary() const;
+  /// @brief Writes the recorded calls in the Chrome trace event format.
+  void WriteChromeTrace(const string& filename) const;
+
+ protected:
+  struct TraceEvent {
+    int layer_id;
+    bool backward;
+    double ts_us;
+    double dur_us;
+  };
+
+  const Net<Dtype>& net_;
+  vector<LayerStats> stats_;
+  vector<TraceEvent> events_;
+  int max_trace_events_;
+  int dropped_events_;
+  Timer timer_;
+  boost::posix_time::ptime origin_;
+  double start_us_;
+
+  DISABLE_COPY_AND_ASSIGN(NetProfiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NET_PROFILER_HPP_
@@ -0,0 +1,58 @@
+#ifndef CAFFE_UTIL_QUANTIZE_HPP_
+#define CAFFE_UTIL_QUANTIZE_HPP_
+
+#include <stdint.h>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Symmetric int8 quantization helpers used by the INT8 CPU inference path of
+// ConvolutionLayer and InnerProductLayer (see QuantizationParameter).
+// A real value x is represented as q = saturate(round(x * scale)), so the
+// scale of a tensor with largest magnitude m is 127 / m.
+
+// Returns 127 / max_i |x_i|, or 1 if x is all zeros.
+template <typename Dtype>
+Dtype caffe_cpu_int8_scale(const int n, const Dtype* x);
+
+// q[i] = saturate(round(x[i] * scale))
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* q);
+
+// Quantizes the rows x cols row-major matrix x into its cols x rows
+// transpose q, so that the reduction axis of an im2col buffer becomes
+// contiguous for caffe_cpu_gemm_int8.
+template <typename Dtype>
+void caffe_cpu_quantize_transpose(const int rows, const int cols,
+    const Dtype scale, const Dtype* x, int8_t* q);
+
+// Quantizes each row of the rows x cols row-major matrix x with its own scale
+// and stores the reciprocal of that scale in inv_scale[row].
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* x,
+    int8_t* q, Dtype* inv_scale);
+
+// C = A * B^T with int32 accumulation, where A is M x K and B is N x K, both
+// row-major, so that every output is a dot product of two contiguous rows.
+// The values must be in [-127, 127], as caffe_cpu_quantize makes them. Runs
+// an AVX-512 VNNI or AVX2 kernel when the CPU has one, and large products on
+// ThreadPool::Shared().
+void caffe_cpu_gemm_int8(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C);
+
+// Y = alpha * C, additionally scaled by row_scale[m] and/or col_scale[n]
+// when those are not NULL. C and Y are M x N row-major.
+template <typename Dtype>
+void caffe_cpu_requantize(const int M, const int N, const int32_t* C,
+    const Dtype alpha, const Dtype* row_scale, const Dtype* col_scale,
+    Dtype* Y);
+
+// Rewrites the float data of a BlobProto as int8_data with one scale per
+// slice along the first axis (the output channels of a weight blob).
+void QuantizeBlobProto(BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_HPP_
@@ -9,8 +9,10 @@ namespace caffe {
 class SignalHandler {
  public:
   // Contructor. Specify what action to take when a signal is received.
+  // With handle_SIGTERM, SIGTERM is caught as well and taken as a SIGINT.
   SignalHandler(SolverAction::Enum SIGINT_action,
-                SolverAction::Enum SIGHUP_action);
+                SolverAction::Enum SIGHUP_action,
+                bool handle_SIGTERM = false);
   ~SignalHandler();
   ActionCallback GetActionFunction();
  private:
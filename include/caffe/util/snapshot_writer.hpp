@@ -0,0 +1,74 @@
+#ifndef CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+#define CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Writes solver snapshots from a background thread
+ *        (SolverParameter.snapshot_async).
+ *
+ * The solver copies its weights and history into a Staging, which only takes
+ * a memcpy of each blob, and the writer serializes and writes it while
+ * training goes on. Stagings are allocated once and reused; when all of them
+ * are still being written, Acquire waits, which bounds the memory and the
+ * number of snapshots in flight.
+ */
+template <typename Dtype>
+class SnapshotWriter : public InternalThread {
+ public:
+  // A snapshot copied out of the solver, waiting to be written.
+  struct Staging {
+    string model_filename;
+    bool write_diff;
+    // The net and its layers, with the blobs of each layer kept apart.
+    NetParameter net_param;
+    vector<vector<shared_ptr<Blob<Dtype> > > > layer_blobs;
+    // The solver state without its history, if it is to be written too.
+    string state_filename;
+    SolverState state;
+    vector<shared_ptr<Blob<Dtype> > > history;
+  };
+
+  explicit SnapshotWriter(int max_pending);
+  virtual ~SnapshotWriter();
+
+  /// @brief Returns a free Staging, waiting for a pending one if need be.
+  Staging* Acquire();
+  /// @brief Queues a Staging for writing.
+  void Submit(Staging* staging);
+  /// @brief Returns a Staging that is not to be written.
+  void Release(Staging* staging);
+  /// @brief Waits for all submitted snapshots to be written.
+  void Flush();
+
+  /// @brief Copies the layers and blobs of net into staging.
+  static void StageNet(const Net<Dtype>& net, bool write_diff,
+      Staging* staging);
+  /// @brief Copies blobs into the host memory of staged, reusing its blobs.
+  static void StageBlobs(const vector<shared_ptr<Blob<Dtype> > >& blobs,
+      bool copy_diff, vector<shared_ptr<Blob<Dtype> > >* staged);
+
+ protected:
+  virtual void InternalThreadEntry();
+  void Write(Staging* staging);
+
+  vector<shared_ptr<Staging> > stagings_;
+  BlockingQueue<Staging*> free_;
+  BlockingQueue<Staging*> full_;
+
+  DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
@@ -0,0 +1,57 @@
+#ifndef CAFFE_UTIL_SPSC_QUEUE_HPP_
+#define CAFFE_UTIL_SPSC_QUEUE_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded lock-free queue for exactly one producer thread and one
+ *        consumer thread.
+ *
+ * Elements move through a fixed ring without taking a lock, so handing a
+ * batch between the prefetch thread and the net costs two atomic index
+ * updates. Waiting (pop on an empty queue, push on a full one) spins briefly
+ * and then backs off with short sleeps, checking for thread interruption.
+ * Several threads may take turns on one side as long as they are serialized
+ * externally (e.g. by the forward mutex of a shared data layer). Use
+ * BlockingQueue when there are several concurrent producers or consumers.
+ */
+template<typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(int capacity);
+
+  bool try_push(const T& t);
+  void push(const T& t);
+
+  bool try_pop(T* t);
+  // This logs a message if the thread needs to wait,
+  // useful for detecting e.g. when data feeding is too slow
+  T pop(const string& log_on_wait = "");
+
+  // Number of elements; exact only when called from the producer or the
+  // consumer thread while the other side is idle.
+  size_t size() const;
+  inline int capacity() const { return buffer_.size(); }
+
+ protected:
+  vector<T> buffer_;
+  // The consumer owns head_ and the producer owns tail_; both only grow.
+  // They live on separate cache lines so that the two threads don't
+  // invalidate each other's line on every update.
+  char pad0_[64];
+  size_t head_;
+  char pad1_[64];
+  size_t tail_;
+  char pad2_[64];
+
+DISABLE_COPY_AND_ASSIGN(SpscQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPSC_QUEUE_HPP_
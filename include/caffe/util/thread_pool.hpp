@@ -0,0 +1,43 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads that run the parts of parallel loops,
+ *        so that loops run every iteration (e.g. the fused solver update) do
+ *        not pay for starting and joining threads each time.
+ *
+ * Run(num_tasks, task) calls task(0) ... task(num_tasks - 1) on the workers
+ * and on the calling thread, and returns once all of them are done. Several
+ * threads may call Run at once; their tasks are handed out in turn. Since the
+ * caller also takes its own tasks, Run may be called from within a task.
+ * The tasks must not throw.
+ *
+ * Shared() is a process-wide pool with a worker per CPU but one, for code
+ * that has no pool of its own.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_workers);
+  ~ThreadPool();
+
+  void Run(int num_tasks, const boost::function<void(int)>& task);
+  int num_workers() const;
+
+  static shared_ptr<ThreadPool> Shared();
+
+ private:
+  class Impl;
+  shared_ptr<Impl> impl_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -5,6 +5,7 @@
 
 #include <boost/make_shared.hpp>
 #include <boost/python.hpp>
+#include <boost/thread.hpp>
 #include <boost/python/raw_function.hpp>
 #include <boost/python/suite/indexing/vector_indexing_suite.hpp>
 #include <numpy/arrayobject.h>
@@ -50,6 +51,8 @@ const int NPY_DTYPE = NPY_FLOAT32;
 // Selecting mode.
 void set_mode_cpu() { Caffe::set_mode(Caffe::CPU); }
 void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
+// The mode is per thread: this is the mode of the calling thread.
+bool is_mode_gpu() { return Caffe::mode() == Caffe::GPU; }
 
 // For convenience, check that input files can be opened, and raise an
 // exception that boost will send to Python if not (caffe could still crash
@@ -86,6 +89,17 @@ void CheckContiguousArray(PyArrayObject* arr, string name,
   }
 }
 
+// Releases the GIL for the lifetime of the object, letting the other Python
+// threads run while caffe computes.
+class ScopedGILRelease {
+ public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+};
+
 // Net constructor for passing phase as int
 shared_ptr<Net<Dtype> > Net_Init(
     string param_file, int phase) {
@@ -108,6 +122,147 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
   return net;
 }
 
+Dtype Net_Forward(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_Backward(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  net->BackwardFromTo(start, end);
+}
+
+// A forward pass running on a thread of its own, for Net.forward_async.
+class NetForwardFuture {
+ public:
+  NetForwardFuture(shared_ptr<Net<Dtype> > net, int start, int end)
+      : state_(new State()) {
+    state_->net = net;
+    state_->done = false;
+    state_->failed = false;
+    // The Caffe singleton is per thread: the pass runs with the settings of
+    // the caller, as threads started by InternalThread do.
+    state_->device = 0;
+#ifndef CPU_ONLY
+    CUDA_CHECK(cudaGetDevice(&state_->device));
+#endif
+    state_->mode = Caffe::mode();
+    state_->rand_seed = caffe_rng_rand();
+    state_->solver_count = Caffe::solver_count();
+    state_->root_solver = Caffe::root_solver();
+    state_->numa_node = Caffe::numa_node();
+    // The thread holds its own reference, which it drops with the GIL held,
+    // since the state holds Python objects.
+    boost::thread(&NetForwardFuture::Run, new shared_ptr<State>(state_),
+        start, end).detach();
+  }
+
+  bool done() {
+    boost::mutex::scoped_lock lock(state_->mutex);
+    return state_->done;
+  }
+  // Waits for the pass, without the GIL, and returns the loss. An exception
+  // thrown by the pass, e.g. by a Python layer, is raised here.
+  Dtype wait() {
+    {
+      ScopedGILRelease release;
+      boost::mutex::scoped_lock lock(state_->mutex);
+      while (!state_->done) {
+        state_->condition.wait(lock);
+      }
+    }
+    if (state_->error_type) {
+      // PyErr_Restore steals the references.
+      PyErr_Restore(bp::xincref(state_->error_type.get()),
+          bp::xincref(state_->error_value.get()),
+          bp::xincref(state_->error_traceback.get()));
+      bp::throw_error_already_set();
+    }
+    if (state_->failed) {
+      throw std::runtime_error(state_->error);
+    }
+    return state_->loss;
+  }
+
+ protected:
+  struct State {
+    shared_ptr<Net<Dtype> > net;
+    int device;
+    Caffe::Brew mode;
+    int rand_seed;
+    int solver_count;
+    bool root_solver;
+    int numa_node;
+    boost::mutex mutex;
+    boost::condition_variable condition;
+    bool done;
+    Dtype loss;
+    // The Python error of the pass, or the message of another exception.
+    bp::handle<> error_type, error_value, error_traceback;
+    bool failed;
+    string error;
+  };
+
+  static void Run(shared_ptr<State>* state_ref, int start, int end) {
+    State* state = state_ref->get();
+#ifndef CPU_ONLY
+    CUDA_CHECK(cudaSetDevice(state->device));
+#endif
+    Caffe::set_mode(state->mode);
+    Caffe::set_random_seed(state->rand_seed);
+    Caffe::set_solver_count(state->solver_count);
+    Caffe::set_root_solver(state->root_solver);
+    Caffe::set_numa_node(state->numa_node);
+    // The thread keeps one Python thread state for the whole pass, so that
+    // an error set by a Python layer is still there to be fetched below.
+    PyGILState_STATE gil_state = PyGILState_Ensure();
+    PyThreadState* thread_state = PyEval_SaveThread();
+    Dtype loss = 0;
+    bool python_error = false;
+    bool failed = false;
+    string error;
+    try {
+      loss = state->net->ForwardFromTo(start, end);
+    } catch (bp::error_already_set&) {
+      python_error = true;
+    } catch (std::exception& e) {
+      failed = true;
+      error = e.what();
+    } catch (...) {
+      failed = true;
+      error = "Unknown exception in the forward pass";
+    }
+    PyEval_RestoreThread(thread_state);
+    if (python_error) {
+      PyObject *type, *value, *traceback;
+      PyErr_Fetch(&type, &value, &traceback);
+      state->error_type = bp::handle<>(bp::allow_null(type));
+      state->error_value = bp::handle<>(bp::allow_null(value));
+      state->error_traceback = bp::handle<>(bp::allow_null(traceback));
+    }
+    // The net may be freed here if Python dropped it, along with the
+    // Python objects of its layers.
+    state->net.reset();
+    {
+      boost::mutex::scoped_lock lock(state->mutex);
+      state->loss = loss;
+      state->failed = failed;
+      state->error = error;
+      state->done = true;
+      state->condition.notify_all();
+    }
+    delete state_ref;
+    PyGILState_Release(gil_state);
+  }
+
+  shared_ptr<State> state_;
+};
+
+shared_ptr<NetForwardFuture> Net_ForwardAsync(shared_ptr<Net<Dtype> > net,
+    int start, int end) {
+  return shared_ptr<NetForwardFuture>(new NetForwardFuture(net, start, end));
+}
+
 void Net_Save(const Net<Dtype>& net, string filename) {
   NetParameter net_param;
   net.ToProto(&net_param, false);
@@ -237,9 +392,11 @@ class PythonCallback: public Solver<Dtype>::Callback {
   PythonCallback(bp::object on_start, bp::object on_gradients_ready)
     : on_start_(on_start), on_gradients_ready_(on_gradients_ready) { }
   virtual void on_gradients_ready() {
+    ScopedGILAcquire gil;
     on_gradients_ready_();
   }
   virtual void on_start() {
+    ScopedGILAcquire gil;
     on_start_();
   }
 };
@@ -249,7 +406,20 @@ void Solver_add_callback(Solver<Dtype> * solver, bp::object on_start,
   solver->add_callback(new PythonCallback<Dtype>(on_start, on_gradients_ready));
 }
 
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
+void Solver_Step(Solver<Dtype>* solver, int iters) {
+  ScopedGILRelease release;
+  solver->Step(iters);
+}
+
+void Solver_Solve(Solver<Dtype>* solver) {
+  ScopedGILRelease release;
+  solver->Solve();
+}
+
+void Solver_SolveFrom(Solver<Dtype>* solver, const string& resume_file) {
+  ScopedGILRelease release;
+  solver->Solve(resume_file);
+}
 
 BOOST_PYTHON_MODULE(_caffe) {
   // below, we prepend an underscore to methods that will be replaced
@@ -257,9 +427,15 @@ BOOST_PYTHON_MODULE(_caffe) {
 
   bp::scope().attr("__version__") = AS_STRING(CAFFE_VERSION);
 
+#if PY_VERSION_HEX < 0x03070000
+  // Set up the GIL, which nets release while they run.
+  PyEval_InitThreads();
+#endif
+
   // Caffe utility functions
   bp::def("set_mode_cpu", &set_mode_cpu);
   bp::def("set_mode_gpu", &set_mode_gpu);
+  bp::def("is_mode_gpu", &is_mode_gpu);
   bp::def("set_device", &Caffe::SetDevice);
 
   bp::def("layer_type_list", &LayerRegistry<Dtype>::LayerTypeList);
@@ -268,8 +444,9 @@ BOOST_PYTHON_MODULE(_caffe) {
     bp::no_init)
     .def("__init__", bp::make_constructor(&Net_Init))
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
+    .def("_forward", &Net_Forward)
+    .def("_forward_async", &Net_ForwardAsync)
+    .def("_backward", &Net_Backward)
     .def("reshape", &Net<Dtype>::Reshape)
     // The cast is to select a particular overload.
     .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
@@ -301,6 +478,12 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("load_hdf5", &Net_LoadHDF5);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Net<Dtype>);
 
+  bp::class_<NetForwardFuture, shared_ptr<NetForwardFuture>,
+    boost::noncopyable>("_ForwardFuture", bp::no_init)
+    .def("done", &NetForwardFuture::done)
+    .def("wait", &NetForwardFuture::wait);
+  BP_REGISTER_SHARED_PTR_TO_PYTHON(NetForwardFuture);
+
   bp::class_<Blob<Dtype>, shared_ptr<Blob<Dtype> >, boost::noncopyable>(
     "Blob", bp::no_init)
     .add_property("shape",
@@ -339,9 +522,9 @@ BOOST_PYTHON_MODULE(_caffe) {
           bp::return_internal_reference<>()))
     .add_property("iter", &Solver<Dtype>::iter)
     .def("add_callback", &Solver_add_callback<Dtype>)
-    .def("solve", static_cast<void (Solver<Dtype>::*)(const char*)>(
-          &Solver<Dtype>::Solve), SolveOverloads())
-    .def("step", &Solver<Dtype>::Step)
+    .def("solve", &Solver_Solve)
+    .def("solve", &Solver_SolveFrom)
+    .def("step", &Solver_Step)
     .def("restore", &Solver<Dtype>::Restore)
     .def("snapshot", &Solver<Dtype>::Snapshot);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Solver<Dtype>);
@@ -93,6 +93,41 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
     -------
     outs : {blob name: blob ndarray} dict.
     """
+    start_ind, end_ind, outputs = self._prepare_forward(blobs, start, end,
+                                                        kwargs)
+    self._forward(start_ind, end_ind)
+
+    # Unpack blobs to extract
+    return {out: self.blobs[out].data for out in outputs}
+
+
+def _Net_forward_async(self, blobs=None, start=None, end=None, **kwargs):
+    """
+    Forward pass on a thread of its own: prepare inputs as forward() does,
+    and start running the net forward. Python threads keep running while
+    the net computes, but the blobs of the net must be left alone until the
+    pass is over.
+
+    Parameters
+    ----------
+    Same as forward().
+
+    Returns
+    -------
+    future : ForwardFuture whose result() waits for the pass and returns the
+             {blob name: blob ndarray} dict of forward().
+    """
+    start_ind, end_ind, outputs = self._prepare_forward(blobs, start, end,
+                                                        kwargs)
+    return ForwardFuture(self, self._forward_async(start_ind, end_ind),
+                         outputs)
+
+
+def _Net_prepare_forward(self, blobs, start, end, inputs):
+    """
+    Set the inputs of a forward pass, returning the indices of its first and
+    last layers and the names of the blobs it outputs.
+    """
     if blobs is None:
         blobs = []
 
@@ -108,20 +143,38 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
         end_ind = len(self.layers) - 1
         outputs = set(self.outputs + blobs)
 
-    if kwargs:
-        if set(kwargs.keys()) != set(self.inputs):
+    if inputs:
+        if set(inputs.keys()) != set(self.inputs):
             raise Exception('Input blob arguments do not match net inputs.')
         # Set input according to defined shapes and make arrays single and
         # C-contiguous as Caffe expects.
-        for in_, blob in six.iteritems(kwargs):
+        for in_, blob in six.iteritems(inputs):
             if blob.shape[0] != self.blobs[in_].shape[0]:
                 raise Exception('Input is not batch sized')
             self.blobs[in_].data[...] = blob
 
-    self._forward(start_ind, end_ind)
+    return start_ind, end_ind, outputs
 
-    # Unpack blobs to extract
-    return {out: self.blobs[out].data for out in outputs}
+
+class ForwardFuture(object):
+    """
+    The result of Net.forward_async().
+    """
+    def __init__(self, net, handle, outputs):
+        self._net, self._handle, self._outputs = net, handle, outputs
+
+    def done(self):
+        """Whether the forward pass is over."""
+        return self._handle.done()
+
+    def result(self):
+        """
+        Wait for the forward pass, without holding the GIL, and return the
+        {blob name: blob ndarray} dict of forward(). An exception raised by
+        the pass, e.g. by a Python layer, is raised here.
+        """
+        self._handle.wait()
+        return {out: self._net.blobs[out].data for out in self._outputs}
 
 
 def _Net_backward(self, diffs=None, start=None, end=None, **kwargs):
@@ -313,6 +366,8 @@ Net.blobs = _Net_blobs
 Net.blob_loss_weights = _Net_blob_loss_weights
 Net.params = _Net_params
 Net.forward = _Net_forward
+Net.forward_async = _Net_forward_async
+Net._prepare_forward = _Net_prepare_forward
 Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
 Net.forward_backward_all = _Net_forward_backward_all
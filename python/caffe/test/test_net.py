@@ -63,6 +63,15 @@ class TestNet(unittest.TestCase):
         self.net.forward()
         self.net.backward()
 
+    def test_forward_async(self):
+        loss = self.net.forward()['loss'].copy()
+        # Start after the data layer, which draws new data on each forward.
+        future = self.net.forward_async(start='conv')
+        outs = future.result()
+        self.assertTrue(future.done())
+        self.assertEqual(list(outs.keys()), ['loss'])
+        self.assertEqual(outs['loss'], loss)
+
     def test_inputs_outputs(self):
         self.assertEqual(self.net.inputs, [])
         self.assertEqual(self.net.outputs, ['loss'])
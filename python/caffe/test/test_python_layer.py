@@ -28,6 +28,30 @@ class ExceptionLayer(caffe.Layer):
     def setup(self, bottom, top):
         raise RuntimeError
 
+class ForwardExceptionLayer(caffe.Layer):
+    """A layer for checking exceptions raised by a forward pass"""
+
+    def setup(self, bottom, top):
+        pass
+
+    def reshape(self, bottom, top):
+        top[0].reshape(*bottom[0].data.shape)
+
+    def forward(self, bottom, top):
+        raise RuntimeError('forward failed')
+
+class ModeLayer(caffe.Layer):
+    """A layer for checking the mode of the thread running the net"""
+
+    def setup(self, bottom, top):
+        pass
+
+    def reshape(self, bottom, top):
+        top[0].reshape()
+
+    def forward(self, bottom, top):
+        top[0].data[()] = caffe.is_mode_gpu()
+
 class ParameterLayer(caffe.Layer):
     """A layer that just multiplies by ten"""
 
@@ -79,6 +103,24 @@ def exception_net_file():
         return f.name
 
 
+def forward_exception_net_file():
+    with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
+        f.write("""name: 'pythonnet' force_backward: true
+        input: 'data' input_shape { dim: 10 dim: 9 dim: 8 }
+        layer { type: 'Python' name: 'layer' bottom: 'data' top: 'top'
+          python_param { module: 'test_python_layer'
+                         layer: 'ForwardExceptionLayer' } }
+          """)
+        return f.name
+
+def mode_net_file():
+    with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
+        f.write("""name: 'pythonnet' force_backward: true
+        layer { type: 'Python' name: 'layer' top: 'mode'
+          python_param { module: 'test_python_layer' layer: 'ModeLayer' } }
+          """)
+        return f.name
+
 def parameter_net_file():
     with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
         f.write("""name: 'pythonnet' force_backward: true
@@ -132,6 +174,39 @@ class TestPythonLayer(unittest.TestCase):
         self.assertRaises(RuntimeError, caffe.Net, net_file, caffe.TEST)
         os.remove(net_file)
 
+    def test_forward_async(self):
+        x = 6
+        self.net.blobs['data'].data[...] = x
+        outs = self.net.forward_async().result()
+        for y in outs['three'].flat:
+            self.assertEqual(y, 10**3 * x)
+
+    def test_forward_async_exception(self):
+        net_file = forward_exception_net_file()
+        net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        future = net.forward_async()
+        self.assertRaises(RuntimeError, future.result)
+        self.assertTrue(future.done())
+        # The net is usable again once the failed pass is over.
+        self.assertRaises(RuntimeError, net.forward)
+
+    def test_forward_async_mode(self):
+        net_file = mode_net_file()
+        net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        # The pass runs on another thread, in the mode of the caller.
+        try:
+            for gpu in False, True:
+                if gpu:
+                    caffe.set_mode_gpu()
+                else:
+                    caffe.set_mode_cpu()
+                self.assertEqual(net.forward()['mode'], gpu)
+                self.assertEqual(net.forward_async().result()['mode'], gpu)
+        finally:
+            caffe.set_mode_cpu()
+
     def test_parameter(self):
         net_file = parameter_net_file()
         net = caffe.Net(net_file, caffe.TRAIN)
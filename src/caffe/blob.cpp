@@ -41,6 +41,7 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    int8_data_.reset();
   }
 }
 
@@ -63,14 +64,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), int8_version_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), int8_version_(0) {
   Reshape(shape);
 }
 
@@ -138,6 +139,15 @@ template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
   data_ = other.data();
+  int8_data_.reset();
+}
+
+template <typename Dtype>
+shared_ptr<SyncedMemory> Blob<Dtype>::int8_data() const {
+  if (int8_data_ && data_->version() == int8_version_) {
+    return int8_data_;
+  }
+  return shared_ptr<SyncedMemory>();
 }
 
 template <typename Dtype>
@@ -469,7 +479,22 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  int8_data_.reset();
+  if (proto.has_int8_data()) {
+    CHECK_EQ(count_, proto.int8_data().size());
+    CHECK_GT(proto.int8_scale_size(), 0);
+    CHECK_EQ(count_ % proto.int8_scale_size(), 0);
+    const int8_t* q = reinterpret_cast<const int8_t*>(proto.int8_data().data());
+    const int slice = count_ / proto.int8_scale_size();
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = q[i] / proto.int8_scale(i / slice);
+    }
+    // Keep the int8 data too, for the INT8 layers.
+    int8_data_.reset(new SyncedMemory(count_ * sizeof(int8_t)));
+    memcpy(int8_data_->mutable_cpu_data(), q, count_ * sizeof(int8_t));
+    int8_scale_.assign(proto.int8_scale().begin(), proto.int8_scale().end());
+    int8_version_ = data_->version();
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -5,6 +5,7 @@
 #include <ctime>
 
 #include "caffe/common.hpp"
+#include "caffe/util/cpu_topology.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -49,11 +50,22 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+void Caffe::set_numa_node(int node) {
+  if (node == Get().numa_node_) {
+    return;
+  }
+  const bool pinned = SetThreadAffinity(node >= 0 ?
+      CPUTopology::Get().cpus(node) : vector<int>());
+  LOG_IF(WARNING, !pinned) << "Could not set the CPU affinity for NUMA node "
+      << node;
+  Get().numa_node_ = node;
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), root_solver_(true) { }
+      solver_count_(1), root_solver_(true), numa_node_(-1) { }
 
 Caffe::~Caffe() { }
 
@@ -106,7 +118,8 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU), solver_count_(1), root_solver_(true) {
+    mode_(Caffe::CPU), solver_count_(1), root_solver_(true),
+    numa_node_(-1) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
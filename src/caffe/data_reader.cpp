@@ -73,8 +73,12 @@ DataReader::Body::~Body() {
 void DataReader::Body::InternalThreadEntry() {
   shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));
   db->Open(param_.data_param().source(), db::READ);
-  shared_ptr<db::Cursor> cursor(db->NewCursor());
   vector<shared_ptr<QueuePair> > qps;
+  if (param_.data_param().reader_threads() > 1) {
+    read_sharded(db.get(), &qps);
+    return;
+  }
+  shared_ptr<db::Cursor> cursor(db->NewCursor());
   try {
     int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
 
@@ -116,4 +120,104 @@ void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) {
   }
 }
 
+void DataReader::Body::read_sharded(db::DB* db,
+    vector<shared_ptr<QueuePair> >* qps) {
+  const int stride = param_.data_param().reader_threads();
+  vector<shared_ptr<Shard> > shards;
+  for (int i = 0; i < stride; ++i) {
+    shards.push_back(shared_ptr<Shard>(new Shard(db->NewCursor(), i, stride)));
+  }
+  // Records handed to the shards, and from the shards to the solvers. Both
+  // follow the order of the database, so that runs stay deterministic.
+  int64_t dispatched = 0;
+  int64_t collected = 0;
+  try {
+    int solver_count = param_.phase() == TRAIN ? Caffe::solver_count() : 1;
+
+    // As for a single thread, read one item per solver while they start.
+    for (int i = 0; i < solver_count; ++i) {
+      qps->push_back(new_queue_pairs_.pop());
+      shards[i % stride]->in_.push(qps->back()->free_.pop());
+      qps->back()->full_.push(shards[i % stride]->out_.pop());
+    }
+    dispatched = collected = solver_count;
+    // Main loop
+    while (!must_stop()) {
+      bool progress = false;
+      Datum* datum;
+      // Hand the parsed datums to the solvers, oldest first
+      while (collected < dispatched &&
+          shards[collected % stride]->out_.try_pop(&datum)) {
+        (*qps)[collected++ % solver_count]->full_.push(datum);
+        progress = true;
+      }
+      // Keep the shards busy with all the free datums
+      while ((*qps)[dispatched % solver_count]->free_.try_pop(&datum)) {
+        shards[dispatched++ % stride]->in_.push(datum);
+        progress = true;
+      }
+      if (!progress) {
+        // Wait for the oldest record in flight, or else for a free datum
+        if (collected < dispatched) {
+          datum = shards[collected % stride]->out_.pop();
+          (*qps)[collected++ % solver_count]->full_.push(datum);
+        } else {
+          datum = (*qps)[dispatched % solver_count]->free_.pop();
+          shards[dispatched++ % stride]->in_.push(datum);
+        }
+      }
+      CHECK_EQ(new_queue_pairs_.size(), 0);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+  // Return the datums in flight to a queue pair, which deletes them
+  for (int i = 0; i < shards.size(); ++i) {
+    shards[i]->StopInternalThread();
+    Datum* datum;
+    while (shards[i]->in_.try_pop(&datum) || shards[i]->out_.try_pop(&datum)) {
+      qps->front()->free_.push(datum);
+    }
+  }
+}
+
+//
+
+// Moves the cursor to the next record, restarting from the first at the end.
+static void next_record(db::Cursor* cursor) {
+  cursor->Next();
+  if (!cursor->valid()) {
+    cursor->SeekToFirst();
+  }
+}
+
+DataReader::Shard::Shard(db::Cursor* cursor, int index, int stride)
+    : cursor_(cursor),
+      index_(index),
+      stride_(stride) {
+  StartInternalThread();
+}
+
+DataReader::Shard::~Shard() {
+  StopInternalThread();
+}
+
+void DataReader::Shard::InternalThreadEntry() {
+  try {
+    for (int i = 0; i < index_; ++i) {
+      next_record(cursor_.get());
+    }
+    while (!must_stop()) {
+      Datum* datum = in_.pop();
+      datum->ParseFromString(cursor_->value());
+      out_.push(datum);
+      for (int i = 0; i < stride_; ++i) {
+        next_record(cursor_.get());
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 }  // namespace caffe
@@ -12,6 +12,40 @@
 
 namespace caffe {
 
+// Writes (pixel - mean) * scale for a row of width uint8 pixels spaced by
+// stride, in reverse order if kMirror. The mean is taken from the row mean
+// if given, else it is mean_value. The branches are hoisted out of the
+// loops, which the compiler can then vectorize.
+template <typename Dtype, bool kMirror>
+static void TransformRow(const uint8_t* src, int stride, int width,
+    const Dtype* mean, Dtype mean_value, Dtype scale, Dtype* dst) {
+  const int step = kMirror ? -1 : 1;
+  if (kMirror) {
+    dst += width - 1;
+  }
+  if (mean) {
+    for (int w = 0; w < width; ++w) {
+      dst[w * step] = (static_cast<Dtype>(src[w * stride]) - mean[w]) * scale;
+    }
+  } else {
+    for (int w = 0; w < width; ++w) {
+      dst[w * step] = (static_cast<Dtype>(src[w * stride]) - mean_value) *
+          scale;
+    }
+  }
+}
+
+template <typename Dtype>
+static inline void TransformRow(bool mirror, const uint8_t* src, int stride,
+    int width, const Dtype* mean, Dtype mean_value, Dtype scale, Dtype* dst) {
+  if (mirror) {
+    TransformRow<Dtype, true>(src, stride, width, mean, mean_value, scale, dst);
+  } else {
+    TransformRow<Dtype, false>(src, stride, width, mean, mean_value, scale,
+        dst);
+  }
+}
+
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
     Phase phase)
@@ -93,6 +127,22 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
+  if (has_uint8) {
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data.data());
+    for (int c = 0; c < datum_channels; ++c) {
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      for (int h = 0; h < height; ++h) {
+        const int data_index =
+            (c * datum_height + h_off + h) * datum_width + w_off;
+        TransformRow(do_mirror, pixels + data_index, 1, width,
+            has_mean_file ? mean + data_index : NULL, mean_value, scale,
+            transformed_data + (c * height + h) * width);
+      }
+    }
+    return;
+  }
+
+  // The float data.
   Dtype datum_element;
   int top_index, data_index;
   for (int c = 0; c < datum_channels; ++c) {
@@ -104,12 +154,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
         } else {
           top_index = (c * height + h) * width + w;
         }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
+        datum_element = datum.float_data(data_index);
         if (has_mean_file) {
           transformed_data[top_index] =
             (datum_element - mean[data_index]) * scale;
@@ -127,23 +172,27 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 }
 
 
+#ifdef USE_OPENCV
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeToCVMat(const Datum& datum) {
+  CHECK(!(param_.force_color() && param_.force_gray()))
+      << "cannot set both force_color and force_gray";
+  if (param_.force_color() || param_.force_gray()) {
+    // If force_color then decode in color otherwise decode in gray.
+    return DecodeDatumToCVMat(datum, param_.force_color());
+  }
+  return DecodeDatumToCVMatNative(datum);
+}
+#endif  // USE_OPENCV
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
   // If datum is encoded, decoded and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
     // Transform the cv::image into blob.
-    return Transform(cv_img, transformed_blob);
+    return Transform(DecodeToCVMat(datum), transformed_blob);
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -294,32 +343,16 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   CHECK(cv_cropped_img.data);
 
   Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
   for (int h = 0; h < height; ++h) {
     const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
+    // The channels of the image are interleaved; each is converted to its
+    // own plane of the blob.
+    for (int c = 0; c < img_channels; ++c) {
+      const int mean_index = (c * img_height + h_off + h) * img_width + w_off;
+      TransformRow(do_mirror, ptr + c, img_channels, width,
+          has_mean_file ? mean + mean_index : NULL,
+          has_mean_values ? mean_values_[c] : Dtype(0), scale,
+          transformed_data + (c * height + h) * width);
     }
   }
 }
@@ -442,17 +475,8 @@ template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
     // InferBlobShape using the cv::image.
-    return InferBlobShape(cv_img);
+    return InferBlobShape(DecodeToCVMat(datum));
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -0,0 +1,407 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/inference_server.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+using boost::posix_time::microsec_clock;
+using boost::posix_time::ptime;
+
+struct InferenceServer::Request {
+  Request() : done(false), failed(false) {}
+  int num;
+  vector<float> input;
+  vector<vector<float> > outputs;
+  ptime arrival;
+  bool done;
+  // Set with done when the batch of the request could not be run
+  bool failed;
+};
+
+class InferenceServer::Sync {
+ public:
+  Sync() : gathering_(false) {}
+
+  boost::mutex mutex_;
+  // Notified when requests are queued, and when they are done
+  boost::condition_variable queued_;
+  boost::condition_variable done_;
+  // Set while a worker gathers the next batch
+  bool gathering_;
+};
+
+class InferenceServer::Acceptor : public InternalThread {
+ public:
+  explicit Acceptor(InferenceServer* server) : server_(server) {}
+  virtual ~Acceptor() { StopInternalThread(); }
+  using InternalThread::must_stop;
+
+ protected:
+  virtual void InternalThreadEntry() { server_->Accept(this); }
+
+  InferenceServer* server_;
+};
+
+class InferenceServer::Connection : public InternalThread {
+ public:
+  Connection(InferenceServer* server, int fd)
+      : server_(server), fd_(fd), finished_(false) {}
+  virtual ~Connection() {
+    Close();
+    StopInternalThread();
+    close(fd_);
+  }
+  // Unblocks the reads and writes of the connection
+  void Close() { shutdown(fd_, SHUT_RDWR); }
+
+  InferenceServer* server_;
+  const int fd_;
+  // Set by the thread when done, guarded by the mutex of the server
+  bool finished_;
+
+ protected:
+  virtual void InternalThreadEntry() { server_->Serve(this, fd_); }
+};
+
+class InferenceServer::Worker : public InternalThread {
+ public:
+  explicit Worker(InferenceServer* server) : server_(server) {}
+  virtual ~Worker() { StopInternalThread(); }
+
+ protected:
+  virtual void InternalThreadEntry() { server_->Work(); }
+
+  InferenceServer* server_;
+};
+
+// Reads size bytes, returning false if the connection is closed.
+static bool ReadFully(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t n = recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Writes size bytes, returning false if the connection is closed.
+static bool WriteFully(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+InferenceServer::InferenceServer(NetPool<float>* pool,
+    const vector<string>& outputs, int max_batch_size, int max_batch_delay_us)
+    : pool_(pool), outputs_(outputs), max_batch_size_(max_batch_size),
+      max_batch_delay_us_(max_batch_delay_us), listen_fd_(-1), port_(0),
+      sync_(new Sync()), stats_items_(0), stats_batches_(0) {
+  CHECK_GT(max_batch_size_, 0);
+  CHECK_GE(max_batch_delay_us_, 0);
+  const Net<float>& net = *pool_->weights_net();
+  CHECK_GE(net.input_blobs().size(), 1) << "The net has no input to serve";
+  item_size_ = net.input_blobs()[0]->count(1);
+  if (outputs_.empty()) {
+    for (int i = 0; i < net.output_blob_indices().size(); ++i) {
+      outputs_.push_back(net.blob_names()[net.output_blob_indices()[i]]);
+    }
+  }
+  // Every output must have an item per input item, so that a batch can be
+  // split back into the requests.
+  const int num = net.input_blobs()[0]->shape(0);
+  for (int i = 0; i < outputs_.size(); ++i) {
+    CHECK(net.has_blob(outputs_[i])) << "Unknown output blob " << outputs_[i];
+    const Blob<float>& output = *net.blob_by_name(outputs_[i]);
+    CHECK(output.num_axes() >= 1 && output.shape(0) == num) << "Output "
+        << outputs_[i] << " " << output.shape_string()
+        << " does not have an item per input item";
+  }
+}
+
+InferenceServer::~InferenceServer() {
+  Stop();
+}
+
+void InferenceServer::Listen(const string& address) {
+  CHECK_LT(listen_fd_, 0) << "The server is already listening";
+  if (address.compare(0, 5, "unix:") == 0) {
+    unix_path_ = address.substr(5);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    CHECK_LT(unix_path_.size(), sizeof(addr.sun_path))
+        << "Socket path too long: " << unix_path_;
+    strncpy(addr.sun_path, unix_path_.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(unix_path_.c_str());
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_GE(listen_fd_, 0) << "Cannot create socket: " << strerror(errno);
+    CHECK_EQ(bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+        sizeof(addr)), 0) << "Cannot bind " << unix_path_ << ": "
+        << strerror(errno);
+  } else if (address.compare(0, 4, "tcp:") == 0) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(atoi(address.substr(4).c_str()));
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(listen_fd_, 0) << "Cannot create socket: " << strerror(errno);
+    int reuse = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    CHECK_EQ(bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+        sizeof(addr)), 0) << "Cannot bind " << address << ": "
+        << strerror(errno);
+    socklen_t size = sizeof(addr);
+    CHECK_EQ(getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr),
+        &size), 0);
+    port_ = ntohs(addr.sin_port);
+  } else {
+    LOG(FATAL) << "Unknown address " << address
+        << "; use unix:PATH or tcp:PORT";
+  }
+  CHECK_EQ(listen(listen_fd_, SOMAXCONN), 0) << "Cannot listen on "
+      << address << ": " << strerror(errno);
+
+  stats_timer_.Start();
+  for (int i = 0; i < pool_->size(); ++i) {
+    workers_.push_back(shared_ptr<Worker>(new Worker(this)));
+    workers_[i]->StartInternalThread();
+  }
+  acceptor_.reset(new Acceptor(this));
+  acceptor_->StartInternalThread();
+  LOG(INFO) << "Serving " << pool_->weights_net()->name() << " on "
+      << (port_ ? "tcp:" + format_int(port_) : address) << " with "
+      << workers_.size() << " threads";
+}
+
+void InferenceServer::Stop() {
+  if (listen_fd_ < 0) {
+    return;
+  }
+  // Stop accepting, then running batches, then serving the connections.
+  acceptor_.reset();
+  close(listen_fd_);
+  listen_fd_ = -1;
+  if (!unix_path_.empty()) {
+    unlink(unix_path_.c_str());
+  }
+  workers_.clear();
+  connections_.clear();
+}
+
+void InferenceServer::TakeStats(InferenceServerStats* stats) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  stats->requests = latencies_ms_.size();
+  stats->items = stats_items_;
+  stats->batches = stats_batches_;
+  stats->seconds = stats_timer_.Seconds();
+  stats->p50_ms = 0;
+  stats->p99_ms = 0;
+  if (!latencies_ms_.empty()) {
+    std::sort(latencies_ms_.begin(), latencies_ms_.end());
+    const int last = latencies_ms_.size() - 1;
+    stats->p50_ms = latencies_ms_[last / 2];
+    stats->p99_ms = latencies_ms_[last * 99 / 100];
+  }
+  latencies_ms_.clear();
+  stats_items_ = 0;
+  stats_batches_ = 0;
+  stats_timer_.Start();
+}
+
+void InferenceServer::Accept(Acceptor* acceptor) {
+  while (!acceptor->must_stop()) {
+    // Wake up periodically to check for Stop
+    pollfd listen_poll = { listen_fd_, POLLIN, 0 };
+    if (poll(&listen_poll, 1, 100) <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd_, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    for (int i = connections_.size() - 1; i >= 0; --i) {
+      if (connections_[i]->finished_) {
+        connections_.erase(connections_.begin() + i);
+      }
+    }
+    connections_.push_back(shared_ptr<Connection>(new Connection(this, fd)));
+    connections_.back()->StartInternalThread();
+  }
+}
+
+void InferenceServer::Serve(Connection* connection, int fd) {
+  try {
+    while (true) {
+      uint32_t num;
+      if (!ReadFully(fd, &num, sizeof(num))) {
+        break;
+      }
+      if (num == 0 || num > max_batch_size_) {
+        LOG(WARNING) << "Closing a connection that requested " << num
+            << " items, with a max batch size of " << max_batch_size_;
+        const uint32_t status = 1;
+        WriteFully(fd, &status, sizeof(status));
+        break;
+      }
+      shared_ptr<Request> request(new Request());
+      request->num = num;
+      request->input.resize(num * item_size_);
+      request->outputs.resize(outputs_.size());
+      if (!ReadFully(fd, &request->input[0],
+          request->input.size() * sizeof(float))) {
+        break;
+      }
+      {
+        boost::mutex::scoped_lock lock(sync_->mutex_);
+        request->arrival = microsec_clock::universal_time();
+        queue_.push_back(request);
+        sync_->queued_.notify_all();
+        while (!request->done) {
+          sync_->done_.wait(lock);
+        }
+      }
+      const uint32_t status = request->failed ? 2 : 0;
+      bool written = WriteFully(fd, &status, sizeof(status));
+      for (int i = 0; i < request->outputs.size() && written && !status;
+          ++i) {
+        const vector<float>& output = request->outputs[i];
+        const uint32_t count = output.size();
+        written = WriteFully(fd, &count, sizeof(count)) &&
+            WriteFully(fd, &output[0], count * sizeof(float));
+      }
+      if (!written) {
+        break;
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  connection->finished_ = true;
+}
+
+void InferenceServer::Work() {
+  try {
+    while (true) {
+      vector<shared_ptr<Request> > batch;
+      int items = 0;
+      {
+        // Gather the requests until the batch is full, the next request does
+        // not fit, or the first one has waited max_batch_delay_us_. One
+        // worker gathers at a time, while the others run their batches.
+        boost::mutex::scoped_lock lock(sync_->mutex_);
+        while (sync_->gathering_ || queue_.empty()) {
+          sync_->queued_.wait(lock);
+        }
+        sync_->gathering_ = true;
+        const ptime deadline = queue_.front()->arrival +
+            boost::posix_time::microseconds(max_batch_delay_us_);
+        while (true) {
+          while (!queue_.empty() &&
+              items + queue_.front()->num <= max_batch_size_) {
+            items += queue_.front()->num;
+            batch.push_back(queue_.front());
+            queue_.pop_front();
+          }
+          if (items == max_batch_size_ || !queue_.empty() ||
+              microsec_clock::universal_time() >= deadline) {
+            break;
+          }
+          sync_->queued_.timed_wait(lock, deadline);
+        }
+        sync_->gathering_ = false;
+        sync_->queued_.notify_all();
+      }
+      Net<float>* net = pool_->Acquire();
+      const bool ran = Run(net, batch, items);
+      pool_->Release(net);
+
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      const ptime now = microsec_clock::universal_time();
+      for (int i = 0; i < batch.size(); ++i) {
+        batch[i]->done = true;
+        batch[i]->failed = !ran;
+        latencies_ms_.push_back(
+            (now - batch[i]->arrival).total_microseconds() / 1000.);
+      }
+      stats_items_ += items;
+      ++stats_batches_;
+      sync_->done_.notify_all();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+bool InferenceServer::Run(Net<float>* net,
+    const vector<shared_ptr<Request> >& batch, int items) {
+  Blob<float>* input = net->input_blobs()[0];
+  vector<int> shape = input->shape();
+  shape[0] = items;
+  input->Reshape(shape);
+  float* input_data = input->mutable_cpu_data();
+  for (int i = 0; i < batch.size(); ++i) {
+    caffe_copy(batch[i]->input.size(), &batch[i]->input[0], input_data);
+    input_data += batch[i]->input.size();
+  }
+  net->Forward();
+  // The shapes were checked for the batch size of the net as loaded; a net
+  // whose outputs do not follow the batch size fails the requests instead.
+  for (int j = 0; j < outputs_.size(); ++j) {
+    const Blob<float>& output = *net->blob_by_name(outputs_[j]);
+    if (output.shape(0) != items) {
+      LOG(ERROR) << "Failing a batch of " << items << " items: output "
+          << outputs_[j] << " " << output.shape_string()
+          << " does not have an item per input item";
+      return false;
+    }
+  }
+  for (int j = 0; j < outputs_.size(); ++j) {
+    const Blob<float>& output = *net->blob_by_name(outputs_[j]);
+    const int size = output.count(1);
+    const float* output_data = output.cpu_data();
+    for (int i = 0; i < batch.size(); ++i) {
+      batch[i]->outputs[j].assign(output_data,
+          output_data + batch[i]->num * size);
+      output_data += batch[i]->num * size;
+    }
+  }
+  return true;
+}
+
+}  // namespace caffe
@@ -5,6 +5,7 @@
 #include "caffe/layers/base_conv_layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -180,6 +181,18 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   weight_offset_ = conv_out_channels_ * kernel_dim_ / group_;
   // Propagate gradients to the parameters (as directed by backward pass).
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  // Set up reduced-precision inference.
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  int8_ = quant_param.precision() == QuantizationParameter_Precision_INT8;
+  if (int8_) {
+    CHECK(!reverse_dimensions())
+        << "INT8 precision is only implemented for convolution.";
+    bottom_scale_ = quant_param.bottom_scale();
+    quantized_weight_mem_ = NULL;
+    quantized_weight_version_ = 0;
+    weight_inv_scale_.Reshape(vector<int>(1, conv_out_channels_));
+  }
 }
 
 template <typename Dtype>
@@ -251,6 +264,15 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     caffe_set(bias_multiplier_.count(), Dtype(1),
         bias_multiplier_.mutable_cpu_data());
   }
+  if (int8_) {
+    const size_t col_size = kernel_dim_ * conv_out_spatial_dim_;
+    if (!col_int8_ || col_int8_->size() < col_size) {
+      col_int8_.reset(new SyncedMemory(col_size * sizeof(int8_t)));
+      output_int32_.reset(new SyncedMemory(
+          conv_out_channels_ / group_ * conv_out_spatial_dim_ *
+          sizeof(int32_t)));
+    }
+  }
 }
 
 template <typename Dtype>
@@ -271,6 +293,60 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_int8(const Dtype* input,
+    Dtype* output) {
+  // As in InnerProductLayer: weights loaded as int8 are used as they are;
+  // the int8 copy of others follows the version of the weights' memory and
+  // is always redone in TRAIN phase.
+  const Blob<Dtype>& weight_blob = *this->blobs_[0];
+  const SyncedMemory* weight_mem = weight_blob.data().get();
+  if (this->phase_ == TRAIN || quantized_weight_mem_ != weight_mem
+      || quantized_weight_version_ != weight_mem->version()) {
+    Dtype* inv_scale = weight_inv_scale_.mutable_cpu_data();
+    shared_ptr<SyncedMemory> loaded_int8 = weight_blob.int8_data();
+    if (loaded_int8 && weight_blob.int8_scale().size() == conv_out_channels_) {
+      weight_int8_ = loaded_int8;
+      for (int c = 0; c < conv_out_channels_; ++c) {
+        inv_scale[c] = Dtype(1) / weight_blob.int8_scale()[c];
+      }
+    } else {
+      // A buffer still shared with the blob is left to it.
+      if (!weight_int8_ || !weight_int8_.unique()) {
+        weight_int8_.reset(new SyncedMemory(weight_blob.count()));
+      }
+      caffe_cpu_quantize_rows(conv_out_channels_, kernel_dim_,
+          weight_blob.cpu_data(),
+          static_cast<int8_t*>(weight_int8_->mutable_cpu_data()), inv_scale);
+    }
+    quantized_weight_mem_ = weight_mem;
+    quantized_weight_version_ = weight_mem->version();
+  }
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  const Dtype bottom_scale = bottom_scale_ > 0 ? bottom_scale_ :
+      caffe_cpu_int8_scale(bottom_dim_, input);
+  const int8_t* weight_int8 =
+      static_cast<const int8_t*>(weight_int8_->cpu_data());
+  const Dtype* inv_scale = weight_inv_scale_.cpu_data();
+  int8_t* col_int8 = static_cast<int8_t*>(col_int8_->mutable_cpu_data());
+  int32_t* output_int32 =
+      static_cast<int32_t*>(output_int32_->mutable_cpu_data());
+  const int group_out_channels = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_quantize_transpose(kernel_dim_, conv_out_spatial_dim_,
+        bottom_scale, col_buff + col_offset_ * g, col_int8);
+    caffe_cpu_gemm_int8(group_out_channels, conv_out_spatial_dim_,
+        kernel_dim_, weight_int8 + weight_offset_ * g, col_int8, output_int32);
+    caffe_cpu_requantize<Dtype>(group_out_channels, conv_out_spatial_dim_,
+        output_int32, Dtype(1) / bottom_scale,
+        inv_scale + group_out_channels * g, NULL, output + output_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
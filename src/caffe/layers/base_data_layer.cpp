@@ -1,4 +1,5 @@
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -7,7 +8,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/spsc_queue.hpp"
 
 namespace caffe {
 
@@ -36,10 +38,15 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.transform_param().prefetch()),
+      prefetch_free_(param.transform_param().prefetch()),
+      prefetch_full_(param.transform_param().prefetch()),
+      stats_mutex_(new boost::mutex()) {
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
+  ResetPrefetchStats();
 }
 
 template <typename Dtype>
@@ -50,18 +57,24 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
+    }
+    for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+      prefetch_[i]->extra_[j]->mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
+      }
+      for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+        prefetch_[i]->extra_[j]->mutable_gpu_data();
       }
     }
   }
@@ -84,7 +97,15 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      CPUTimer timer;
+      timer.Start();
       load_batch(batch);
+      const double load_ms = timer.MicroSeconds() / 1000.;
+      {
+        boost::mutex::scoped_lock lock(*stats_mutex_);
+        ++stats_.loaded;
+        stats_.load_ms += load_ms;
+      }
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
@@ -103,10 +124,69 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::PopFullBatch() {
+  const int ready = prefetch_full_.size();
+  CPUTimer timer;
+  timer.Start();
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  const double wait_ms = timer.MicroSeconds() / 1000.;
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  ++stats_.batches;
+  stats_.wait_ms += wait_ms;
+  stats_.stalls += ready == 0;
+  ++stats_.occupancy[std::min<int>(ready, stats_.occupancy.size() - 1)];
+  return batch;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::AddStageTimes(double read_ms,
+    double decode_ms, double transform_ms) {
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  stats_.read_ms += read_ms;
+  stats_.decode_ms += decode_ms;
+  stats_.transform_ms += transform_ms;
+}
+
+template <typename Dtype>
+PrefetchStats BasePrefetchingDataLayer<Dtype>::prefetch_stats() const {
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  return stats_;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ResetPrefetchStats() {
+  boost::mutex::scoped_lock lock(*stats_mutex_);
+  stats_.batches = stats_.stalls = stats_.loaded = 0;
+  stats_.wait_ms = stats_.load_ms = 0;
+  stats_.read_ms = stats_.decode_ms = stats_.transform_ms = 0;
+  stats_.occupancy.assign(prefetch_.size() + 1, 0);
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::LogPrefetchStats() const {
+  const PrefetchStats stats = prefetch_stats();
+  if (stats.batches == 0) {
+    return;
+  }
+  const int loaded = std::max(stats.loaded, 1);
+  ostringstream occupancy;
+  for (int k = 0; k < stats.occupancy.size(); ++k) {
+    occupancy << " " << k << ":" << stats.occupancy[k];
+  }
+  LOG(INFO) << "Data layer " << this->layer_param_.name() << ": waited "
+      << stats.wait_ms / stats.batches << " ms/batch, stalled on "
+      << stats.stalls << "/" << stats.batches << " batches, queue"
+      << occupancy.str() << "; load " << stats.load_ms / loaded
+      << " ms/batch (read " << stats.read_ms / loaded << ", decode "
+      << stats.decode_ms / loaded << ", transform "
+      << stats.transform_ms / loaded << ")";
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = PopFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
@@ -120,6 +200,11 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
         top[1]->mutable_cpu_data());
   }
+  for (int i = 0; i < batch->extra_.size(); ++i) {
+    top[i + 2]->ReshapeLike(*batch->extra_[i]);
+    caffe_copy(batch->extra_[i]->count(), batch->extra_[i]->cpu_data(),
+        top[i + 2]->mutable_cpu_data());
+  }
 
   prefetch_free_.push(batch);
 }
@@ -31,6 +31,8 @@ void BatchTripletLossLayer<Dtype>::LayerSetUp(
     
   margin_ = this->layer_param_.triplet_loss_param().margin();
   mu_ = this->layer_param_.triplet_loss_param().mu();
+  precomputed_distance_ =
+      this->layer_param_.triplet_loss_param().precomputed_distance();
 }
 
 template <typename Dtype>
@@ -44,6 +46,10 @@ void BatchTripletLossLayer<Dtype>::Reshape(
   }
 
   int num = bottom[0]->num();
+  if (precomputed_distance_) {
+    CHECK_EQ(num, bottom[0]->count(1))
+        << "The precomputed distances must be an N x N matrix.";
+  }
   dist_.Reshape(num, num, 1, 1);
   norm_.Reshape(num, 1, 1, 1);
   aggregator_.reset(new SyncedMemory(num * num * sizeof(Dtype)));
@@ -71,17 +77,21 @@ void BatchTripletLossLayer<Dtype>::Forward_cpu(
   pos_pairs_.clear();
 
   Dtype* dist_data = dist_.mutable_cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num, dim, Dtype(-2),
-      feat_data, feat_data, Dtype(0), dist_data);
+  if (precomputed_distance_) {
+    caffe_copy(num * num, feat_data, dist_data);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num, dim, Dtype(-2),
+        feat_data, feat_data, Dtype(0), dist_data);
 
-  for (int i=0; i<num; ++i) {
-    norm_data[i] = -0.5 * dist_.data_at(i, i, 0, 0);
-  }
+    for (int i=0; i<num; ++i) {
+      norm_data[i] = -0.5 * dist_.data_at(i, i, 0, 0);
+    }
 
-  for (int i=0; i<num; ++i) {
-    dist_data = dist_.mutable_cpu_data() + dist_.offset(i);
-    for (int j=0; j<num; ++j) {
-      dist_data[j] += (norm_data[i] + norm_data[j]);
+    for (int i=0; i<num; ++i) {
+      dist_data = dist_.mutable_cpu_data() + dist_.offset(i);
+      for (int j=0; j<num; ++j) {
+        dist_data[j] += (norm_data[i] + norm_data[j]);
+      }
     }
   }
 
@@ -126,7 +136,7 @@ void BatchTripletLossLayer<Dtype>::Forward_cpu(
             continue;
           }
           pair_loss += dist_data[j];
-          pos_pairs_.push_back(make_pair<int, int>(i, j));
+          pos_pairs_.push_back(make_pair(i, j));
         }
       }
     }
@@ -201,7 +211,23 @@ void BatchTripletLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     LOG(FATAL) << this->type()
                << " Layer cannot backpropagate to label inputs.";
   }
-  if (propagate_down[0]) {
+  if (propagate_down[0] && precomputed_distance_) {
+    // The gradients w.r.t. the distances; the layer computing them takes
+    // them back to the features.
+    int num = bottom[0]->num();
+    Dtype* dist_diff = bottom[0]->mutable_cpu_diff();
+    caffe_set(num * num, Dtype(0), dist_diff);
+    Dtype scale1 = mu_ / triplets_.size();
+    for (int i=0; i<triplets_.size(); ++i) {
+      int qry_id = triplets_[i].first_;
+      dist_diff[qry_id * num + triplets_[i].second_] += scale1;
+      dist_diff[qry_id * num + triplets_[i].third_] -= scale1;
+    }
+    Dtype scale2 = (Dtype(1) - mu_) / pos_pairs_.size();
+    for (int i=0; i<pos_pairs_.size(); ++i) {
+      dist_diff[pos_pairs_[i].first * num + pos_pairs_[i].second] += scale2;
+    }
+  } else if (propagate_down[0]) {
     Blob<Dtype>* feat = bottom[0];
     const Dtype* feat_data = feat->cpu_data();
     Dtype* feat_diff = feat->mutable_cpu_diff();
@@ -10,6 +10,10 @@ namespace caffe {
 template <typename Dtype>
 void BatchTripletLossLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (precomputed_distance_) {
+    Forward_cpu(bottom, top);
+    return;
+  }
   // The forward pass computes the pairwise distances.
   const Dtype* feat_data = bottom[0]->cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
@@ -83,7 +87,7 @@ void BatchTripletLossLayer<Dtype>::Forward_gpu(
             continue;
           }
           pair_loss += dist_data[j];
-          pos_pairs_.push_back(make_pair<int, int>(i, j));
+          pos_pairs_.push_back(make_pair(i, j));
         }
       }
     }
@@ -154,6 +158,10 @@ void BatchTripletLossLayer<Dtype>::Forward_gpu(
 template <typename Dtype>
 void BatchTripletLossLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (precomputed_distance_) {
+    Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
   if (propagate_down[1]) {
     LOG(FATAL) << this->type()
                << " Layer cannot backpropagate to label inputs.";
@@ -35,8 +35,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -45,8 +45,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -57,6 +57,7 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
   double read_time = 0;
+  double decode_time = 0;
   double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
@@ -88,7 +89,19 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // Apply data transformations (mirror, scale, crop...)
     int offset = batch->data_.offset(item_id);
     this->transformed_data_.set_cpu_data(top_data + offset);
+#ifdef USE_OPENCV
+    // Decode encoded data apart, to time it.
+    if (datum.encoded()) {
+      const cv::Mat cv_img = this->data_transformer_->DecodeToCVMat(datum);
+      decode_time += timer.MicroSeconds();
+      timer.Start();
+      this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    } else {
+      this->data_transformer_->Transform(datum, &(this->transformed_data_));
+    }
+#else
     this->data_transformer_->Transform(datum, &(this->transformed_data_));
+#endif  // USE_OPENCV
     // Copy label.
     if (this->output_labels_) {
       top_label[item_id] = datum.label();
@@ -101,7 +114,10 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "   Decode time: " << decode_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  this->AddStageTimes(read_time / 1000, decode_time / 1000,
+      trans_time / 1000);
 }
 
 INSTANTIATE_CLASS(DataLayer);
@@ -43,6 +43,17 @@ void EmbedLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  sparse_gradient_ = this->layer_param_.embed_param().sparse_gradient();
+  touched_rows_.clear();
+  row_touched_.assign(sparse_gradient_ ? K_ : 0, false);
+}
+
+template <typename Dtype>
+void EmbedLayer<Dtype>::ClearSparseParamRows() {
+  for (int i = 0; i < touched_rows_.size(); ++i) {
+    row_touched_[touched_rows_[i]] = false;
+  }
+  touched_rows_.clear();
 }
 
 template <typename Dtype>
@@ -99,6 +110,10 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n])
           << "non-integer input";
       caffe_axpy(N_, Dtype(1), top_diff + n * N_, weight_diff + index * N_);
+      if (sparse_gradient_ && !row_touched_[index]) {
+        row_touched_[index] = true;
+        touched_rows_.push_back(index);
+      }
     }
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
@@ -1,11 +1,5 @@
-/*
-TODO:
-- load file in a separate thread ("prefetch")
-- can be smarter about the memcpy call instead of doing it row-by-row
-  :: use util functions caffe_copy, and Blob->offset()
-  :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
-*/
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -15,67 +9,167 @@ TODO:
 #include "stdint.h"
 
 #include "caffe/layers/hdf5_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+// Serializes the HDF5 calls of the prefetch threads.
+static boost::mutex hdf5_mutex_;
+
+// Returns the number of rows of the dataset dataset_name in the file filename.
+static hsize_t hdf5_count_rows(const string& filename,
+    const string& dataset_name) {
+  boost::mutex::scoped_lock lock(hdf5_mutex_);
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  CHECK_GE(file_id, 0) << "Failed opening HDF5 file: " << filename;
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(file_id, dataset_name.c_str(), &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name;
+  CHECK_GE(ndims, 1) << "No rows in " << dataset_name;
+  std::vector<hsize_t> dims(ndims);
+  H5T_class_t class_;
+  status = H5LTget_dataset_info(file_id, dataset_name.c_str(), &dims[0],
+      &class_, NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name;
+  H5Fclose(file_id);
+  return dims[0];
+}
+
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+  if (file_id_ >= 0) {
+    boost::mutex::scoped_lock lock(hdf5_mutex_);
+    H5Fclose(file_id_);
+  }
+}
 
-// Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
-  DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0) {
+void HDF5DataLayer<Dtype>::OpenHDF5File(const char* filename) {
+  DLOG(INFO) << "Opening HDF5 file: " << filename;
+  boost::mutex::scoped_lock lock(hdf5_mutex_);
+  if (file_id_ >= 0) {
+    herr_t status = H5Fclose(file_id_);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file";
+  }
+  file_id_ = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id_ < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
   }
 
-  int top_size = this->layer_param_.top_size();
-  hdf_blobs_.resize(top_size);
-
+  const int top_size = this->layer_param_.top_size();
+  const int chunk_size = this->layer_param_.hdf5_data_param().chunk_size();
   const int MIN_DATA_DIM = 1;
   const int MAX_DATA_DIM = INT_MAX;
-
+  chunk_.resize(top_size);
   for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-        MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get());
+    // Only the shape of the dataset is read; the blob is never allocated.
+    Blob<Dtype> dataset;
+    hdf5_load_nd_dataset_helper(file_id_, this->layer_param_.top(i).c_str(),
+        MIN_DATA_DIM, MAX_DATA_DIM, &dataset);
+    // MinTopBlobs==1 guarantees at least one top blob
+    if (i == 0) {
+      file_rows_ = dataset.shape(0);
+      CHECK_GT(file_rows_, 0) << "No rows in " << filename;
+    } else {
+      CHECK_EQ(dataset.shape(0), file_rows_);
+    }
+    vector<int> chunk_shape = dataset.shape();
+    chunk_shape[0] = std::min<hsize_t>(chunk_size, file_rows_);
+    if (chunk_[i]) {
+      CHECK_EQ(chunk_[i]->count(1), dataset.count(1))
+          << "The rows of " << this->layer_param_.top(i) << " in " << filename
+          << " differ from those of the previous files";
+    } else {
+      chunk_[i].reset(new Blob<Dtype>());
+    }
+    chunk_[i]->Reshape(chunk_shape);
+  }
+
+  const int num_chunks = (file_rows_ + chunk_size - 1) / chunk_size;
+  chunk_permutation_.resize(num_chunks);
+  for (int i = 0; i < num_chunks; ++i) {
+    chunk_permutation_[i] = i;
   }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    ShuffleChunks();
+  }
+  current_chunk_ = 0;
+  // The chunk is read by the first NextRow.
+  current_row_ = chunk_[0]->shape(0);
+}
 
-  herr_t status = H5Fclose(file_id);
-  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::ShuffleChunks() {
+  caffe::rng_t* prefetch_rng =
+      static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+  shuffle(chunk_permutation_.begin(), chunk_permutation_.end(), prefetch_rng);
+}
 
-  // MinTopBlobs==1 guarantees at least one top blob
-  CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
-  const int num = hdf_blobs_[0]->shape(0);
-  for (int i = 1; i < top_size; ++i) {
-    CHECK_EQ(hdf_blobs_[i]->shape(0), num);
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextChunk() {
+  if (current_chunk_ == chunk_permutation_.size()) {
+    if (num_files_ > 1) {
+      ++current_file_;
+      if (current_file_ == num_files_) {
+        current_file_ = 0;
+        if (this->layer_param_.hdf5_data_param().shuffle()) {
+          caffe::rng_t* prefetch_rng =
+              static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+          shuffle(file_permutation_.begin(), file_permutation_.end(),
+              prefetch_rng);
+        }
+        DLOG(INFO) << "Looping around to first file.";
+      }
+      OpenHDF5File(hdf_filenames_[file_permutation_[current_file_]].c_str());
+    } else {
+      current_chunk_ = 0;
+      if (this->layer_param_.hdf5_data_param().shuffle()) {
+        ShuffleChunks();
+      }
+    }
   }
-  // Default to identity permutation.
-  data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
-    data_permutation_[i] = i;
+  const hsize_t chunk_size = this->layer_param_.hdf5_data_param().chunk_size();
+  const hsize_t start = chunk_permutation_[current_chunk_++] * chunk_size;
+  const int rows = std::min(chunk_size, file_rows_ - start);
+  boost::mutex::scoped_lock lock(hdf5_mutex_);
+  for (int i = 0; i < chunk_.size(); ++i) {
+    vector<int> shape = chunk_[i]->shape();
+    shape[0] = rows;
+    chunk_[i]->Reshape(shape);
+    hdf5_load_nd_dataset_rows(file_id_, this->layer_param_.top(i).c_str(),
+        start, chunk_[i].get());
+  }
+  current_row_ = 0;
+}
 
-  // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
-  } else {
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextRow(const vector<Blob<Dtype>*>& blobs,
+    int index) {
+  if (current_row_ == chunk_[0]->shape(0)) {
+    NextChunk();
+  }
+  for (int i = 0; i < blobs.size(); ++i) {
+    const int data_dim = chunk_[i]->count(1);
+    caffe_copy(data_dim, chunk_[i]->cpu_data() + current_row_ * data_dim,
+        blobs[i]->mutable_cpu_data() + index * data_dim);
   }
+  ++current_row_;
 }
 
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+void HDF5DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
       this->type() << " does not transform data.";
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
+  CHECK_GT(hdf5_data_param.chunk_size(), 0);
   // Read the source to parse the filenames.
-  const string& source = this->layer_param_.hdf5_data_param().source();
+  const string& source = hdf5_data_param.source();
   LOG(INFO) << "Loading list of HDF5 filenames from: " << source;
   hdf_filenames_.clear();
   std::ifstream source_file(source.c_str());
@@ -102,64 +196,102 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+  if (hdf5_data_param.shuffle()) {
+    const unsigned int prefetch_rng_seed = caffe_rng_rand();
+    prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
+    caffe::rng_t* prefetch_rng =
+        static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+    shuffle(file_permutation_.begin(), file_permutation_.end(), prefetch_rng);
   }
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
-  current_row_ = 0;
+  // Open the first HDF5 file, which gives the shape of the rows.
+  OpenHDF5File(hdf_filenames_[file_permutation_[current_file_]].c_str());
 
   // Reshape blobs.
-  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  const int batch_size = hdf5_data_param.batch_size();
   const int top_size = this->layer_param_.top_size();
+  int buffer_size = hdf5_data_param.shuffle() ?
+      hdf5_data_param.shuffle_buffer_size() : 0;
+  if (buffer_size > 0) {
+    // A buffer larger than the source would hold some rows twice.
+    const hsize_t max_rows = buffer_size;
+    hsize_t source_rows = 0;
+    for (int i = 0; i < num_files_ && source_rows < max_rows; ++i) {
+      source_rows += hdf5_count_rows(hdf_filenames_[i],
+          this->layer_param_.top(0));
+    }
+    if (source_rows < max_rows) {
+      LOG(INFO) << "Capping the shuffle buffer at the " << source_rows
+          << " rows of " << source;
+      buffer_size = source_rows;
+    }
+  }
+  shuffle_buffer_.resize(buffer_size > 0 ? top_size : 0);
+  buffered_rows_ = 0;
   vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-    top_shape.resize(hdf_blobs_[i]->num_axes());
+    top_shape = chunk_[i]->shape();
     top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
-    }
     top[i]->Reshape(top_shape);
+    for (int j = 0; j < this->prefetch_.size(); ++j) {
+      Batch<Dtype>* batch = this->prefetch_[j].get();
+      if (i == 0) {
+        batch->data_.Reshape(top_shape);
+      } else if (i == 1) {
+        batch->label_.Reshape(top_shape);
+      } else {
+        batch->extra_.resize(top_size - 2);
+        batch->extra_[i - 2].reset(new Blob<Dtype>(top_shape));
+      }
+    }
+    if (buffer_size > 0) {
+      top_shape[0] = buffer_size;
+      shuffle_buffer_[i].reset(new Blob<Dtype>(top_shape));
+    }
   }
 }
 
+// This function is called on prefetch thread
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer timer;
+  timer.Start();
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  for (int i = 0; i < batch_size; ++i, ++current_row_) {
-    if (current_row_ == hdf_blobs_[0]->shape(0)) {
-      if (num_files_ > 1) {
-        ++current_file_;
-        if (current_file_ == num_files_) {
-          current_file_ = 0;
-          if (this->layer_param_.hdf5_data_param().shuffle()) {
-            std::random_shuffle(file_permutation_.begin(),
-                                file_permutation_.end());
-          }
-          DLOG(INFO) << "Looping around to first file.";
-        }
-        LoadHDF5FileData(
-            hdf_filenames_[file_permutation_[current_file_]].c_str());
-      }
-      current_row_ = 0;
-      if (this->layer_param_.hdf5_data_param().shuffle())
-        std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
+  vector<Blob<Dtype>*> blobs(1, &batch->data_);
+  if (this->output_labels_) {
+    blobs.push_back(&batch->label_);
+  }
+  for (int i = 0; i < batch->extra_.size(); ++i) {
+    blobs.push_back(batch->extra_[i].get());
+  }
+  if (shuffle_buffer_.empty()) {
+    for (int i = 0; i < batch_size; ++i) {
+      NextRow(blobs, i);
+    }
+  } else {
+    vector<Blob<Dtype>*> buffer(shuffle_buffer_.size());
+    for (int i = 0; i < shuffle_buffer_.size(); ++i) {
+      buffer[i] = shuffle_buffer_[i].get();
     }
-    for (int j = 0; j < this->layer_param_.top_size(); ++j) {
-      int data_dim = top[j]->count() / top[j]->shape(0);
-      caffe_copy(data_dim,
-          &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+    // Fill the buffer on the first batch, then refill each row drawn from it.
+    for (; buffered_rows_ < buffer[0]->shape(0); ++buffered_rows_) {
+      NextRow(buffer, buffered_rows_);
+    }
+    caffe::rng_t* prefetch_rng =
+        static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+    for (int i = 0; i < batch_size; ++i) {
+      const int row = (*prefetch_rng)() % buffered_rows_;
+      for (int j = 0; j < blobs.size(); ++j) {
+        const int data_dim = buffer[j]->count(1);
+        caffe_copy(data_dim, buffer[j]->cpu_data() + row * data_dim,
+            blobs[j]->mutable_cpu_data() + i * data_dim);
+      }
+      NextRow(buffer, row);
     }
   }
+  this->AddStageTimes(timer.MicroSeconds() / 1000, 0, 0);
 }
 
-#ifdef CPU_ONLY
-STUB_GPU_FORWARD(HDF5DataLayer, Forward);
-#endif
-
 INSTANTIATE_CLASS(HDF5DataLayer);
 REGISTER_LAYER_CLASS(HDF5Data);
 
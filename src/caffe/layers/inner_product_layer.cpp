@@ -3,6 +3,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -52,6 +53,16 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  const QuantizationParameter& quant_param =
+      this->layer_param_.quantization_param();
+  int8_ = quant_param.precision() == QuantizationParameter_Precision_INT8;
+  bottom_scale_ = quant_param.bottom_scale();
+  quantized_weight_mem_ = NULL;
+  quantized_weight_version_ = 0;
+  if (int8_) {
+    vector<int> scale_shape(1, N_);
+    weight_inv_scale_.Reshape(scale_shape);
+  }
 }
 
 template <typename Dtype>
@@ -78,11 +89,21 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     bias_multiplier_.Reshape(bias_shape);
     caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
   }
+  if (int8_) {
+    if (!bottom_int8_ || bottom_int8_->size() < M_ * K_ * sizeof(int8_t)) {
+      bottom_int8_.reset(new SyncedMemory(M_ * K_ * sizeof(int8_t)));
+      top_int32_.reset(new SyncedMemory(M_ * N_ * sizeof(int32_t)));
+    }
+  }
 }
 
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (int8_) {
+    Forward_cpu_int8(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
@@ -96,6 +117,73 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::QuantizeWeights() {
+  const Blob<Dtype>& weight_blob = *this->blobs_[0];
+  Dtype* inv_scale = weight_inv_scale_.mutable_cpu_data();
+  quantized_weight_mem_ = weight_blob.data().get();
+  quantized_weight_version_ = quantized_weight_mem_->version();
+  // Weights loaded as int8 with a scale per output are already in the N_ x K_
+  // layout of the int8 GEMM.
+  shared_ptr<SyncedMemory> loaded_int8 = weight_blob.int8_data();
+  if (loaded_int8 && !transpose_ && weight_blob.int8_scale().size() == N_) {
+    weight_int8_ = loaded_int8;
+    for (int n = 0; n < N_; ++n) {
+      inv_scale[n] = Dtype(1) / weight_blob.int8_scale()[n];
+    }
+    return;
+  }
+  // A buffer still shared with the blob is left to it.
+  if (!weight_int8_ || !weight_int8_.unique()) {
+    weight_int8_.reset(new SyncedMemory(N_ * K_ * sizeof(int8_t)));
+  }
+  const Dtype* weight = weight_blob.cpu_data();
+  int8_t* weight_int8 = static_cast<int8_t*>(weight_int8_->mutable_cpu_data());
+  if (transpose_) {
+    // Bring the K_ x N_ weights into the N_ x K_ layout of the int8 GEMM.
+    Blob<Dtype> weight_t(vector<int>(1, N_ * K_));
+    Dtype* weight_t_data = weight_t.mutable_cpu_data();
+    for (int k = 0; k < K_; ++k) {
+      for (int n = 0; n < N_; ++n) {
+        weight_t_data[n * K_ + k] = weight[k * N_ + n];
+      }
+    }
+    caffe_cpu_quantize_rows(N_, K_, weight_t_data, weight_int8, inv_scale);
+  } else {
+    caffe_cpu_quantize_rows(N_, K_, weight, weight_int8, inv_scale);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::Forward_cpu_int8(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // The weights can change in place, keeping their pointer, so the int8
+  // copy is checked against the version of their memory. In TRAIN phase
+  // they are requantized on every pass: they change on every iteration,
+  // possibly through another net's pointer into shared memory (CPUParams).
+  const SyncedMemory* weight_mem = this->blobs_[0]->data().get();
+  if (this->phase_ == TRAIN || quantized_weight_mem_ != weight_mem
+      || quantized_weight_version_ != weight_mem->version()) {
+    QuantizeWeights();
+  }
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype bottom_scale = bottom_scale_ > 0 ? bottom_scale_ :
+      caffe_cpu_int8_scale(M_ * K_, bottom_data);
+  int8_t* bottom_int8 = static_cast<int8_t*>(bottom_int8_->mutable_cpu_data());
+  int32_t* top_int32 = static_cast<int32_t*>(top_int32_->mutable_cpu_data());
+  caffe_cpu_quantize(M_ * K_, bottom_scale, bottom_data, bottom_int8);
+  caffe_cpu_gemm_int8(M_, N_, K_, bottom_int8,
+      static_cast<const int8_t*>(weight_int8_->cpu_data()), top_int32);
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  caffe_cpu_requantize<Dtype>(M_, N_, top_int32, Dtype(1) / bottom_scale,
+      NULL, weight_inv_scale_.cpu_data(), top_data);
+  if (bias_term_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
+        bias_multiplier_.cpu_data(),
+        this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
+  }
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
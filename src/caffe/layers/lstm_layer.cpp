@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,17 @@
 
 namespace caffe {
 
+// The nonlinearities of LSTMUnitLayer, so that both engines agree.
+template <typename Dtype>
+inline Dtype lstm_sigmoid(Dtype x) {
+  return 1. / (1. + exp(-x));
+}
+
+template <typename Dtype>
+inline Dtype lstm_tanh(Dtype x) {
+  return 2. * lstm_sigmoid(2. * x) - 1.;
+}
+
 template <typename Dtype>
 void LSTMLayer<Dtype>::RecurrentInputBlobNames(vector<string>* names) const {
   names->resize(2);
@@ -238,6 +250,233 @@ void LSTMLayer<Dtype>::FillUnrolledNet(NetParameter* net_param) const {
   net_param->add_layer()->CopyFrom(output_concat_layer);
 }
 
+template <typename Dtype>
+void LSTMLayer<Dtype>::FusedSetUp(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int num_output = this->layer_param_.recurrent_param().num_output();
+  CHECK_GT(num_output, 0) << "num_output must be positive";
+  shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
+      this->layer_param_.recurrent_param().weight_filler()));
+  shared_ptr<Filler<Dtype> > bias_filler(GetFiller<Dtype>(
+      this->layer_param_.recurrent_param().bias_filler()));
+  // The parameters of the unrolled net: W_xc, b_c, W_xc_static and W_hc.
+  vector<int> weight_shape(2);
+  weight_shape[0] = 4 * num_output;
+  weight_shape[1] = bottom[0]->count(2);
+  this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+      weight_shape)));
+  weight_filler->Fill(this->blobs_.back().get());
+  vector<int> bias_shape(1, 4 * num_output);
+  this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+      bias_shape)));
+  bias_filler->Fill(this->blobs_.back().get());
+  if (this->static_input_) {
+    weight_shape[1] = bottom[2]->count(1);
+    this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+        weight_shape)));
+    weight_filler->Fill(this->blobs_.back().get());
+  }
+  weight_shape[1] = num_output;
+  this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+      weight_shape)));
+  weight_filler->Fill(this->blobs_.back().get());
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::FusedReshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int num_output = this->layer_param_.recurrent_param().num_output();
+  CHECK_EQ(this->blobs_[0]->shape(1), bottom[0]->count(2))
+      << "Input size incompatible with inner product parameters.";
+  vector<int> shape(3);
+  shape[0] = this->T_;
+  shape[1] = this->N_;
+  shape[2] = num_output;
+  top[0]->Reshape(shape);
+  h_conted_.Reshape(shape);
+  shape[0] = this->T_ + 1;
+  cell_.Reshape(shape);
+  shape[0] = 2;
+  state_diff_.Reshape(shape);
+  shape[0] = this->T_;
+  shape[2] = 4 * num_output;
+  gates_.Reshape(shape);
+  shape[0] = 1;
+  static_gates_.Reshape(shape);
+  vector<int> multiplier_shape(1, this->T_ * this->N_);
+  bias_multiplier_.Reshape(multiplier_shape);
+  caffe_set(bias_multiplier_.count(), Dtype(1),
+      bias_multiplier_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::FusedForward(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top, const vector<Blob<Dtype>*>& hidden_in) {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = top[0]->shape(2);
+  const int G = 4 * H;
+  const int D = bottom[0]->count(2);
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* W_xc = this->blobs_[0]->cpu_data();
+  const Dtype* b_c = this->blobs_[1]->cpu_data();
+  const Dtype* W_hc = this->blobs_.back()->cpu_data();
+  Dtype* gates = gates_.mutable_cpu_data();
+  Dtype* cell = cell_.mutable_cpu_data();
+  Dtype* h_conted = h_conted_.mutable_cpu_data();
+  Dtype* h = top[0]->mutable_cpu_data();
+
+  // The gate inputs from x of all timesteps: W_xc * x + b_c (+ W_xc_static *
+  // x_static).
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T * N, G, D, (Dtype)1.,
+      bottom[0]->cpu_data(), W_xc, (Dtype)0., gates);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, G, 1, (Dtype)1.,
+      bias_multiplier_.cpu_data(), b_c, (Dtype)1., gates);
+  if (this->static_input_) {
+    Dtype* static_gates = static_gates_.mutable_cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, G, bottom[2]->count(1),
+        (Dtype)1., bottom[2]->cpu_data(), this->blobs_[2]->cpu_data(),
+        (Dtype)0., static_gates);
+    for (int t = 0; t < T; ++t) {
+      caffe_axpy<Dtype>(N * G, (Dtype)1., static_gates, gates + t * N * G);
+    }
+  }
+
+  caffe_copy(N * H, hidden_in[1]->cpu_data(), cell);
+  const Dtype* h_prev = hidden_in[0]->cpu_data();
+  for (int t = 0; t < T; ++t) {
+    const Dtype* cont_t = cont + t * N;
+    Dtype* h_conted_t = h_conted + t * N * H;
+    for (int n = 0; n < N; ++n) {
+      caffe_cpu_scale(H, cont_t[n], h_prev + n * H, h_conted_t + n * H);
+    }
+    Dtype* gates_t = gates + t * N * G;
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, G, H, (Dtype)1.,
+        h_conted_t, W_hc, (Dtype)1., gates_t);
+    // The LSTMUnit, keeping the activations of the gates for Backward.
+    const Dtype* c_prev = cell + t * N * H;
+    Dtype* c = cell + (t + 1) * N * H;
+    Dtype* h_t = h + t * N * H;
+    for (int n = 0; n < N; ++n) {
+      Dtype* X = gates_t + n * G;
+      for (int d = 0; d < H; ++d) {
+        const Dtype i = lstm_sigmoid(X[d]);
+        const Dtype f = lstm_sigmoid(X[H + d]);
+        const Dtype o = lstm_sigmoid(X[2 * H + d]);
+        const Dtype g = lstm_tanh(X[3 * H + d]);
+        X[d] = i;
+        X[H + d] = f;
+        X[2 * H + d] = o;
+        X[3 * H + d] = g;
+        const Dtype f_cont = (cont_t[n] == 0) ? 0 : cont_t[n] * f;
+        const Dtype c_nd = f_cont * c_prev[n * H + d] + i * g;
+        c[n * H + d] = c_nd;
+        h_t[n * H + d] = o * lstm_tanh(c_nd);
+      }
+    }
+    h_prev = h_t;
+  }
+  // hidden_in may be hidden_, which is only written now.
+  caffe_copy(N * H, h + (T - 1) * N * H, this->hidden_[0]->mutable_cpu_data());
+  caffe_copy(N * H, cell + T * N * H, this->hidden_[1]->mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::FusedBackward(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = top[0]->shape(2);
+  const int G = 4 * H;
+  const int D = bottom[0]->count(2);
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* gates = gates_.cpu_data();
+  const Dtype* cell = cell_.cpu_data();
+  const Dtype* h_diff = top[0]->cpu_diff();
+  const Dtype* W_hc = this->blobs_.back()->cpu_data();
+  Dtype* gates_diff = gates_.mutable_cpu_diff();
+  // The diffs of h_t and c_t flowing back from timestep t + 1.
+  Dtype* h_next_diff = state_diff_.mutable_cpu_data();
+  Dtype* c_next_diff = h_next_diff + N * H;
+  caffe_set(2 * N * H, Dtype(0), h_next_diff);
+
+  for (int t = T - 1; t >= 0; --t) {
+    const Dtype* cont_t = cont + t * N;
+    const Dtype* c_prev = cell + t * N * H;
+    const Dtype* c = cell + (t + 1) * N * H;
+    const Dtype* h_diff_t = h_diff + t * N * H;
+    Dtype* gates_diff_t = gates_diff + t * N * G;
+    for (int n = 0; n < N; ++n) {
+      const Dtype* X = gates + (t * N + n) * G;
+      Dtype* X_diff = gates_diff_t + n * G;
+      for (int d = 0; d < H; ++d) {
+        const int nd = n * H + d;
+        const Dtype i = X[d];
+        const Dtype f = (cont_t[n] == 0) ? 0 : cont_t[n] * X[H + d];
+        const Dtype o = X[2 * H + d];
+        const Dtype g = X[3 * H + d];
+        const Dtype tanh_c = lstm_tanh(c[nd]);
+        const Dtype h_total_diff = h_diff_t[nd] + h_next_diff[nd];
+        const Dtype c_term_diff =
+            c_next_diff[nd] + h_total_diff * o * (1 - tanh_c * tanh_c);
+        c_next_diff[nd] = c_term_diff * f;
+        X_diff[d] = c_term_diff * g * i * (1 - i);
+        X_diff[H + d] = c_term_diff * c_prev[nd] * f * (1 - f);
+        X_diff[2 * H + d] = h_total_diff * tanh_c * o * (1 - o);
+        X_diff[3 * H + d] = c_term_diff * i * (1 - g * g);
+      }
+    }
+    // Through the recurrent GEMM to cont_t * h_{t-1}.
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, H, G, (Dtype)1.,
+        gates_diff_t, W_hc, (Dtype)0., h_next_diff);
+    for (int n = 0; n < N; ++n) {
+      caffe_scal(H, cont_t[n], h_next_diff + n * H);
+    }
+  }
+
+  // The gradients of all timesteps, each as one GEMM.
+  const int W_hc_index = this->blobs_.size() - 1;
+  if (this->param_propagate_down_[0]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, G, D, T * N, (Dtype)1.,
+        gates_diff, bottom[0]->cpu_data(), (Dtype)1.,
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[1]) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, T * N, G, (Dtype)1., gates_diff,
+        bias_multiplier_.cpu_data(), (Dtype)1.,
+        this->blobs_[1]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[W_hc_index]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, G, H, T * N, (Dtype)1.,
+        gates_diff, h_conted_.cpu_data(), (Dtype)1.,
+        this->blobs_[W_hc_index]->mutable_cpu_diff());
+  }
+  if (propagate_down[0]) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, D, G, (Dtype)1.,
+        gates_diff, this->blobs_[0]->cpu_data(), (Dtype)0.,
+        bottom[0]->mutable_cpu_diff());
+  }
+  if (this->static_input_) {
+    // The static input contributes to every timestep.
+    Dtype* static_diff = static_gates_.mutable_cpu_diff();
+    caffe_set(N * G, Dtype(0), static_diff);
+    for (int t = 0; t < T; ++t) {
+      caffe_axpy<Dtype>(N * G, (Dtype)1., gates_diff + t * N * G, static_diff);
+    }
+    const int static_dim = bottom[2]->count(1);
+    if (this->param_propagate_down_[2]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, G, static_dim, N,
+          (Dtype)1., static_diff, bottom[2]->cpu_data(), (Dtype)1.,
+          this->blobs_[2]->mutable_cpu_diff());
+    }
+    if (propagate_down[2]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, static_dim, G,
+          (Dtype)1., static_diff, this->blobs_[2]->cpu_data(), (Dtype)0.,
+          bottom[2]->mutable_cpu_diff());
+    }
+  }
+}
+
 INSTANTIATE_CLASS(LSTMLayer);
 REGISTER_LAYER_CLASS(LSTM);
 
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/margin_softmax_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The smallest norm divided by, for features or weight rows of zeros.
+static const double kMinNorm = 1e-12;
+
+template <typename Dtype>
+void MarginSoftmaxLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  const MarginSoftmaxParameter& param =
+      this->layer_param_.margin_softmax_param();
+  N_ = param.num_output();
+  CHECK_GT(N_, 0) << "MarginSoftmaxLossLayer num_output must be positive.";
+  const int axis = bottom[0]->CanonicalAxisIndex(param.axis());
+  K_ = bottom[0]->count(axis);
+  CHECK_GT(param.block_size(), 0) << "block_size must be positive.";
+  block_size_ = std::min<int>(param.block_size(), N_);
+  scale_ = param.scale();
+  margin_ = param.margin();
+  angular_ = param.margin_type() == MarginSoftmaxParameter_MarginType_ANGULAR;
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(1);
+    vector<int> weight_shape(2);
+    weight_shape[0] = N_;
+    weight_shape[1] = K_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
+        param.weight_filler()));
+    weight_filler->Fill(this->blobs_[0].get());
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  has_ignore_label_ = this->layer_param_.loss_param().has_ignore_label();
+  if (has_ignore_label_) {
+    ignore_label_ = this->layer_param_.loss_param().ignore_label();
+  }
+  if (!this->layer_param_.loss_param().has_normalization() &&
+      this->layer_param_.loss_param().has_normalize()) {
+    normalization_ = this->layer_param_.loss_param().normalize() ?
+                     LossParameter_NormalizationMode_VALID :
+                     LossParameter_NormalizationMode_BATCH_SIZE;
+  } else {
+    normalization_ = this->layer_param_.loss_param().normalization();
+  }
+}
+
+template <typename Dtype>
+void MarginSoftmaxLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  const int axis = bottom[0]->CanonicalAxisIndex(
+      this->layer_param_.margin_softmax_param().axis());
+  CHECK_EQ(K_, bottom[0]->count(axis))
+      << "Input size incompatible with the weight.";
+  M_ = bottom[0]->count(0, axis);
+  CHECK_EQ(M_, bottom[1]->count())
+      << "The number of labels must match the number of samples.";
+  target_.resize(M_);
+  vector<int> shape(2);
+  shape[0] = M_;
+  shape[1] = K_;
+  x_hat_.Reshape(shape);
+  shape[1] = block_size_;
+  block_.Reshape(shape);
+  shape[0] = block_size_;
+  shape[1] = K_;
+  block_weight_diff_.Reshape(shape);
+  shape.resize(1);
+  shape[0] = M_;
+  x_norm_.Reshape(shape);
+  logsumexp_.Reshape(shape);
+  shape[0] = N_;
+  w_norm_.Reshape(shape);
+}
+
+template <typename Dtype>
+Dtype MarginSoftmaxLossLayer<Dtype>::MarginLogit(Dtype cosine,
+    Dtype* derivative) const {
+  if (!angular_) {
+    if (derivative) { *derivative = 1; }
+    return cosine - margin_;
+  }
+  // cos(theta + m) only decreases with theta up to theta + m = pi; beyond,
+  // cos(theta) - m sin(m) is used instead, as in ArcFace.
+  const Dtype cos_m = std::cos(margin_);
+  const Dtype sin_m = std::sin(margin_);
+  if (cosine <= -cos_m) {
+    if (derivative) { *derivative = 1; }
+    return cosine - margin_ * sin_m;
+  }
+  const Dtype sine = std::sqrt(std::max(Dtype(1) - cosine * cosine,
+      Dtype(kMinNorm)));
+  if (derivative) {
+    *derivative = cos_m + sin_m * cosine / sine;
+  }
+  return cosine * cos_m - sine * sin_m;
+}
+
+template <typename Dtype>
+void MarginSoftmaxLossLayer<Dtype>::BlockLogits(int begin, int cols) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* w_norm = w_norm_.cpu_data();
+  Dtype* logits = block_.mutable_cpu_data();
+  Dtype* cosines = block_.mutable_cpu_diff();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, cols, K_, Dtype(1),
+      x_hat_.cpu_data(), weight + static_cast<size_t>(begin) * K_, Dtype(0),
+      cosines);
+  for (int i = 0; i < M_; ++i) {
+    for (int j = 0; j < cols; ++j) {
+      const int index = i * cols + j;
+      cosines[index] = std::max(Dtype(-1), std::min(Dtype(1),
+          cosines[index] / w_norm[begin + j]));
+      logits[index] = scale_ * cosines[index];
+    }
+    const int target = target_[i] - begin;
+    if (target >= 0 && target < cols) {
+      logits[i * cols + target] =
+          scale_ * MarginLogit(cosines[i * cols + target], NULL);
+    }
+  }
+}
+
+template <typename Dtype>
+Dtype MarginSoftmaxLossLayer<Dtype>::get_normalizer(int valid_count) const {
+  Dtype normalizer;
+  switch (normalization_) {
+    case LossParameter_NormalizationMode_FULL:
+    case LossParameter_NormalizationMode_BATCH_SIZE:
+      normalizer = Dtype(M_);
+      break;
+    case LossParameter_NormalizationMode_VALID:
+      normalizer = Dtype(valid_count);
+      break;
+    case LossParameter_NormalizationMode_NONE:
+      normalizer = Dtype(1);
+      break;
+    default:
+      LOG(FATAL) << "Unknown normalization mode: "
+          << LossParameter_NormalizationMode_Name(normalization_);
+  }
+  return std::max(Dtype(1.0), normalizer);
+}
+
+template <typename Dtype>
+void MarginSoftmaxLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* x_hat = x_hat_.mutable_cpu_data();
+  Dtype* x_norm = x_norm_.mutable_cpu_data();
+  Dtype* w_norm = w_norm_.mutable_cpu_data();
+  for (int i = 0; i < M_; ++i) {
+    x_norm[i] = std::max(Dtype(kMinNorm), std::sqrt(caffe_cpu_dot(K_,
+        bottom_data + i * K_, bottom_data + i * K_)));
+    caffe_cpu_scale(K_, Dtype(1) / x_norm[i], bottom_data + i * K_,
+        x_hat + i * K_);
+  }
+  for (int c = 0; c < N_; ++c) {
+    const Dtype* row = weight + static_cast<size_t>(c) * K_;
+    w_norm[c] = std::max(Dtype(kMinNorm),
+        std::sqrt(caffe_cpu_dot(K_, row, row)));
+  }
+  valid_count_ = 0;
+  for (int i = 0; i < M_; ++i) {
+    const int label_value = static_cast<int>(label[i]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      target_[i] = -1;
+      continue;
+    }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, N_);
+    target_[i] = label_value;
+    ++valid_count_;
+  }
+  // The running max of the logits of each sample, and the sum of their
+  // exp(logit - max), in the data and diff of logsumexp_.
+  Dtype* max_logit = logsumexp_.mutable_cpu_data();
+  Dtype* sum = logsumexp_.mutable_cpu_diff();
+  caffe_set(M_, Dtype(-FLT_MAX), max_logit);
+  caffe_set(M_, Dtype(0), sum);
+  Dtype loss = 0;
+  for (int begin = 0; begin < N_; begin += block_size_) {
+    const int cols = std::min(block_size_, N_ - begin);
+    BlockLogits(begin, cols);
+    const Dtype* logits = block_.cpu_data();
+    for (int i = 0; i < M_; ++i) {
+      const Dtype* row = logits + i * cols;
+      const Dtype block_max = *std::max_element(row, row + cols);
+      if (block_max > max_logit[i]) {
+        sum[i] *= std::exp(max_logit[i] - block_max);
+        max_logit[i] = block_max;
+      }
+      for (int j = 0; j < cols; ++j) {
+        sum[i] += std::exp(row[j] - max_logit[i]);
+      }
+      const int target = target_[i] - begin;
+      if (target >= 0 && target < cols) {
+        loss -= row[target];
+      }
+    }
+  }
+  Dtype* logsumexp = max_logit;
+  for (int i = 0; i < M_; ++i) {
+    logsumexp[i] = max_logit[i] + std::log(sum[i]);
+    if (target_[i] >= 0) {
+      loss += logsumexp[i];
+    }
+  }
+  top[0]->mutable_cpu_data()[0] = loss / get_normalizer(valid_count_);
+}
+
+template <typename Dtype>
+void MarginSoftmaxLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  if (!propagate_down[0] && !this->param_propagate_down_[0]) {
+    return;
+  }
+  const Dtype loss_scale =
+      top[0]->cpu_diff()[0] / get_normalizer(valid_count_) * scale_;
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* w_norm = w_norm_.cpu_data();
+  const Dtype* x_hat = x_hat_.cpu_data();
+  const Dtype* logsumexp = logsumexp_.cpu_data();
+  Dtype* x_hat_diff = x_hat_.mutable_cpu_diff();
+  caffe_set(x_hat_.count(), Dtype(0), x_hat_diff);
+  for (int begin = 0; begin < N_; begin += block_size_) {
+    const int cols = std::min(block_size_, N_ - begin);
+    BlockLogits(begin, cols);
+    // The gradients w.r.t. the cosines, over the norms of the weight rows:
+    // the gradients w.r.t. the products of the normalized features with the
+    // weight rows.
+    Dtype* grad = block_.mutable_cpu_data();
+    const Dtype* cosines = block_.cpu_diff();
+    for (int i = 0; i < M_; ++i) {
+      Dtype* row = grad + i * cols;
+      if (target_[i] < 0) {
+        caffe_set(cols, Dtype(0), row);
+        continue;
+      }
+      for (int j = 0; j < cols; ++j) {
+        row[j] = std::exp(row[j] - logsumexp[i]);
+      }
+      const int target = target_[i] - begin;
+      if (target >= 0 && target < cols) {
+        Dtype derivative;
+        MarginLogit(cosines[i * cols + target], &derivative);
+        row[target] = (row[target] - 1) * derivative;
+      }
+      for (int j = 0; j < cols; ++j) {
+        row[j] *= loss_scale / w_norm[begin + j];
+      }
+    }
+    const Dtype* block_weight = weight + static_cast<size_t>(begin) * K_;
+    if (propagate_down[0]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, cols,
+          Dtype(1), grad, block_weight, Dtype(1), x_hat_diff);
+    }
+    if (this->param_propagate_down_[0]) {
+      // Backpropagate through the normalization of each weight row.
+      Dtype* block_diff = block_weight_diff_.mutable_cpu_data();
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, cols, K_, M_, Dtype(1),
+          grad, x_hat, Dtype(0), block_diff);
+      Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff() +
+          static_cast<size_t>(begin) * K_;
+      for (int j = 0; j < cols; ++j) {
+        const Dtype* w = block_weight + j * K_;
+        const Dtype dot = caffe_cpu_dot(K_, w, block_diff + j * K_);
+        caffe_axpy(K_, Dtype(1), block_diff + j * K_, weight_diff + j * K_);
+        caffe_axpy(K_, -dot / (w_norm[begin + j] * w_norm[begin + j]), w,
+            weight_diff + j * K_);
+      }
+    }
+  }
+  if (propagate_down[0]) {
+    // Backpropagate through the normalization of each feature.
+    const Dtype* x_norm = x_norm_.cpu_data();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    for (int i = 0; i < M_; ++i) {
+      const Dtype dot = caffe_cpu_dot(K_, x_hat + i * K_, x_hat_diff + i * K_);
+      caffe_cpu_scale(K_, Dtype(1) / x_norm[i], x_hat_diff + i * K_,
+          bottom_diff + i * K_);
+      caffe_axpy(K_, -dot / x_norm[i], x_hat + i * K_, bottom_diff + i * K_);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(MarginSoftmaxLossLayer);
+REGISTER_LAYER_CLASS(MarginSoftmaxLoss);
+
+}  // namespace caffe
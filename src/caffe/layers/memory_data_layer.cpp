@@ -28,6 +28,30 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   labels_ = NULL;
   added_data_.cpu_data();
   added_label_.cpu_data();
+  const int ring_size = this->layer_param_.memory_data_param().ring_size();
+  ring_.resize(ring_size);
+  for (int i = 0; i < ring_size; ++i) {
+    ring_[i].reset(new Batch<Dtype>());
+    ring_[i]->data_.Reshape(batch_size_, channels_, height_, width_);
+    ring_[i]->label_.Reshape(label_shape);
+    // Allocate now rather than on the threads of the producers.
+    ring_[i]->data_.mutable_cpu_data();
+    ring_[i]->label_.mutable_cpu_data();
+    ring_free_.push(ring_[i].get());
+  }
+}
+
+template <typename Dtype>
+Batch<Dtype>* MemoryDataLayer<Dtype>::ReserveBatch() {
+  CHECK(!ring_.empty()) << "ReserveBatch needs memory_data_param().ring_size()";
+  return ring_free_.pop("Waiting for a free batch slot");
+}
+
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::CommitBatch(Batch<Dtype>* batch) {
+  CHECK(batch);
+  CHECK_EQ(batch_size_, batch->data_.num()) << "Slots can't be reshaped";
+  ring_full_.push(batch);
 }
 
 template <typename Dtype>
@@ -81,6 +105,7 @@ void MemoryDataLayer<Dtype>::AddMatVector(const vector<cv::Mat>& mat_vector,
 
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
+  CHECK(ring_.empty()) << "Reset can't be used along with ring_size";
   CHECK(data);
   CHECK(labels);
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
@@ -99,6 +124,7 @@ template <typename Dtype>
 void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
   CHECK(!has_new_data_) <<
       "Can't change batch_size until current data has been consumed.";
+  CHECK(ring_.empty()) << "Can't change batch_size of the batch slots";
   batch_size_ = new_size;
   added_data_.Reshape(batch_size_, channels_, height_, width_);
   added_label_.Reshape(batch_size_, 1, 1, 1);
@@ -107,6 +133,18 @@ void MemoryDataLayer<Dtype>::set_batch_size(int new_size) {
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (!ring_.empty()) {
+    // The tops pointed at the previous slot until now.
+    if (ring_current_) {
+      ring_free_.push(ring_current_);
+    }
+    ring_current_ = ring_full_.pop("Waiting for a committed batch slot");
+    top[0]->ReshapeLike(ring_current_->data_);
+    top[1]->ReshapeLike(ring_current_->label_);
+    top[0]->set_cpu_data(ring_current_->data_.mutable_cpu_data());
+    top[1]->set_cpu_data(ring_current_->label_.mutable_cpu_data());
+    return;
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initialized by calling Reset";
   top[0]->Reshape(batch_size_, channels_, height_, width_);
   top[1]->Reshape(batch_size_, 1, 1, 1);
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/layers/pairwise_distance_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The smallest norm divided by, for features of zeros.
+static const double kMinNorm = 1e-12;
+
+template <typename Dtype>
+void PairwiseDistanceLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  metric_ = this->layer_param_.pairwise_distance_param().metric();
+  CHECK(top.size() == 1 || top.size() == 3)
+      << "PairwiseDistanceLayer has the distances as top, and optionally "
+      << "the masks of same and different labels.";
+  CHECK(top.size() == 1 || bottom.size() == 2)
+      << "The label masks need the labels as bottom[1].";
+}
+
+template <typename Dtype>
+void PairwiseDistanceLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int num = bottom[0]->num();
+  if (bottom.size() == 2) {
+    CHECK_EQ(num, bottom[1]->count())
+        << "The number of labels must match the number of features.";
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    top[i]->Reshape(num, num, 1, 1);
+  }
+  if (metric_ == PairwiseDistanceParameter_Metric_COSINE) {
+    x_hat_.ReshapeLike(*bottom[0]);
+  }
+  norm_.Reshape(num, 1, 1, 1);
+  sym_diff_.Reshape(num, num, 1, 1);
+}
+
+template <typename Dtype>
+void PairwiseDistanceLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int num = bottom[0]->num();
+  const int dim = bottom[0]->count(1);
+  const Dtype* x = bottom[0]->cpu_data();
+  Dtype* dist = top[0]->mutable_cpu_data();
+  Dtype* norm = norm_.mutable_cpu_data();
+  switch (metric_) {
+  case PairwiseDistanceParameter_Metric_EUCLIDEAN:
+    // |x_i|^2 + |x_j|^2 - 2 x_i x_j, with the squared norms read off the
+    // diagonal.
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num, dim, Dtype(-2),
+        x, x, Dtype(0), dist);
+    for (int i = 0; i < num; ++i) {
+      norm[i] = Dtype(-0.5) * dist[i * num + i];
+    }
+    for (int i = 0; i < num; ++i) {
+      for (int j = 0; j < num; ++j) {
+        dist[i * num + j] += norm[i] + norm[j];
+      }
+    }
+    break;
+  case PairwiseDistanceParameter_Metric_COSINE: {
+    Dtype* x_hat = x_hat_.mutable_cpu_data();
+    for (int i = 0; i < num; ++i) {
+      norm[i] = std::max(Dtype(kMinNorm),
+          std::sqrt(caffe_cpu_dot(dim, x + i * dim, x + i * dim)));
+      caffe_cpu_scale(dim, Dtype(1) / norm[i], x + i * dim, x_hat + i * dim);
+    }
+    caffe_set(num * num, Dtype(1), dist);
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num, dim, Dtype(-1),
+        x_hat, x_hat, Dtype(1), dist);
+    break;
+  }
+  case PairwiseDistanceParameter_Metric_DOT:
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, num, dim, Dtype(-1),
+        x, x, Dtype(0), dist);
+    break;
+  default:
+    LOG(FATAL) << "Unknown pairwise distance metric.";
+  }
+  if (top.size() == 3) {
+    const Dtype* label = bottom[1]->cpu_data();
+    Dtype* same = top[1]->mutable_cpu_data();
+    Dtype* different = top[2]->mutable_cpu_data();
+    for (int i = 0; i < num; ++i) {
+      for (int j = 0; j < num; ++j) {
+        const bool same_label = label[i] == label[j];
+        same[i * num + j] = same_label && i != j;
+        different[i * num + j] = !same_label;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PairwiseDistanceLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (bottom.size() == 2 && propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  if (!propagate_down[0]) { return; }
+  const int num = bottom[0]->num();
+  const int dim = bottom[0]->count(1);
+  // Each distance is symmetric in its features, so x_i gets the gradients of
+  // both D_ij and D_ji.
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* sym_diff = sym_diff_.mutable_cpu_data();
+  for (int i = 0; i < num; ++i) {
+    for (int j = 0; j < num; ++j) {
+      sym_diff[i * num + j] = top_diff[i * num + j] + top_diff[j * num + i];
+    }
+  }
+  const Dtype* x = bottom[0]->cpu_data();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  switch (metric_) {
+  case PairwiseDistanceParameter_Metric_EUCLIDEAN:
+    // 2 sum_j S_ij (x_i - x_j)
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, num,
+        Dtype(-2), sym_diff, x, Dtype(0), bottom_diff);
+    for (int i = 0; i < num; ++i) {
+      Dtype row_sum = 0;
+      for (int j = 0; j < num; ++j) {
+        row_sum += sym_diff[i * num + j];
+      }
+      caffe_axpy(dim, 2 * row_sum, x + i * dim, bottom_diff + i * dim);
+    }
+    break;
+  case PairwiseDistanceParameter_Metric_COSINE: {
+    const Dtype* x_hat = x_hat_.cpu_data();
+    Dtype* x_hat_diff = x_hat_.mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, num,
+        Dtype(-1), sym_diff, x_hat, Dtype(0), x_hat_diff);
+    // Through the normalization: (I - x_hat x_hat^T) / |x|.
+    const Dtype* norm = norm_.cpu_data();
+    for (int i = 0; i < num; ++i) {
+      const Dtype dot = caffe_cpu_dot(dim, x_hat + i * dim,
+          x_hat_diff + i * dim);
+      caffe_cpu_scale(dim, Dtype(1) / norm[i], x_hat_diff + i * dim,
+          bottom_diff + i * dim);
+      caffe_axpy(dim, -dot / norm[i], x_hat + i * dim, bottom_diff + i * dim);
+    }
+    break;
+  }
+  case PairwiseDistanceParameter_Metric_DOT:
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, num,
+        Dtype(-1), sym_diff, x, Dtype(0), bottom_diff);
+    break;
+  default:
+    LOG(FATAL) << "Unknown pairwise distance metric.";
+  }
+}
+
+INSTANTIATE_CLASS(PairwiseDistanceLayer);
+REGISTER_LAYER_CLASS(PairwiseDistance);
+
+}  // namespace caffe
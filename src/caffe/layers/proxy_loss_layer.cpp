@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/proxy_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The smallest norm divided by, for features or proxies of zeros.
+static const double kMinNorm = 1e-12;
+
+// Normalizes the num rows of dim values of data into data_hat, keeping their
+// norms in norm.
+template <typename Dtype>
+static void NormalizeRows(int num, int dim, const Dtype* data, Dtype* data_hat,
+    Dtype* norm) {
+  for (int i = 0; i < num; ++i) {
+    norm[i] = std::max(Dtype(kMinNorm),
+        std::sqrt(caffe_cpu_dot(dim, data + i * dim, data + i * dim)));
+    caffe_cpu_scale(dim, Dtype(1) / norm[i], data + i * dim,
+        data_hat + i * dim);
+  }
+}
+
+// Turns the gradient w.r.t. a normalized row into that w.r.t. the row, adding
+// it scaled by scale to diff.
+template <typename Dtype>
+static void NormalizeRowBackward(int dim, const Dtype* row_hat, Dtype norm,
+    const Dtype* row_hat_diff, Dtype scale, Dtype* diff) {
+  const Dtype dot = caffe_cpu_dot(dim, row_hat, row_hat_diff);
+  caffe_axpy(dim, scale / norm, row_hat_diff, diff);
+  caffe_axpy(dim, -scale * dot / norm, row_hat, diff);
+}
+
+template <typename Dtype>
+void ProxyLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  // The accuracy does not contribute to the loss.
+  for (int i = this->layer_param_.loss_weight_size(); i < top.size(); ++i) {
+    this->layer_param_.add_loss_weight(Dtype(0));
+  }
+  const ProxyLossParameter& param = this->layer_param_.proxy_loss_param();
+  N_ = param.num_output();
+  CHECK_GT(N_, 0) << "ProxyLossLayer num_output must be positive.";
+  K_ = bottom[0]->count(1);
+  anchor_ = param.method() == ProxyLossParameter_Method_ANCHOR;
+  alpha_ = param.alpha();
+  margin_ = param.margin();
+  batch_proxies_only_ = param.batch_proxies_only();
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(1);
+    vector<int> proxy_shape(2);
+    proxy_shape[0] = N_;
+    proxy_shape[1] = K_;
+    this->blobs_[0].reset(new Blob<Dtype>(proxy_shape));
+    // The proxies are drawn from a unit Gaussian unless a filler is given:
+    // the default constant filler would leave them without a direction.
+    FillerParameter filler_param = param.proxy_filler();
+    if (!param.has_proxy_filler()) {
+      filler_param.set_type("gaussian");
+    }
+    shared_ptr<Filler<Dtype> > proxy_filler(GetFiller<Dtype>(filler_param));
+    proxy_filler->Fill(this->blobs_[0].get());
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  class_used_.assign(N_, true);
+  used_rows_.clear();
+  row_used_.assign(batch_proxies_only_ ? N_ : 0, false);
+}
+
+template <typename Dtype>
+void ProxyLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  CHECK_EQ(K_, bottom[0]->count(1))
+      << "Input size incompatible with the proxies.";
+  CHECK_EQ(bottom[0]->num(), bottom[1]->count())
+      << "The number of labels must match the number of features.";
+  M_ = bottom[0]->num();
+  if (top.size() == 2) {
+    top[1]->Reshape(vector<int>());
+  }
+  x_hat_.Reshape(M_, K_, 1, 1);
+  x_norm_.Reshape(M_, 1, 1, 1);
+  p_hat_.Reshape(N_, K_, 1, 1);
+  p_norm_.Reshape(N_, 1, 1, 1);
+  sim_.Reshape(M_, N_, 1, 1);
+}
+
+template <typename Dtype>
+void ProxyLossLayer<Dtype>::ClearSparseParamRows() {
+  for (int i = 0; i < used_rows_.size(); ++i) {
+    row_used_[used_rows_[i]] = false;
+  }
+  used_rows_.clear();
+}
+
+template <typename Dtype>
+void ProxyLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* label = bottom[1]->cpu_data();
+  NormalizeRows(M_, K_, bottom[0]->cpu_data(), x_hat_.mutable_cpu_data(),
+      x_norm_.mutable_cpu_data());
+  NormalizeRows(N_, K_, this->blobs_[0]->cpu_data(),
+      p_hat_.mutable_cpu_data(), p_norm_.mutable_cpu_data());
+  vector<int> labels(M_);
+  for (int i = 0; i < M_; ++i) {
+    labels[i] = static_cast<int>(label[i]);
+    CHECK_GE(labels[i], 0);
+    CHECK_LT(labels[i], N_);
+  }
+  if (batch_proxies_only_) {
+    class_used_.assign(N_, false);
+    for (int i = 0; i < M_; ++i) {
+      class_used_[labels[i]] = true;
+    }
+  }
+  // The similarities of all features to all proxies.
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, Dtype(1),
+      x_hat_.cpu_data(), p_hat_.cpu_data(), Dtype(0),
+      sim_.mutable_cpu_data());
+  const Dtype* sim = sim_.cpu_data();
+  // The gradients w.r.t. the similarities are computed along with the loss.
+  Dtype* grad = sim_.mutable_cpu_diff();
+  caffe_set(sim_.count(), Dtype(0), grad);
+  Dtype loss = 0;
+  if (anchor_) {
+    int num_positive = 0;
+    int num_proxies = 0;
+    for (int c = 0; c < N_; ++c) {
+      if (!class_used_[c]) { continue; }
+      ++num_proxies;
+      bool has_positive = false;
+      for (int i = 0; i < M_; ++i) {
+        has_positive = has_positive || labels[i] == c;
+      }
+      num_positive += has_positive;
+    }
+    for (int c = 0; c < N_; ++c) {
+      if (!class_used_[c]) { continue; }
+      Dtype pos_sum = 0;
+      Dtype neg_sum = 0;
+      for (int i = 0; i < M_; ++i) {
+        const Dtype s = sim[i * N_ + c];
+        // The exponentials are kept in grad, then scaled.
+        if (labels[i] == c) {
+          grad[i * N_ + c] = std::exp(-alpha_ * (s - margin_));
+          pos_sum += grad[i * N_ + c];
+        } else {
+          grad[i * N_ + c] = std::exp(alpha_ * (s + margin_));
+          neg_sum += grad[i * N_ + c];
+        }
+      }
+      if (pos_sum > 0) {
+        loss += std::log(Dtype(1) + pos_sum) / num_positive;
+      }
+      loss += std::log(Dtype(1) + neg_sum) / num_proxies;
+      const Dtype pos_scale = -alpha_ / ((Dtype(1) + pos_sum) * num_positive);
+      const Dtype neg_scale = alpha_ / ((Dtype(1) + neg_sum) * num_proxies);
+      for (int i = 0; i < M_; ++i) {
+        grad[i * N_ + c] *= labels[i] == c ? pos_scale : neg_scale;
+      }
+    }
+  } else {
+    for (int i = 0; i < M_; ++i) {
+      const Dtype* row = sim + i * N_;
+      Dtype max_logit = -FLT_MAX;
+      for (int c = 0; c < N_; ++c) {
+        if (class_used_[c]) {
+          max_logit = std::max(max_logit, alpha_ * row[c]);
+        }
+      }
+      Dtype sum = 0;
+      for (int c = 0; c < N_; ++c) {
+        if (class_used_[c]) {
+          grad[i * N_ + c] = std::exp(alpha_ * row[c] - max_logit);
+          sum += grad[i * N_ + c];
+        }
+      }
+      loss += max_logit + std::log(sum) - alpha_ * row[labels[i]];
+      for (int c = 0; c < N_; ++c) {
+        grad[i * N_ + c] *= alpha_ / (sum * M_);
+      }
+      grad[i * N_ + labels[i]] -= alpha_ / M_;
+    }
+    loss /= M_;
+  }
+  top[0]->mutable_cpu_data()[0] = loss;
+  if (top.size() == 2) {
+    int correct = 0;
+    for (int i = 0; i < M_; ++i) {
+      const Dtype* row = sim + i * N_;
+      int best = -1;
+      for (int c = 0; c < N_; ++c) {
+        if (class_used_[c] && (best < 0 || row[c] > row[best])) {
+          best = c;
+        }
+      }
+      correct += best == labels[i];
+    }
+    top[1]->mutable_cpu_data()[0] = Dtype(correct) / M_;
+  }
+}
+
+template <typename Dtype>
+void ProxyLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  const Dtype scale = top[0]->cpu_diff()[0];
+  const Dtype* grad = sim_.cpu_diff();
+  if (propagate_down[0]) {
+    Dtype* x_hat_diff = x_hat_.mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, N_, Dtype(1),
+        grad, p_hat_.cpu_data(), Dtype(0), x_hat_diff);
+    const Dtype* x_hat = x_hat_.cpu_data();
+    const Dtype* x_norm = x_norm_.cpu_data();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+    for (int i = 0; i < M_; ++i) {
+      NormalizeRowBackward(K_, x_hat + i * K_, x_norm[i], x_hat_diff + i * K_,
+          scale, bottom_diff + i * K_);
+    }
+  }
+  if (this->param_propagate_down_[0]) {
+    Dtype* p_hat_diff = p_hat_.mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, N_, K_, M_, Dtype(1),
+        grad, x_hat_.cpu_data(), Dtype(0), p_hat_diff);
+    const Dtype* p_hat = p_hat_.cpu_data();
+    const Dtype* p_norm = p_norm_.cpu_data();
+    Dtype* proxy_diff = this->blobs_[0]->mutable_cpu_diff();
+    for (int c = 0; c < N_; ++c) {
+      if (!class_used_[c]) { continue; }
+      NormalizeRowBackward(K_, p_hat + c * K_, p_norm[c], p_hat_diff + c * K_,
+          scale, proxy_diff + c * K_);
+      if (batch_proxies_only_ && !row_used_[c]) {
+        row_used_[c] = true;
+        used_rows_.push_back(c);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(ProxyLossLayer);
+REGISTER_LAYER_CLASS(ProxyLoss);
+
+}  // namespace caffe
@@ -47,6 +47,22 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_EQ(N_, bottom[2]->shape(0));
   }
 
+  fused_ = this->layer_param_.recurrent_param().engine() ==
+      RecurrentParameter_Engine_FUSED;
+  if (fused_) {
+    CHECK_EQ(top.size() - num_hidden_exposed, output_names.size())
+        << "OutputBlobNames must provide an output blob name for each top.";
+    hidden_.resize(num_recur_blobs);
+    for (int i = 0; i < num_recur_blobs; ++i) {
+      hidden_[i].reset(new Blob<Dtype>());
+    }
+    this->blobs_.clear();
+    FusedSetUp(bottom, top);
+    this->param_propagate_down_.clear();
+    this->param_propagate_down_.resize(this->blobs_.size(), true);
+    return;
+  }
+
   // Create a NetParameter; setup the inputs that aren't unique to particular
   // recurrent architectures.
   NetParameter net_param;
@@ -190,6 +206,28 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
   CHECK_EQ(T_, bottom[1]->shape(0));
   CHECK_EQ(N_, bottom[1]->shape(1));
+  if (fused_) {
+    vector<BlobShape> hidden_shapes;
+    RecurrentInputShapes(&hidden_shapes);
+    CHECK_EQ(hidden_shapes.size(), hidden_.size());
+    for (int i = 0; i < hidden_shapes.size(); ++i) {
+      hidden_[i]->Reshape(hidden_shapes[i]);
+    }
+    if (expose_hidden_) {
+      const int bottom_offset = 2 + static_input_;
+      for (int i = bottom_offset, j = 0; i < bottom.size(); ++i, ++j) {
+        CHECK(hidden_[j]->shape() == bottom[i]->shape())
+            << "bottom[" << i << "] shape must match hidden state input shape: "
+            << hidden_[j]->shape_string();
+      }
+      const int top_offset = top.size() - hidden_.size();
+      for (int i = top_offset, j = 0; i < top.size(); ++i, ++j) {
+        top[i]->ReshapeLike(*hidden_[j]);
+      }
+    }
+    FusedReshape(bottom, top);
+    return;
+  }
   x_input_blob_->ReshapeLike(*bottom[0]);
   vector<int> cont_shape = bottom[1]->shape();
   cont_input_blob_->Reshape(cont_shape);
@@ -234,6 +272,12 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Reset() {
+  if (fused_) {
+    for (int i = 0; i < hidden_.size(); ++i) {
+      caffe_set(hidden_[i]->count(), Dtype(0), hidden_[i]->mutable_cpu_data());
+    }
+    return;
+  }
   // "Reset" the hidden state of the net by zeroing out all recurrent outputs.
   for (int i = 0; i < recur_output_blobs_.size(); ++i) {
     caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
@@ -244,6 +288,22 @@ void RecurrentLayer<Dtype>::Reset() {
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (fused_) {
+    // Start from the given hidden state, or from the end of the last batch.
+    vector<Blob<Dtype>*> hidden_in(hidden_.size());
+    for (int i = 0; i < hidden_.size(); ++i) {
+      hidden_in[i] = expose_hidden_ ?
+          bottom[2 + static_input_ + i] : hidden_[i].get();
+    }
+    FusedForward(bottom, top, hidden_in);
+    if (expose_hidden_) {
+      const int top_offset = top.size() - hidden_.size();
+      for (int i = top_offset, j = 0; i < top.size(); ++i, ++j) {
+        top[i]->ShareData(*hidden_[j]);
+      }
+    }
+    return;
+  }
   // Hacky fix for test time: reshare all the internal shared blobs, which may
   // currently point to a stale owner blob that was dropped when Solver::Test
   // called test_net->ShareTrainedLayersWith(net_.get()).
@@ -277,6 +337,10 @@ template <typename Dtype>
 void RecurrentLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
+  if (fused_) {
+    FusedBackward(top, propagate_down, bottom);
+    return;
+  }
 
   // TODO: skip backpropagation to inputs and parameters inside the unrolled
   // net according to propagate_down[0] and propagate_down[2]. For now just
@@ -286,6 +350,12 @@ void RecurrentLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   unrolled_net_->BackwardFrom(last_layer_index_);
 }
 
+template <typename Dtype>
+void RecurrentLayer<Dtype>::FusedSetUp(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  LOG(FATAL) << this->type() << " has no FUSED engine.";
+}
+
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(RecurrentLayer, Forward);
 #endif
@@ -0,0 +1,66 @@
+#include <vector>
+
+#include "caffe/layers/retrieval_accuracy_layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void RetrievalAccuracyLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  top_k_ = this->layer_param_.accuracy_param().top_k();
+  CHECK_GE(top_k_, 1) << "top_k must be positive.";
+}
+
+template <typename Dtype>
+void RetrievalAccuracyLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int num = bottom[0]->num();
+  CHECK_EQ(num, bottom[0]->count(1))
+      << "The distances must be an N x N matrix.";
+  CHECK_EQ(bottom[0]->count(), bottom[1]->count())
+      << "The same-label mask must match the distances.";
+  CHECK_EQ(bottom[0]->count(), bottom[2]->count())
+      << "The different-label mask must match the distances.";
+  vector<int> top_shape(0);  // Accuracy is a scalar; 0 axes.
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void RetrievalAccuracyLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const int num = bottom[0]->num();
+  const Dtype* dist = bottom[0]->cpu_data();
+  const Dtype* same = bottom[1]->cpu_data();
+  const Dtype* different = bottom[2]->cpu_data();
+  int queries = 0;
+  int hits = 0;
+  for (int i = 0; i < num; ++i) {
+    const Dtype* dist_i = dist + i * num;
+    const Dtype* same_i = same + i * num;
+    const Dtype* different_i = different + i * num;
+    // The nearest feature of the same label.
+    int nearest = -1;
+    for (int j = 0; j < num; ++j) {
+      if (same_i[j] && (nearest < 0 || dist_i[j] < dist_i[nearest])) {
+        nearest = j;
+      }
+    }
+    if (nearest < 0) { continue; }
+    ++queries;
+    // It is retrieved if fewer than top_k features of other labels are as
+    // near.
+    int num_nearer = 0;
+    for (int j = 0; j < num && num_nearer < top_k_; ++j) {
+      num_nearer += different_i[j] && dist_i[j] <= dist_i[nearest];
+    }
+    hits += num_nearer < top_k_;
+  }
+  top[0]->mutable_cpu_data()[0] =
+      queries > 0 ? static_cast<Dtype>(hits) / queries : Dtype(0);
+  // RetrievalAccuracy layer should not be used as a loss function.
+}
+
+INSTANTIATE_CLASS(RetrievalAccuracyLayer);
+REGISTER_LAYER_CLASS(RetrievalAccuracy);
+
+}  // namespace caffe
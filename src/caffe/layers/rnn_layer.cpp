@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -230,6 +231,220 @@ void RNNLayer<Dtype>::FillUnrolledNet(NetParameter* net_param) const {
   net_param->add_layer()->CopyFrom(output_concat_layer);
 }
 
+template <typename Dtype>
+void RNNLayer<Dtype>::FusedSetUp(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int num_output = this->layer_param_.recurrent_param().num_output();
+  CHECK_GT(num_output, 0) << "num_output must be positive";
+  shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
+      this->layer_param_.recurrent_param().weight_filler()));
+  shared_ptr<Filler<Dtype> > bias_filler(GetFiller<Dtype>(
+      this->layer_param_.recurrent_param().bias_filler()));
+  // The parameters of the unrolled net: W_xh, b_h, W_xh_static, W_hh, W_ho
+  // and b_o.
+  vector<int> weight_shape(2);
+  weight_shape[0] = num_output;
+  weight_shape[1] = bottom[0]->count(2);
+  vector<int> bias_shape(1, num_output);
+  this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+      weight_shape)));
+  weight_filler->Fill(this->blobs_.back().get());
+  this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+      bias_shape)));
+  bias_filler->Fill(this->blobs_.back().get());
+  if (this->static_input_) {
+    weight_shape[1] = bottom[2]->count(1);
+    this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+        weight_shape)));
+    weight_filler->Fill(this->blobs_.back().get());
+  }
+  weight_shape[1] = num_output;
+  for (int i = 0; i < 2; ++i) {
+    this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+        weight_shape)));
+    weight_filler->Fill(this->blobs_.back().get());
+  }
+  this->blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(
+      bias_shape)));
+  bias_filler->Fill(this->blobs_.back().get());
+}
+
+template <typename Dtype>
+void RNNLayer<Dtype>::FusedReshape(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int num_output = this->layer_param_.recurrent_param().num_output();
+  CHECK_EQ(this->blobs_[0]->shape(1), bottom[0]->count(2))
+      << "Input size incompatible with inner product parameters.";
+  vector<int> shape(3);
+  shape[0] = this->T_;
+  shape[1] = this->N_;
+  shape[2] = num_output;
+  top[0]->Reshape(shape);
+  h_.Reshape(shape);
+  h_conted_.Reshape(shape);
+  o_input_diff_.Reshape(shape);
+  shape[0] = 1;
+  static_h_.Reshape(shape);
+  h_next_diff_.Reshape(shape);
+  vector<int> multiplier_shape(1, this->T_ * this->N_);
+  bias_multiplier_.Reshape(multiplier_shape);
+  caffe_set(bias_multiplier_.count(), Dtype(1),
+      bias_multiplier_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void RNNLayer<Dtype>::FusedForward(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top, const vector<Blob<Dtype>*>& hidden_in) {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = top[0]->shape(2);
+  const int D = bottom[0]->count(2);
+  const int W_hh_index = 2 + this->static_input_;
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* W_hh = this->blobs_[W_hh_index]->cpu_data();
+  Dtype* h = h_.mutable_cpu_data();
+  Dtype* h_conted = h_conted_.mutable_cpu_data();
+
+  // The hidden inputs from x of all timesteps: W_xh * x + b_h (+ W_xh_static
+  // * x_static).
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T * N, H, D, (Dtype)1.,
+      bottom[0]->cpu_data(), this->blobs_[0]->cpu_data(), (Dtype)0., h);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, H, 1, (Dtype)1.,
+      bias_multiplier_.cpu_data(), this->blobs_[1]->cpu_data(), (Dtype)1., h);
+  if (this->static_input_) {
+    Dtype* static_h = static_h_.mutable_cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, H, bottom[2]->count(1),
+        (Dtype)1., bottom[2]->cpu_data(), this->blobs_[2]->cpu_data(),
+        (Dtype)0., static_h);
+    for (int t = 0; t < T; ++t) {
+      caffe_axpy<Dtype>(N * H, (Dtype)1., static_h, h + t * N * H);
+    }
+  }
+
+  const Dtype* h_prev = hidden_in[0]->cpu_data();
+  for (int t = 0; t < T; ++t) {
+    const Dtype* cont_t = cont + t * N;
+    Dtype* h_conted_t = h_conted + t * N * H;
+    for (int n = 0; n < N; ++n) {
+      caffe_cpu_scale(H, cont_t[n], h_prev + n * H, h_conted_t + n * H);
+    }
+    Dtype* h_t = h + t * N * H;
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, H, H, (Dtype)1.,
+        h_conted_t, W_hh, (Dtype)1., h_t);
+    for (int i = 0; i < N * H; ++i) {
+      h_t[i] = tanh(h_t[i]);
+    }
+    h_prev = h_t;
+  }
+  // hidden_in may be hidden_, which is only written now.
+  caffe_copy(N * H, h + (T - 1) * N * H, this->hidden_[0]->mutable_cpu_data());
+
+  // The outputs of all timesteps: tanh(W_ho * h + b_o).
+  Dtype* o = top[0]->mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T * N, H, H, (Dtype)1., h,
+      this->blobs_[W_hh_index + 1]->cpu_data(), (Dtype)0., o);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, H, 1, (Dtype)1.,
+      bias_multiplier_.cpu_data(), this->blobs_[W_hh_index + 2]->cpu_data(),
+      (Dtype)1., o);
+  for (int i = 0; i < T * N * H; ++i) {
+    o[i] = tanh(o[i]);
+  }
+}
+
+template <typename Dtype>
+void RNNLayer<Dtype>::FusedBackward(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  const int T = this->T_;
+  const int N = this->N_;
+  const int H = top[0]->shape(2);
+  const int D = bottom[0]->count(2);
+  const int W_hh_index = 2 + this->static_input_;
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* h = h_.cpu_data();
+  const Dtype* o = top[0]->cpu_data();
+  const Dtype* o_diff = top[0]->cpu_diff();
+
+  // Through the output tanh and GEMM of all timesteps.
+  Dtype* o_input_diff = o_input_diff_.mutable_cpu_data();
+  for (int i = 0; i < T * N * H; ++i) {
+    o_input_diff[i] = o_diff[i] * (1 - o[i] * o[i]);
+  }
+  if (this->param_propagate_down_[W_hh_index + 1]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, H, H, T * N, (Dtype)1.,
+        o_input_diff, h, (Dtype)1.,
+        this->blobs_[W_hh_index + 1]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[W_hh_index + 2]) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, T * N, H, (Dtype)1., o_input_diff,
+        bias_multiplier_.cpu_data(), (Dtype)1.,
+        this->blobs_[W_hh_index + 2]->mutable_cpu_diff());
+  }
+  Dtype* h_diff = h_.mutable_cpu_diff();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, H, H, (Dtype)1.,
+      o_input_diff, this->blobs_[W_hh_index + 1]->cpu_data(), (Dtype)0.,
+      h_diff);
+
+  // Back through the timesteps, turning h_diff into the diff of the inputs
+  // of the hidden tanh.
+  const Dtype* W_hh = this->blobs_[W_hh_index]->cpu_data();
+  Dtype* h_next_diff = h_next_diff_.mutable_cpu_data();
+  caffe_set(N * H, Dtype(0), h_next_diff);
+  for (int t = T - 1; t >= 0; --t) {
+    const Dtype* cont_t = cont + t * N;
+    const Dtype* h_t = h + t * N * H;
+    Dtype* h_diff_t = h_diff + t * N * H;
+    for (int i = 0; i < N * H; ++i) {
+      h_diff_t[i] = (h_diff_t[i] + h_next_diff[i]) * (1 - h_t[i] * h_t[i]);
+    }
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, H, H, (Dtype)1.,
+        h_diff_t, W_hh, (Dtype)0., h_next_diff);
+    for (int n = 0; n < N; ++n) {
+      caffe_scal(H, cont_t[n], h_next_diff + n * H);
+    }
+  }
+
+  // The gradients of all timesteps, each as one GEMM.
+  if (this->param_propagate_down_[0]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, H, D, T * N, (Dtype)1.,
+        h_diff, bottom[0]->cpu_data(), (Dtype)1.,
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[1]) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, T * N, H, (Dtype)1., h_diff,
+        bias_multiplier_.cpu_data(), (Dtype)1.,
+        this->blobs_[1]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[W_hh_index]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, H, H, T * N, (Dtype)1.,
+        h_diff, h_conted_.cpu_data(), (Dtype)1.,
+        this->blobs_[W_hh_index]->mutable_cpu_diff());
+  }
+  if (propagate_down[0]) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, D, H, (Dtype)1.,
+        h_diff, this->blobs_[0]->cpu_data(), (Dtype)0.,
+        bottom[0]->mutable_cpu_diff());
+  }
+  if (this->static_input_) {
+    // The static input contributes to every timestep.
+    Dtype* static_diff = static_h_.mutable_cpu_diff();
+    caffe_set(N * H, Dtype(0), static_diff);
+    for (int t = 0; t < T; ++t) {
+      caffe_axpy<Dtype>(N * H, (Dtype)1., h_diff + t * N * H, static_diff);
+    }
+    const int static_dim = bottom[2]->count(1);
+    if (this->param_propagate_down_[2]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, H, static_dim, N,
+          (Dtype)1., static_diff, bottom[2]->cpu_data(), (Dtype)1.,
+          this->blobs_[2]->mutable_cpu_diff());
+    }
+    if (propagate_down[2]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, static_dim, H,
+          (Dtype)1., static_diff, this->blobs_[2]->cpu_data(), (Dtype)0.,
+          bottom[2]->mutable_cpu_diff());
+    }
+  }
+}
+
 INSTANTIATE_CLASS(RNNLayer);
 REGISTER_LAYER_CLASS(RNN);
 
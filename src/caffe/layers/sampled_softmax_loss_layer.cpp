@@ -0,0 +1,424 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  const SampledSoftmaxParameter& param =
+      this->layer_param_.sampled_softmax_param();
+  N_ = param.num_output();
+  CHECK_GT(N_, 0) << "SampledSoftmaxLossLayer num_output must be positive.";
+  const int axis = bottom[0]->CanonicalAxisIndex(param.axis());
+  K_ = bottom[0]->count(axis);
+  num_sampled_ = param.num_sampled();
+  num_shards_ = param.num_shards();
+  CHECK_GT(num_shards_, 0) << "SampledSoftmaxLossLayer needs a shard.";
+  block_size_ = param.block_size();
+  CHECK_GT(block_size_, 0) << "SampledSoftmaxLossLayer block_size must be "
+      << "positive.";
+  bias_term_ = param.bias_term();
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(bias_term_ ? 2 : 1);
+    // The weight is laid out as that of an InnerProductLayer.
+    vector<int> weight_shape(2);
+    weight_shape[0] = N_;
+    weight_shape[1] = K_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    shared_ptr<Filler<Dtype> > weight_filler(GetFiller<Dtype>(
+        param.weight_filler()));
+    weight_filler->Fill(this->blobs_[0].get());
+    if (bias_term_) {
+      vector<int> bias_shape(1, N_);
+      this->blobs_[1].reset(new Blob<Dtype>(bias_shape));
+      shared_ptr<Filler<Dtype> > bias_filler(GetFiller<Dtype>(
+          param.bias_filler()));
+      bias_filler->Fill(this->blobs_[1].get());
+    }
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  has_ignore_label_ = this->layer_param_.loss_param().has_ignore_label();
+  if (has_ignore_label_) {
+    ignore_label_ = this->layer_param_.loss_param().ignore_label();
+  }
+  if (!this->layer_param_.loss_param().has_normalization() &&
+      this->layer_param_.loss_param().has_normalize()) {
+    normalization_ = this->layer_param_.loss_param().normalize() ?
+                     LossParameter_NormalizationMode_VALID :
+                     LossParameter_NormalizationMode_BATCH_SIZE;
+  } else {
+    normalization_ = this->layer_param_.loss_param().normalization();
+  }
+  class_index_.assign(num_sampled_ > 0 ? N_ : 0, -1);
+  used_rows_.clear();
+  row_used_.assign(num_sampled_ > 0 ? N_ : 0, false);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  const int axis = bottom[0]->CanonicalAxisIndex(
+      this->layer_param_.sampled_softmax_param().axis());
+  CHECK_EQ(K_, bottom[0]->count(axis))
+      << "Input size incompatible with the weight.";
+  M_ = bottom[0]->count(0, axis);
+  CHECK_EQ(M_, bottom[1]->count())
+      << "The number of labels must match the number of samples.";
+  target_.resize(M_);
+  vector<int> shape(1, M_);
+  logsumexp_.Reshape(shape);
+  target_logit_.Reshape(shape);
+  if (bias_term_) {
+    bias_multiplier_.Reshape(shape);
+    caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
+  }
+  shape.insert(shape.begin(), num_shards_);
+  shard_max_.Reshape(shape);
+  shard_sum_.Reshape(shape);
+  shape[0] = num_shards_ - 1;
+  shape.push_back(K_);
+  shard_bottom_diff_.Reshape(shape);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::ClearSparseParamRows() {
+  for (int i = 0; i < used_rows_.size(); ++i) {
+    row_used_[used_rows_[i]] = false;
+  }
+  used_rows_.clear();
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::SampleClasses(const Dtype* label) {
+  classes_.clear();
+  for (int i = 0; i < M_; ++i) {
+    const int label_value = static_cast<int>(label[i]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      continue;
+    }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, N_);
+    if (class_index_[label_value] < 0) {
+      class_index_[label_value] = classes_.size();
+      classes_.push_back(label_value);
+    }
+  }
+  num_labels_ = classes_.size();
+  // Draw among the other classes, uniformly and without replacement.
+  const int num_drawn = std::min(num_sampled_, N_ - num_labels_);
+  if (num_drawn == N_ - num_labels_) {
+    for (int c = 0; c < N_; ++c) {
+      if (class_index_[c] < 0) {
+        class_index_[c] = classes_.size();
+        classes_.push_back(c);
+      }
+    }
+  } else {
+    while (classes_.size() < num_labels_ + num_drawn) {
+      const int c = caffe_rng_rand() % N_;
+      if (class_index_[c] < 0) {
+        class_index_[c] = classes_.size();
+        classes_.push_back(c);
+      }
+    }
+  }
+  num_classes_ = classes_.size();
+  // Each drawn class stands for (N_ - num_labels_) / num_drawn classes.
+  sampled_log_weight_ = num_drawn > 0 ?
+      std::log(Dtype(N_ - num_labels_) / num_drawn) : Dtype(0);
+  vector<int> weight_shape(2);
+  weight_shape[0] = num_classes_;
+  weight_shape[1] = K_;
+  sampled_weight_.Reshape(weight_shape);
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* sampled_weight = sampled_weight_.mutable_cpu_data();
+  for (int j = 0; j < num_classes_; ++j) {
+    caffe_copy(K_, weight + static_cast<size_t>(classes_[j]) * K_,
+        sampled_weight + j * K_);
+  }
+  if (bias_term_) {
+    sampled_bias_.Reshape(vector<int>(1, num_classes_));
+    const Dtype* bias = this->blobs_[1]->cpu_data();
+    Dtype* sampled_bias = sampled_bias_.mutable_cpu_data();
+    for (int j = 0; j < num_classes_; ++j) {
+      sampled_bias[j] = bias[classes_[j]];
+    }
+  }
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::RunShards(
+    const boost::function<void(int)>& fn) {
+  if (!shard_pool_) {
+    shard_pool_ = ThreadPool::Shared();
+  }
+  shard_pool_->Run(shard_begin_.size() - 1, fn);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::ComputeLogits(int begin, int cols,
+    Dtype* logits) {
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, cols, K_, Dtype(1),
+      bottom_data_, weight_ + static_cast<size_t>(begin) * K_, Dtype(0),
+      logits);
+  // The drawn classes among them, if sampling.
+  const int drawn_begin = sampling_ ?
+      std::max(0, std::min(cols, num_labels_ - begin)) : cols;
+  for (int i = 0; i < M_; ++i) {
+    Dtype* row = logits + i * cols;
+    if (bias_term_) {
+      caffe_axpy(cols, Dtype(1), bias_ + begin, row);
+    }
+    for (int j = drawn_begin; j < cols; ++j) {
+      row[j] += sampled_log_weight_;
+    }
+  }
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::ForwardShard(int shard) {
+  const int end = shard_begin_[shard + 1];
+  Dtype* logits = logits_data_ + shard * M_ * block_cols_;
+  Dtype* shard_max = shard_max_data_ + shard * M_;
+  Dtype* shard_sum = shard_sum_data_ + shard * M_;
+  caffe_set(M_, Dtype(-FLT_MAX), shard_max);
+  caffe_set(M_, Dtype(0), shard_sum);
+  for (int begin = shard_begin_[shard]; begin < end; begin += block_cols_) {
+    const int cols = std::min(block_cols_, end - begin);
+    ComputeLogits(begin, cols, logits);
+    // Merge the logsumexp of the block into that of the shard.
+    for (int i = 0; i < M_; ++i) {
+      const Dtype* row = logits + i * cols;
+      Dtype max_logit = shard_max[i];
+      for (int j = 0; j < cols; ++j) {
+        max_logit = std::max(max_logit, row[j]);
+      }
+      Dtype sum = shard_sum[i] * std::exp(shard_max[i] - max_logit);
+      for (int j = 0; j < cols; ++j) {
+        sum += std::exp(row[j] - max_logit);
+      }
+      shard_max[i] = max_logit;
+      shard_sum[i] = sum;
+      if (target_[i] >= begin && target_[i] < begin + cols) {
+        target_logit_data_[i] = row[target_[i] - begin];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::BackwardShard(int shard) {
+  const int end = shard_begin_[shard + 1];
+  // A shard of a single block still has its logits from the forward pass.
+  const bool recompute = end - shard_begin_[shard] > block_cols_;
+  Dtype* logits = logits_data_ + shard * M_ * block_cols_;
+  Dtype* bottom_diff = NULL;
+  if (bottom_diff_) {
+    bottom_diff = shard == 0 ? bottom_diff_ :
+        shard_bottom_diff_data_ + (shard - 1) * M_ * K_;
+  }
+  for (int begin = shard_begin_[shard]; begin < end; begin += block_cols_) {
+    const int cols = std::min(block_cols_, end - begin);
+    if (recompute) {
+      ComputeLogits(begin, cols, logits);
+    }
+    for (int i = 0; i < M_; ++i) {
+      Dtype* row = logits + i * cols;
+      if (target_[i] < 0) {
+        caffe_set(cols, Dtype(0), row);
+        continue;
+      }
+      for (int j = 0; j < cols; ++j) {
+        row[j] = loss_scale_ * std::exp(row[j] - logsumexp_data_[i]);
+      }
+      if (target_[i] >= begin && target_[i] < begin + cols) {
+        row[target_[i] - begin] -= loss_scale_;
+      }
+    }
+    if (weight_diff_) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, cols, K_, M_, Dtype(1),
+          logits, bottom_data_, Dtype(1),
+          weight_diff_ + static_cast<size_t>(begin) * K_);
+    }
+    if (bias_diff_) {
+      caffe_cpu_gemv<Dtype>(CblasTrans, M_, cols, Dtype(1), logits,
+          bias_multiplier_.cpu_data(), Dtype(1), bias_diff_ + begin);
+    }
+    if (bottom_diff) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, cols,
+          Dtype(1), logits, weight_ + static_cast<size_t>(begin) * K_,
+          Dtype(begin > shard_begin_[shard]), bottom_diff);
+    }
+  }
+}
+
+template <typename Dtype>
+Dtype SampledSoftmaxLossLayer<Dtype>::get_normalizer(int valid_count) const {
+  Dtype normalizer;
+  switch (normalization_) {
+    case LossParameter_NormalizationMode_FULL:
+    case LossParameter_NormalizationMode_BATCH_SIZE:
+      normalizer = Dtype(M_);
+      break;
+    case LossParameter_NormalizationMode_VALID:
+      normalizer = Dtype(valid_count);
+      break;
+    case LossParameter_NormalizationMode_NONE:
+      normalizer = Dtype(1);
+      break;
+    default:
+      LOG(FATAL) << "Unknown normalization mode: "
+          << LossParameter_NormalizationMode_Name(normalization_);
+  }
+  return std::max(Dtype(1.0), normalizer);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* label = bottom[1]->cpu_data();
+  sampling_ = num_sampled_ > 0 && this->phase_ == TRAIN;
+  if (sampling_) {
+    SampleClasses(label);
+    weight_ = sampled_weight_.cpu_data();
+    bias_ = bias_term_ ? sampled_bias_.cpu_data() : NULL;
+  } else {
+    num_classes_ = N_;
+    num_labels_ = N_;
+    weight_ = this->blobs_[0]->cpu_data();
+    bias_ = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  }
+  valid_count_ = 0;
+  for (int i = 0; i < M_; ++i) {
+    const int label_value = static_cast<int>(label[i]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      target_[i] = -1;
+      continue;
+    }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, N_);
+    target_[i] = sampling_ ? class_index_[label_value] : label_value;
+    ++valid_count_;
+  }
+  if (sampling_) {
+    for (int j = 0; j < num_classes_; ++j) {
+      class_index_[classes_[j]] = -1;
+    }
+  }
+  const int num_shards = std::min(num_shards_, num_classes_);
+  shard_begin_.resize(num_shards + 1);
+  for (int shard = 0; shard <= num_shards; ++shard) {
+    shard_begin_[shard] = static_cast<int64_t>(num_classes_) * shard /
+        num_shards;
+  }
+  // The largest shard has (num_classes_ + num_shards - 1) / num_shards.
+  block_cols_ = std::min(std::max(1, block_size_ / std::max(M_, 1)),
+      (num_classes_ + num_shards - 1) / num_shards);
+  vector<int> logits_shape(2);
+  logits_shape[0] = num_shards;
+  logits_shape[1] = M_ * block_cols_;
+  logits_.Reshape(logits_shape);
+  bottom_data_ = bottom[0]->cpu_data();
+  logits_data_ = logits_.mutable_cpu_data();
+  target_logit_data_ = target_logit_.mutable_cpu_data();
+  shard_max_data_ = shard_max_.mutable_cpu_data();
+  shard_sum_data_ = shard_sum_.mutable_cpu_data();
+  RunShards(boost::bind(&SampledSoftmaxLossLayer<Dtype>::ForwardShard, this,
+      _1));
+  // Combine the partial logsumexp of the shards.
+  Dtype* logsumexp = logsumexp_.mutable_cpu_data();
+  Dtype loss = 0;
+  for (int i = 0; i < M_; ++i) {
+    Dtype max_logit = -FLT_MAX;
+    for (int shard = 0; shard < num_shards; ++shard) {
+      max_logit = std::max(max_logit, shard_max_data_[shard * M_ + i]);
+    }
+    Dtype sum = 0;
+    for (int shard = 0; shard < num_shards; ++shard) {
+      sum += shard_sum_data_[shard * M_ + i] *
+          std::exp(shard_max_data_[shard * M_ + i] - max_logit);
+    }
+    logsumexp[i] = max_logit + std::log(sum);
+    if (target_[i] < 0) {
+      continue;
+    }
+    loss += logsumexp[i] - target_logit_data_[i];
+  }
+  top[0]->mutable_cpu_data()[0] = loss / get_normalizer(valid_count_);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  loss_scale_ = top[0]->cpu_diff()[0] / get_normalizer(valid_count_);
+  const bool weight_down = this->param_propagate_down_[0];
+  const bool bias_down = bias_term_ && this->param_propagate_down_[1];
+  // When sampling, the gradients of the classes of the batch are computed
+  // apart and added to the rows of the params.
+  if (sampling_) {
+    weight_diff_ = weight_down ? sampled_weight_.mutable_cpu_diff() : NULL;
+    bias_diff_ = bias_down ? sampled_bias_.mutable_cpu_diff() : NULL;
+    if (weight_diff_) {
+      caffe_set(sampled_weight_.count(), Dtype(0), weight_diff_);
+    }
+    if (bias_diff_) {
+      caffe_set(sampled_bias_.count(), Dtype(0), bias_diff_);
+    }
+  } else {
+    weight_diff_ = weight_down ? this->blobs_[0]->mutable_cpu_diff() : NULL;
+    bias_diff_ = bias_down ? this->blobs_[1]->mutable_cpu_diff() : NULL;
+  }
+  bottom_diff_ = propagate_down[0] ? bottom[0]->mutable_cpu_diff() : NULL;
+  shard_bottom_diff_data_ = propagate_down[0] && shard_begin_.size() > 2 ?
+      shard_bottom_diff_.mutable_cpu_data() : NULL;
+  logsumexp_data_ = logsumexp_.cpu_data();
+  RunShards(boost::bind(&SampledSoftmaxLossLayer<Dtype>::BackwardShard, this,
+      _1));
+  if (bottom_diff_) {
+    for (int shard = 1; shard < shard_begin_.size() - 1; ++shard) {
+      caffe_axpy(M_ * K_, Dtype(1),
+          shard_bottom_diff_data_ + (shard - 1) * M_ * K_, bottom_diff_);
+    }
+  }
+  if (sampling_ && (weight_down || bias_down)) {
+    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    Dtype* bias_diff = bias_term_ ? this->blobs_[1]->mutable_cpu_diff() : NULL;
+    for (int j = 0; j < num_classes_; ++j) {
+      const int c = classes_[j];
+      if (weight_down) {
+        caffe_axpy(K_, Dtype(1), weight_diff_ + j * K_,
+            weight_diff + static_cast<size_t>(c) * K_);
+      }
+      if (bias_down) {
+        bias_diff[c] += bias_diff_[j];
+      }
+      if (!row_used_[c]) {
+        row_used_[c] = true;
+        used_rows_.push_back(c);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(SampledSoftmaxLossLayer);
+REGISTER_LAYER_CLASS(SampledSoftmaxLoss);
+
+}  // namespace caffe
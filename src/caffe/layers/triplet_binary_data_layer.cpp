@@ -74,8 +74,8 @@ void TripletBinaryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& b
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   CHECK_GT(batch_size, 0) << "Positive batch size required";
   this->top_shape_[0] = batch_size * 3;
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(this->top_shape_);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(this->top_shape_);
   }
   top[0]->Reshape(this->top_shape_);
 
@@ -138,6 +138,7 @@ void TripletBinaryDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  this->AddStageTimes(read_time / 1000, 0, 0);
 }
 
 INSTANTIATE_CLASS(TripletBinaryDataLayer);
@@ -12,9 +12,11 @@
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/flat_weights.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/net_profiler.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -23,13 +25,13 @@ namespace caffe {
 
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+    : profiling_(false), root_net_(root_net) {
   Init(param);
 }
 
 template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase, const Net* root_net)
-    : root_net_(root_net) {
+    : profiling_(false), root_net_(root_net) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   param.mutable_state()->set_phase(phase);
@@ -538,7 +540,9 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    if (profiling_) { profiler_->Start(); }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (profiling_) { profiler_->Stop(i, false); }
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
@@ -583,13 +587,23 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
+      if (profiling_) { profiler_->Start(); }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (profiling_) { profiler_->Stop(i, true); }
       if (debug_info_) { BackwardDebugInfo(i); }
     }
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::set_profiling(const bool value) {
+  if (value && !profiler_) {
+    profiler_.reset(new NetProfiler<Dtype>(*this));
+  }
+  profiling_ = value;
+}
+
 template <typename Dtype>
 void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
   for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -701,6 +715,33 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const Net* other) {
+  int num_source_layers = other->layers().size();
+  for (int i = 0; i < num_source_layers; ++i) {
+    Layer<Dtype>* source_layer = other->layers()[i].get();
+    const string& source_layer_name = other->layer_names()[i];
+    if (!has_layer(source_layer_name)) {
+      DLOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layer_by_name(source_layer_name)->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const Blob<Dtype>& source_blob = *source_layer->blobs()[j];
+      CHECK(target_blobs[j]->shape() == source_blob.shape())
+          << "Cannot copy param " << j << " weights from layer '"
+          << source_layer_name << "'; shape mismatch.  Source param shape is "
+          << source_blob.shape_string() << "; target param shape is "
+          << target_blobs[j]->shape_string();
+      target_blobs[j]->CopyFrom(source_blob);
+    }
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::BackwardFrom(int start) {
   BackwardFromTo(start, 0);
@@ -780,6 +821,8 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (IsFlatWeightsFilename(trained_filename)) {
+    CopyTrainedLayersFromFlat(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -843,6 +886,56 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromFlat(const string trained_filename,
+    bool alias) {
+  shared_ptr<FlatWeights> weights(new FlatWeights(trained_filename));
+  const FlatWeightsIndex& index = weights->index();
+  const FlatWeightsIndex::Type type = sizeof(Dtype) == sizeof(double) ?
+      FlatWeightsIndex::DOUBLE : FlatWeightsIndex::FLOAT;
+  if (alias && index.type() != type) {
+    LOG(WARNING) << "Copying the weights of " << trained_filename
+        << " instead of aliasing them; they are stored as another type.";
+    alias = false;
+  }
+  for (int i = 0; i < index.layer_size(); ++i) {
+    const FlatWeightsIndex::Layer& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!has_layer(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layer_by_name(source_layer_name)->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.param_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const FlatWeightsIndex::Param& param = source_layer.param(j);
+      const vector<int> source_shape(param.shape().dim().begin(),
+          param.shape().dim().end());
+      if (target_blobs[j]->shape() != source_shape) {
+        Blob<Dtype> source_blob(source_shape);
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << source_blob.shape_string() << "; target param shape is "
+            << target_blobs[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      if (alias) {
+        target_blobs[j]->data()->set_cpu_data(
+            const_cast<void*>(weights->data(param)));
+      } else {
+        weights->CopyTo(param, target_blobs[j]->mutable_cpu_data());
+      }
+    }
+  }
+  if (alias) {
+    mapped_weights_.push_back(weights);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -921,12 +1014,22 @@ void Net<Dtype>::Update() {
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  vector<int> rows;
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
     case Caffe::CPU:
-      caffe_set(blob->count(), static_cast<Dtype>(0),
-                blob->mutable_cpu_diff());
+      if (SparseParamRows(i, &rows)) {
+        const int row_size = blob->count(1);
+        Dtype* diff = blob->mutable_cpu_diff();
+        for (int j = 0; j < rows.size(); ++j) {
+          caffe_set(row_size, static_cast<Dtype>(0),
+                    diff + static_cast<size_t>(rows[j]) * row_size);
+        }
+      } else {
+        caffe_set(blob->count(), static_cast<Dtype>(0),
+                  blob->mutable_cpu_diff());
+      }
       break;
     case Caffe::GPU:
 #ifndef CPU_ONLY
@@ -938,6 +1041,29 @@ void Net<Dtype>::ClearParamDiffs() {
       break;
     }
   }
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->ClearSparseParamRows();
+  }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::SparseParamRows(int param_id, vector<int>* rows) const {
+  if (Caffe::mode() != Caffe::CPU || Caffe::solver_count() > 1) {
+    return false;
+  }
+  rows->clear();
+  bool sparse = false;
+  for (int i = 0; i < params_.size(); ++i) {
+    if (learnable_param_ids_[i] != param_id) { continue; }
+    const vector<int>* layer_rows = layers_[param_layer_indices_[i].first]->
+        sparse_param_rows(param_layer_indices_[i].second);
+    if (!layer_rows) { return false; }
+    rows->insert(rows->end(), layer_rows->begin(), layer_rows->end());
+    sparse = true;
+  }
+  std::sort(rows->begin(), rows->end());
+  rows->erase(std::unique(rows->begin(), rows->end()), rows->end());
+  return sparse;
 }
 
 template <typename Dtype>
@@ -0,0 +1,74 @@
+#include <string>
+#include <vector>
+
+#include "caffe/net_pool.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+NetPool<Dtype>::NetPool(const NetParameter& param,
+    const string& trained_filename, int size) {
+  Init(param, trained_filename, size);
+}
+
+template <typename Dtype>
+NetPool<Dtype>::NetPool(const string& param_file, Phase phase,
+    const string& trained_filename, int size) {
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  param.mutable_state()->set_phase(phase);
+  Init(param, trained_filename, size);
+}
+
+template <typename Dtype>
+void NetPool<Dtype>::Init(const NetParameter& param,
+    const string& trained_filename, int size) {
+  CHECK_GT(size, 0) << "A pool needs at least one net";
+  nets_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+  if (!trained_filename.empty()) {
+    nets_[0]->CopyTrainedLayersFrom(trained_filename);
+  }
+  // Synchronize the params up front, so that the threads only read them.
+  const vector<shared_ptr<Blob<Dtype> > >& params = nets_[0]->params();
+  for (int i = 0; i < params.size(); ++i) {
+    switch (Caffe::mode()) {
+    case Caffe::CPU:
+      params[i]->cpu_data();
+      break;
+    case Caffe::GPU:
+      params[i]->gpu_data();
+      break;
+    }
+  }
+  for (int i = 1; i < size; ++i) {
+    nets_.push_back(shared_ptr<Net<Dtype> >(new Net<Dtype>(param)));
+    nets_[i]->ShareTrainedLayersWith(nets_[0].get());
+  }
+  for (int i = 0; i < size; ++i) {
+    free_.push(nets_[i].get());
+  }
+  LOG(INFO) << "Created a pool of " << size << " nets sharing the weights of "
+      << nets_[0]->name();
+}
+
+template <typename Dtype>
+Net<Dtype>* NetPool<Dtype>::Acquire() {
+  return free_.pop();
+}
+
+template <typename Dtype>
+Net<Dtype>* NetPool<Dtype>::TryAcquire() {
+  Net<Dtype>* net = NULL;
+  free_.try_pop(&net);
+  return net;
+}
+
+template <typename Dtype>
+void NetPool<Dtype>::Release(Net<Dtype>* net) {
+  free_.push(net);
+}
+
+INSTANTIATE_CLASS(NetPool);
+
+}  // namespace caffe
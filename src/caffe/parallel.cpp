@@ -9,8 +9,11 @@
 #include <vector>
 
 #include "boost/thread.hpp"
+#include "boost/thread/barrier.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/util/cpu_topology.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 
 namespace caffe {
 
@@ -114,6 +117,42 @@ void GPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
   apply_buffers(net, diff_, size_, replace_gpu_diff);
 }
 
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver,
+                            const CPUParams<Dtype>* shared)
+    : Params<Dtype>(root_solver),
+      owns_data_(shared == NULL) {
+  if (shared) {
+    CHECK_EQ(shared->size(), size_);
+    data_ = shared->data();
+  } else {
+    data_ = static_cast<Dtype*>(
+        HostMemoryPool::Allocate(size_ * sizeof(Dtype)));
+    // Copy blob values
+    const vector<Blob<Dtype>*>& net =
+        root_solver->net()->learnable_params();
+    apply_buffers(net, data_, size_, copy);
+  }
+  diff_ = static_cast<Dtype*>(HostMemoryPool::Allocate(size_ * sizeof(Dtype)));
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  if (owns_data_) {
+    HostMemoryPool::Free(data_, size_ * sizeof(Dtype));
+  }
+  HostMemoryPool::Free(diff_, size_ * sizeof(Dtype));
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+      solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+}
+
 void DevicePair::compute(const vector<int> devices, vector<DevicePair>* pairs) {
 #ifndef CPU_ONLY
   vector<int> remaining(devices);
@@ -436,8 +475,131 @@ void P2PSync<Dtype>::Run(const vector<int>& gpus) {
   }
 }
 
+//
+
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > root_solver)
+    : CPUParams<Dtype>(root_solver, NULL),
+      root_(NULL),
+      rank_(0),
+      numa_node_(Caffe::numa_node()),
+      syncs_(),
+      barrier_(),
+      initial_iter_(root_solver->iter()),
+      solver_(root_solver) {
+  this->configure(solver_.get());
+  solver_->add_callback(this);
+}
+
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                        CPUSync<Dtype>* root, int rank, int numa_node)
+    : CPUParams<Dtype>(root_solver, root),
+      root_(root),
+      rank_(rank),
+      numa_node_(numa_node),
+      syncs_(),
+      barrier_(),
+      initial_iter_(root_solver->iter()),
+      solver_() {
+  Caffe::set_root_solver(false);
+  solver_.reset(new WorkerSolver<Dtype>(root_solver->param(),
+                                        root_solver.get()));
+  Caffe::set_root_solver(true);
+  this->configure(solver_.get());
+  solver_->add_callback(this);
+}
+
+template<typename Dtype>
+CPUSync<Dtype>::~CPUSync() {
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::InternalThreadEntry() {
+  CHECK(Caffe::root_solver());
+  Caffe::set_root_solver(false);
+  Caffe::set_numa_node(numa_node_);
+  // See if there is a defined seed and reset random state if so, modulated
+  // by rank so that workers do not all draw the same numbers.
+  if (solver_->param().random_seed() >= 0) {
+    Caffe::set_random_seed(solver_->param().random_seed() + rank_);
+  }
+  solver_->Step(solver_->param().max_iter() - initial_iter_);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_start() {
+  // Wait for the root to have updated the shared weights.
+  CPUSync<Dtype>* root = root_ ? root_ : this;
+  root->barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_gradients_ready() {
+  CPUSync<Dtype>* root = root_ ? root_ : this;
+  const vector<CPUSync<Dtype>*>& syncs = root->syncs_;
+
+  // Wait for all gradients, then sum this worker's slice of them into the
+  // root's buffer. The slices are disjoint, so no locking is needed.
+  root->barrier_->wait();
+  const size_t begin = size_ * rank_ / syncs.size();
+  const size_t end = size_ * (rank_ + 1) / syncs.size();
+  Dtype* dst = root->diff_ + begin;
+  for (int i = 1; i < syncs.size(); ++i) {
+    caffe_axpy<Dtype>(end - begin, Dtype(1), syncs[i]->diff_ + begin, dst);
+  }
+  // Loss functions divide gradients by the batch size, so to compensate
+  // for split batch, the gradients are divided by number of solvers.
+  caffe_scal<Dtype>(end - begin, Dtype(1.0 / Caffe::solver_count()), dst);
+  // The root may only apply the update once all slices are reduced.
+  root->barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Prepare(int workers,
+            vector<shared_ptr<CPUSync<Dtype> > >* syncs) {
+  CHECK(root_ == NULL) << "Workers are prepared by the root.";
+  CHECK_GT(workers, 0);
+  syncs->resize(workers);
+  syncs_.assign(1, this);
+  const int nodes = CPUTopology::Get().num_nodes();
+  LOG_IF(INFO, numa_node_ >= 0) << "CPU worker 0 on NUMA node " << numa_node_;
+  for (int i = 1; i < workers; ++i) {
+    // The worker's net and buffers are first touched on its own node.
+    const int node = numa_node_ >= 0 ? (numa_node_ + i) % nodes : -1;
+    Caffe::set_numa_node(node);
+    syncs->at(i).reset(new CPUSync<Dtype>(solver_, this, i, node));
+    syncs_.push_back(syncs->at(i).get());
+    LOG_IF(INFO, node >= 0) << "CPU worker " << i << " on NUMA node " << node;
+  }
+  Caffe::set_numa_node(numa_node_);
+  barrier_.reset(new boost::barrier(workers));
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Run(int workers) {
+  CHECK_EQ(Caffe::solver_count(), workers);
+  vector<shared_ptr<CPUSync<Dtype> > > syncs(workers);
+  Prepare(workers, &syncs);
+
+  LOG(INFO)<< "Starting Optimization on " << workers << " CPU workers";
+
+  for (int i = 1; i < syncs.size(); ++i) {
+    syncs[i]->StartInternalThread();
+  }
+
+  // Run root solver on current thread
+  solver_->Solve();
+
+  for (int i = 1; i < syncs.size(); ++i) {
+    syncs[i]->StopInternalThread();
+  }
+}
+
 INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
+INSTANTIATE_CLASS(CPUParams);
 INSTANTIATE_CLASS(P2PSync);
+INSTANTIATE_CLASS(CPUSync);
 
 }  // namespace caffe
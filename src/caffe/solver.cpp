@@ -1,12 +1,19 @@
+#include <boost/thread.hpp>
 #include <cstdio>
 
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "caffe/internal_thread.hpp"
+#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/net_profiler.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -50,6 +57,10 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
   CheckSnapshotWritePermissions();
+  LOG_IF(WARNING, param_.snapshot_async() && param_.snapshot_format() ==
+      SolverParameter_SnapshotFormat_HDF5 && Caffe::root_solver())
+      << "snapshot_async only applies to BINARYPROTO snapshots; HDF5 "
+      << "snapshots are written synchronously.";
   if (Caffe::root_solver() && param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed());
   }
@@ -216,6 +227,7 @@ void Solver<Dtype>::Step(int iters) {
     }
     const bool display = param_.display() && iter_ % param_.display() == 0;
     net_->set_debug_info(display && param_.debug_info());
+    net_->set_profiling(param_.profile_interval() > 0);
     // accumulate the loss and gradient
     Dtype loss = 0;
     for (int i = 0; i < param_.iter_size(); ++i) {
@@ -256,6 +268,15 @@ void Solver<Dtype>::Step(int iters) {
     // the number of times the weights have been updated.
     ++iter_;
 
+    if (param_.profile_interval() > 0
+        && iter_ % param_.profile_interval() == 0 && Caffe::root_solver()) {
+      ReportProfile();
+    }
+    if (param_.data_stats_interval() > 0
+        && iter_ % param_.data_stats_interval() == 0 && Caffe::root_solver()) {
+      ReportDataStats();
+    }
+
     SolverAction::Enum request = GetRequestedAction();
 
     // Save a snapshot if needed.
@@ -273,6 +294,38 @@ void Solver<Dtype>::Step(int iters) {
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::ReportProfile() {
+  NetProfiler<Dtype>& profiler = *net_->profiler();
+  LOG(INFO) << "Profile of iterations " << iter_ - param_.profile_interval()
+      << " to " << iter_ << ":";
+  std::istringstream table(profiler.Summary());
+  string line;
+  while (std::getline(table, line)) {
+    LOG(INFO) << "    " << line;
+  }
+  if (param_.has_profile_trace()) {
+    const string filename = param_.profile_trace() + "_iter_"
+        + caffe::format_int(iter_) + ".json";
+    profiler.WriteChromeTrace(filename);
+    LOG(INFO) << "Wrote profile trace to " << filename;
+  }
+  profiler.Reset();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::ReportDataStats() {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    BasePrefetchingDataLayer<Dtype>* data_layer =
+        dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[i].get());
+    if (data_layer) {
+      data_layer->LogPrefetchStats();
+      data_layer->ResetPrefetchStats();
+    }
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Solve(const char* resume_file) {
   CHECK(Caffe::root_solver());
@@ -297,6 +350,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  FlushSnapshots();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -319,6 +373,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
   }
+  WaitForTests();
   LOG(INFO) << "Optimization Done.";
 }
 
@@ -327,7 +382,11 @@ void Solver<Dtype>::TestAll() {
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
-    Test(test_net_id);
+    if (param_.test_async()) {
+      TestAsync(test_net_id);
+    } else {
+      Test(test_net_id);
+    }
   }
 }
 
@@ -340,36 +399,133 @@ void Solver<Dtype>::Test(const int test_net_id) {
       ShareTrainedLayersWith(net_.get());
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
-  const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
-  for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
-    // Check to see if stoppage of testing/training has been requested.
-    while (request != SolverAction::NONE) {
-        if (SolverAction::SNAPSHOT == request) {
-          Snapshot();
-        } else if (SolverAction::STOP == request) {
-          requested_early_exit_ = true;
-        }
-        request = GetRequestedAction();
+  if (!TestForward(test_net_id, true, &test_score, &test_score_output_id,
+      &loss)) {
+    LOG(INFO)     << "Test interrupted.";
+    return;
+  }
+  DisplayTestScores(test_net_id, test_score, test_score_output_id, loss, "");
+}
+
+// Tests one test net on its own thread. The solver thread hands it the
+// iteration to test once it has copied the weights into the test net.
+template <typename Dtype>
+class Solver<Dtype>::TestThread : public InternalThread {
+ public:
+  TestThread(Solver* solver, int test_net_id)
+      : solver_(solver), test_net_id_(test_net_id), pending_(false) {}
+  virtual ~TestThread() { StopInternalThread(); }
+
+  void Submit(int iter) {
+    CHECK(!pending_);
+    pending_ = true;
+    requests_.push(iter);
+  }
+  void Wait() {
+    if (pending_) {
+      ostringstream msg;
+      msg << "Waiting for test net #" << test_net_id_;
+      done_.pop(msg.str());
+      pending_ = false;
     }
-    if (requested_early_exit_) {
-      // break out of test loop.
-      break;
+  }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      while (!must_stop()) {
+        const int iter = requests_.pop();
+        vector<Dtype> test_score;
+        vector<int> test_score_output_id;
+        Dtype loss = 0;
+        solver_->TestForward(test_net_id_, false, &test_score,
+            &test_score_output_id, &loss);
+        // The training goes on meanwhile and its lines come in between, so
+        // each line says which test it belongs to.
+        LOG(INFO) << "Iteration " << iter
+                  << ", Testing net (#" << test_net_id_ << ") done in "
+                  << "the background";
+        ostringstream prefix;
+        prefix << "[Iteration " << iter << ", test net #" << test_net_id_
+               << "] ";
+        solver_->DisplayTestScores(test_net_id_, test_score,
+            test_score_output_id, loss, prefix.str());
+        done_.push(iter);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  Solver* solver_;
+  int test_net_id_;
+  // Only touched by the solver thread.
+  bool pending_;
+  BlockingQueue<int> requests_;
+  BlockingQueue<int> done_;
+};
+
+template <typename Dtype>
+void Solver<Dtype>::TestAsync(const int test_net_id) {
+  CHECK(Caffe::root_solver());
+  test_threads_.resize(test_nets_.size());
+  shared_ptr<TestThread>& thread = test_threads_[test_net_id];
+  if (!thread) {
+    thread.reset(new TestThread(this, test_net_id));
+    thread->StartInternalThread();
+  }
+  // The test net is still in use until its previous test is done.
+  thread->Wait();
+  CHECK_NOTNULL(test_nets_[test_net_id].get())->
+      CopyTrainedLayersFrom(net_.get());
+  thread->Submit(iter_);
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForTests() {
+  for (int i = 0; i < test_threads_.size(); ++i) {
+    if (test_threads_[i]) {
+      test_threads_[i]->Wait();
+    }
+  }
+}
+
+template <typename Dtype>
+bool Solver<Dtype>::TestForward(const int test_net_id, bool check_requests,
+    vector<Dtype>* test_score, vector<int>* test_score_output_id,
+    Dtype* loss) {
+  const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
+  for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
+    if (check_requests) {
+      SolverAction::Enum request = GetRequestedAction();
+      // Check to see if stoppage of testing/training has been requested.
+      while (request != SolverAction::NONE) {
+          if (SolverAction::SNAPSHOT == request) {
+            Snapshot();
+          } else if (SolverAction::STOP == request) {
+            requested_early_exit_ = true;
+          }
+          request = GetRequestedAction();
+      }
+      if (requested_early_exit_) {
+        // break out of test loop.
+        return false;
+      }
     }
 
     Dtype iter_loss;
     const vector<Blob<Dtype>*>& result =
         test_net->Forward(&iter_loss);
     if (param_.test_compute_loss()) {
-      loss += iter_loss;
+      *loss += iter_loss;
     }
     if (i == 0) {
       for (int j = 0; j < result.size(); ++j) {
         const Dtype* result_vec = result[j]->cpu_data();
         for (int k = 0; k < result[j]->count(); ++k) {
-          test_score.push_back(result_vec[k]);
-          test_score_output_id.push_back(j);
+          test_score->push_back(result_vec[k]);
+          test_score_output_id->push_back(j);
         }
       }
     } else {
@@ -377,18 +533,22 @@ void Solver<Dtype>::Test(const int test_net_id) {
       for (int j = 0; j < result.size(); ++j) {
         const Dtype* result_vec = result[j]->cpu_data();
         for (int k = 0; k < result[j]->count(); ++k) {
-          test_score[idx++] += result_vec[k];
+          (*test_score)[idx++] += result_vec[k];
         }
       }
     }
   }
-  if (requested_early_exit_) {
-    LOG(INFO)     << "Test interrupted.";
-    return;
-  }
+  return true;
+}
+
+template <typename Dtype>
+void Solver<Dtype>::DisplayTestScores(const int test_net_id,
+    const vector<Dtype>& test_score, const vector<int>& test_score_output_id,
+    Dtype loss, const string& prefix) {
+  const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   if (param_.test_compute_loss()) {
     loss /= param_.test_iter(test_net_id);
-    LOG(INFO) << "Test loss: " << loss;
+    LOG(INFO) << prefix << "Test loss: " << loss;
   }
   for (int i = 0; i < test_score.size(); ++i) {
     const int output_blob_index =
@@ -401,14 +561,18 @@ void Solver<Dtype>::Test(const int test_net_id) {
       loss_msg_stream << " (* " << loss_weight
                       << " = " << loss_weight * mean_score << " loss)";
     }
-    LOG(INFO) << "    Test net output #" << i << ": " << output_name << " = "
-              << mean_score << loss_msg_stream.str();
+    LOG(INFO) << prefix << "    Test net output #" << i << ": "
+              << output_name << " = " << mean_score << loss_msg_stream.str();
   }
 }
 
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (param_.snapshot_async() && param_.snapshot_format() ==
+      caffe::SolverParameter_SnapshotFormat_BINARYPROTO && SnapshotAsync()) {
+    return;
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -424,6 +588,36 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);
 }
 
+template <typename Dtype>
+bool Solver<Dtype>::SnapshotAsync() {
+  if (!snapshot_writer_) {
+    snapshot_writer_.reset(
+        new SnapshotWriter<Dtype>(param_.snapshot_max_pending()));
+    snapshot_writer_->StartInternalThread();
+  }
+  typename SnapshotWriter<Dtype>::Staging* staging =
+      snapshot_writer_->Acquire();
+  if (!StageSolverState(&staging->state, &staging->history)) {
+    snapshot_writer_->Release(staging);
+    return false;
+  }
+  staging->model_filename = SnapshotFilename(".caffemodel");
+  staging->state_filename = SnapshotFilename(".solverstate");
+  staging->state.set_learned_net(staging->model_filename);
+  SnapshotWriter<Dtype>::StageNet(*net_, param_.snapshot_diff(), staging);
+  LOG(INFO) << "Snapshotting to binary proto file " << staging->model_filename
+      << " in the background";
+  snapshot_writer_->Submit(staging);
+  return true;
+}
+
+template <typename Dtype>
+void Solver<Dtype>::FlushSnapshots() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Flush();
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -106,6 +107,30 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::FusedUpdate(int param_id, int begin, int end,
+    Dtype rate) {
+  const Dtype delta = this->param_.delta();
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype local_decay = this->LocalDecay(param_id);
+  Dtype* data = this->fused_data_;
+  Dtype* diff = this->fused_diff_;
+  Dtype* gradient_history = this->fused_history_[0];
+  Dtype* update_history = this->fused_history_[1];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(i, local_decay);
+    gradient_history[i] = momentum * gradient_history[i] +
+        (Dtype(1) - momentum) * gradient * gradient;
+    const Dtype update = gradient * std::sqrt((update_history[i] + delta) /
+        (gradient_history[i] + delta));
+    update_history[i] = momentum * update_history[i] +
+        (Dtype(1) - momentum) * update * update;
+    diff[i] = local_rate * update;
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -64,6 +65,23 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::FusedUpdate(int param_id, int begin, int end,
+    Dtype rate) {
+  const Dtype delta = this->param_.delta();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype local_decay = this->LocalDecay(param_id);
+  Dtype* data = this->fused_data_;
+  Dtype* diff = this->fused_diff_;
+  Dtype* history = this->fused_history_[0];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(i, local_decay);
+    history[i] += gradient * gradient;
+    diff[i] = local_rate * gradient / (std::sqrt(history[i]) + delta);
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
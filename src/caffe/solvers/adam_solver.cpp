@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -88,6 +89,31 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::FusedUpdate(int param_id, int begin, int end,
+    Dtype rate) {
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype local_decay = this->LocalDecay(param_id);
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const Dtype eps_hat = this->param_.delta();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  Dtype* data = this->fused_data_;
+  Dtype* diff = this->fused_diff_;
+  Dtype* val_m = this->fused_history_[0];
+  Dtype* val_v = this->fused_history_[1];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = this->FusedGradient(i, local_decay);
+    val_m[i] = beta1 * val_m[i] + (Dtype(1) - beta1) * gradient;
+    val_v[i] = beta2 * val_v[i] + (Dtype(1) - beta2) * gradient * gradient;
+    diff[i] = local_rate * correction * val_m[i] /
+        (std::sqrt(val_v[i]) + eps_hat);
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
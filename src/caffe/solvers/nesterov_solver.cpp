@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -56,6 +57,25 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::FusedUpdate(int param_id, int begin, int end,
+    Dtype rate) {
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype local_decay = this->LocalDecay(param_id);
+  Dtype* data = this->fused_data_;
+  Dtype* diff = this->fused_diff_;
+  Dtype* history = this->fused_history_[0];
+  for (int i = begin; i < end; ++i) {
+    const Dtype previous = history[i];
+    history[i] = momentum * previous +
+        local_rate * this->FusedGradient(i, local_decay);
+    // step back then over step
+    diff[i] = (Dtype(1) + momentum) * history[i] - momentum * previous;
+    data[i] -= diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
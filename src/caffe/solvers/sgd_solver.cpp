@@ -1,9 +1,15 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -75,6 +81,8 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  // The fused update lays out its buffers once all history is in place.
+  fused_offsets_.clear();
 }
 
 template <typename Dtype>
@@ -82,9 +90,19 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  // The params with sparse gradients only have them in their fused_rows_.
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+    if (!fused_sparse_[i]) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+      continue;
+    }
+    const int row_size = net_params[i]->count(1);
+    const Dtype* diff = net_params[i]->cpu_diff();
+    for (int j = 0; j < fused_rows_[i].size(); ++j) {
+      const Dtype* row = diff + fused_rows_[i][j] * row_size;
+      sumsq_diff += caffe_cpu_dot(row_size, row, row);
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -93,7 +111,16 @@ void SGDSolver<Dtype>::ClipGradients() {
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
     for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+      if (!fused_sparse_[i]) {
+        net_params[i]->scale_diff(scale_factor);
+        continue;
+      }
+      const int row_size = net_params[i]->count(1);
+      Dtype* diff = net_params[i]->mutable_cpu_diff();
+      for (int j = 0; j < fused_rows_[i].size(); ++j) {
+        caffe_scal(row_size, scale_factor,
+            diff + fused_rows_[i][j] * row_size);
+      }
     }
   }
 }
@@ -105,7 +132,28 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
+  // The params with sparse gradients, which only occur in CPU mode.
+  const int num_params = this->net_->learnable_params().size();
+  fused_sparse_.resize(num_params);
+  fused_rows_.resize(num_params);
+  bool sparse = false;
+  for (int param_id = 0; param_id < num_params; ++param_id) {
+    fused_sparse_[param_id] =
+        this->net_->SparseParamRows(param_id, &fused_rows_[param_id]);
+    sparse = sparse || fused_sparse_[param_id];
+  }
   ClipGradients();
+  if (Caffe::mode() == Caffe::CPU) {
+    // Only the fused update has the lazy update of the rows of sparse params.
+    if (sparse && !this->param_.fused_update() && fused_offsets_.empty()) {
+      LOG(INFO) << "Using the fused update for the params with sparse "
+          << "gradients, although fused_update is not set";
+    }
+    if (this->param_.fused_update() || sparse) {
+      FusedApplyUpdate(rate);
+      return;
+    }
+  }
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
     Normalize(param_id);
@@ -115,6 +163,158 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+// Copies the data, or the diffs, of blobs into consecutive parts of flat and
+// points the blobs at them.
+template <typename Dtype>
+static void MoveToFlat(const vector<Blob<Dtype>*>& blobs, Blob<Dtype>* flat,
+    bool diff) {
+  Dtype* ptr = flat->mutable_cpu_data();
+  for (int i = 0; i < blobs.size(); ++i) {
+    SyncedMemory* mem = diff ? blobs[i]->diff().get() : blobs[i]->data().get();
+    caffe_copy(blobs[i]->count(), static_cast<const Dtype*>(mem->cpu_data()),
+        ptr);
+    mem->set_cpu_data(ptr);
+    ptr += blobs[i]->count();
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedPreSolve() {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const string& regularization_type = this->param_.regularization_type();
+  CHECK(regularization_type == "L1" || regularization_type == "L2")
+      << "Unknown regularization type: " << regularization_type;
+  fused_l1_ = regularization_type == "L1";
+  fused_offsets_.assign(1, 0);
+  for (int i = 0; i < net_params.size(); ++i) {
+    fused_offsets_.push_back(fused_offsets_.back() + net_params[i]->count());
+  }
+  const vector<int> shape(1, fused_offsets_.back());
+  // Params that already share one buffer, as with CPUSync, stay in place.
+  bool contiguous = true;
+  for (int i = 0; i < net_params.size(); ++i) {
+    contiguous = contiguous && net_params[i]->cpu_data() ==
+        net_params[0]->cpu_data() + fused_offsets_[i] &&
+        net_params[i]->cpu_diff() ==
+        net_params[0]->cpu_diff() + fused_offsets_[i];
+  }
+  if (!contiguous) {
+    flat_data_.reset(new Blob<Dtype>(shape));
+    flat_diff_.reset(new Blob<Dtype>(shape));
+    MoveToFlat(net_params, flat_data_.get(), false);
+    MoveToFlat(net_params, flat_diff_.get(), true);
+  }
+  fused_data_ = net_params.size() ?
+      net_params[0]->mutable_cpu_data() : NULL;
+  fused_diff_ = net_params.size() ?
+      net_params[0]->mutable_cpu_diff() : NULL;
+  // Solvers keep one or more history blobs per param, grouped by kind.
+  CHECK_EQ(history_.size() % std::max<size_t>(net_params.size(), 1), 0);
+  flat_history_.clear();
+  fused_history_.clear();
+  for (int i = 0; i < history_.size(); i += net_params.size()) {
+    vector<Blob<Dtype>*> history(net_params.size());
+    for (int j = 0; j < net_params.size(); ++j) {
+      history[j] = history_[i + j].get();
+    }
+    flat_history_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+    MoveToFlat(history, flat_history_.back().get(), false);
+    fused_history_.push_back(flat_history_.back()->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedApplyUpdate(Dtype rate) {
+  if (fused_offsets_.empty()) {
+    FusedPreSolve();
+  }
+  fused_normalization_ = Dtype(1) / this->param_.iter_size();
+  const int count = fused_offsets_.back();
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  // The update writes through fused_data_; asking for the mutable data marks
+  // the params as changed (SyncedMemory::version) for the copies made of them.
+  for (int i = 0; i < net_params.size(); ++i) {
+    net_params[i]->mutable_cpu_data();
+  }
+  // The elements to update, which the sparse params only have a few of.
+  int64_t work = 0;
+  for (int i = 0; i < net_params.size(); ++i) {
+    work += fused_sparse_[i] ? static_cast<int64_t>(fused_rows_[i].size()) *
+        net_params[i]->count(1) : net_params[i]->count();
+  }
+  // Small nets are not worth splitting over threads.
+  const int kMinCountPerThread = 1 << 16;
+  int threads = this->param_.update_threads();
+  if (threads <= 0) {
+    threads = boost::thread::hardware_concurrency();
+  }
+  threads = std::max<int64_t>(1, std::min<int64_t>(threads,
+      work / kMinCountPerThread));
+  if (threads == 1) {
+    FusedUpdateRange(0, count, rate);
+    return;
+  }
+  if (!update_pool_) {
+    update_pool_ = ThreadPool::Shared();
+  }
+  update_pool_->Run(threads, boost::bind(&SGDSolver<Dtype>::FusedUpdatePart,
+      this, threads, rate, _1));
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdatePart(int parts, Dtype rate, int part) {
+  const int64_t count = fused_offsets_.back();
+  FusedUpdateRange(static_cast<int>(count * part / parts),
+      static_cast<int>(count * (part + 1) / parts), rate);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdateRange(int begin, int end, Dtype rate) {
+  int param_id = std::upper_bound(fused_offsets_.begin(), fused_offsets_.end(),
+      begin) - fused_offsets_.begin() - 1;
+  while (begin < end) {
+    const int param_end = std::min(end, fused_offsets_[param_id + 1]);
+    if (fused_sparse_[param_id]) {
+      FusedSparseUpdate(param_id, begin, param_end, rate);
+    } else {
+      FusedUpdate(param_id, begin, param_end, rate);
+    }
+    begin = param_end;
+    ++param_id;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedSparseUpdate(int param_id, int begin, int end,
+    Dtype rate) {
+  const int offset = fused_offsets_[param_id];
+  const int row_size = this->net_->learnable_params()[param_id]->count(1);
+  const vector<int>& rows = fused_rows_[param_id];
+  vector<int>::const_iterator row = std::lower_bound(rows.begin(), rows.end(),
+      (begin - offset) / row_size);
+  for (; row != rows.end(); ++row) {
+    const int row_begin = offset + *row * row_size;
+    if (row_begin >= end) { break; }
+    FusedUpdate(param_id, std::max(begin, row_begin),
+        std::min(end, row_begin + row_size), rate);
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdate(int param_id, int begin, int end,
+    Dtype rate) {
+  const Dtype momentum = this->param_.momentum();
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype local_decay = LocalDecay(param_id);
+  Dtype* history = fused_history_[0];
+  for (int i = begin; i < end; ++i) {
+    history[i] = momentum * history[i] +
+        local_rate * FusedGradient(i, local_decay);
+    fused_diff_[i] = history[i];
+    fused_data_[i] -= history[i];
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -275,6 +475,16 @@ void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
   WriteProtoToBinaryFile(state, snapshot_filename.c_str());
 }
 
+template <typename Dtype>
+bool SGDSolver<Dtype>::StageSolverState(SolverState* state,
+    vector<shared_ptr<Blob<Dtype> > >* history) {
+  state->Clear();
+  state->set_iter(this->iter_);
+  state->set_current_step(this->current_step_);
+  SnapshotWriter<Dtype>::StageBlobs(history_, false, history);
+  return true;
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
     const string& model_filename) {
@@ -0,0 +1,74 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/cpu_topology.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CPUTopologyTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Caffe::set_numa_node(-1);
+  }
+};
+
+TEST_F(CPUTopologyTest, TestCPUList) {
+  vector<int> cpus;
+  EXPECT_TRUE(ParseCPUList("0-3,8,10-11", &cpus));
+  const int expected[] = {0, 1, 2, 3, 8, 10, 11};
+  ASSERT_EQ(7, cpus.size());
+  for (int i = 0; i < cpus.size(); ++i) {
+    EXPECT_EQ(expected[i], cpus[i]);
+  }
+  EXPECT_EQ("0-3,8,10-11", FormatCPUList(cpus));
+  EXPECT_TRUE(ParseCPUList("5\n", &cpus));
+  EXPECT_EQ("5", FormatCPUList(cpus));
+  EXPECT_FALSE(ParseCPUList("3-1", &cpus));
+  EXPECT_FALSE(ParseCPUList("a", &cpus));
+}
+
+TEST_F(CPUTopologyTest, TestTopology) {
+  const CPUTopology& topology = CPUTopology::Get();
+  ASSERT_GE(topology.num_nodes(), 1);
+  int count = 0;
+  for (int node = 0; node < topology.num_nodes(); ++node) {
+    EXPECT_GT(topology.cpus(node).size(), 0);
+    count += topology.cpus(node).size();
+  }
+  EXPECT_EQ(count, topology.num_cpus());
+  EXPECT_FALSE(topology.Describe().empty());
+}
+
+class NumaNodeThread : public InternalThread {
+ public:
+  NumaNodeThread() : numa_node_(-2) {}
+  int numa_node_;
+
+ protected:
+  virtual void InternalThreadEntry() {
+    numa_node_ = Caffe::numa_node();
+  }
+};
+
+TEST_F(CPUTopologyTest, TestNumaNodeInherited) {
+  EXPECT_EQ(-1, Caffe::numa_node());
+  Caffe::set_numa_node(0);
+  EXPECT_EQ(0, Caffe::numa_node());
+  NumaNodeThread thread;
+  thread.StartInternalThread();
+  thread.StopInternalThread();
+  EXPECT_EQ(0, thread.numa_node_);
+  Caffe::set_numa_node(-1);
+  NumaNodeThread unpinned;
+  unpinned.StartInternalThread();
+  unpinned.StopInternalThread();
+  EXPECT_EQ(-1, unpinned.numa_node_);
+}
+
+}  // namespace caffe
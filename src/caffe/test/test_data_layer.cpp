@@ -67,7 +67,29 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
-  void TestRead() {
+  // Fill the DB with the JPEG of the cat image, as it is, under 5 labels.
+  void FillEncoded(DataParameter_DB backend) {
+    backend_ = backend;
+    LOG(INFO) << "Using temporary dataset " << *filename_;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < 5; ++i) {
+      Datum datum;
+      CHECK(ReadImageToDatum(EXAMPLES_SOURCE_DIR "images/cat.jpg", i, "jpg",
+          &datum));
+      CHECK(datum.encoded());
+      stringstream ss;
+      ss << i;
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(ss.str(), out);
+    }
+    txn->Commit();
+    db->Close();
+  }
+
+  void TestRead(int reader_threads = 1) {
     const Dtype scale = 3;
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -75,6 +97,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_reader_threads(reader_threads);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -105,6 +128,47 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  void TestPrefetchStats(bool encoded) {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    param.mutable_transform_param()->set_prefetch(6);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    const int num_batches = 10;
+    for (int iter = 0; iter < num_batches; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    }
+    PrefetchStats stats = layer.prefetch_stats();
+    EXPECT_EQ(num_batches, stats.batches);
+    EXPECT_GE(stats.loaded, num_batches);
+    EXPECT_GE(stats.wait_ms, 0);
+    EXPECT_LE(stats.stalls, num_batches);
+    ASSERT_EQ(6 + 1, stats.occupancy.size());
+    int occupancy_total = 0;
+    for (int k = 0; k < stats.occupancy.size(); ++k) {
+      occupancy_total += stats.occupancy[k];
+    }
+    EXPECT_EQ(num_batches, occupancy_total);
+    EXPECT_EQ(stats.stalls, stats.occupancy[0]);
+    EXPECT_GE(stats.load_ms,
+        stats.read_ms + stats.decode_ms + stats.transform_ms);
+    // Only encoded data is decoded.
+    if (encoded) {
+      EXPECT_GT(stats.decode_ms, 0);
+    } else {
+      EXPECT_EQ(0, stats.decode_ms);
+    }
+    layer.ResetPrefetchStats();
+    stats = layer.prefetch_stats();
+    EXPECT_EQ(0, stats.batches);
+    EXPECT_EQ(0, stats.occupancy[0]);
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -356,6 +420,14 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+// The threads read strides of 3 over the 5 records, wrapping around them at
+// different points, and the records still come out in order.
+TYPED_TEST(DataLayerTest, TestReadThreadedLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestRead(3);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -387,6 +459,17 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
   this->TestReadCrop(TEST);
 }
+
+TYPED_TEST(DataLayerTest, TestPrefetchStatsLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestPrefetchStats(false);
+}
+
+TYPED_TEST(DataLayerTest, TestPrefetchStatsEncodedLevelDB) {
+  this->FillEncoded(DataParameter_DB_LEVELDB);
+  this->TestPrefetchStats(true);
+}
 #endif  // USE_LEVELDB
 
 #ifdef USE_LMDB
@@ -396,6 +479,14 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+// The threads read strides of 3 over the 5 records, wrapping around them at
+// different points, and the records still come out in order.
+TYPED_TEST(DataLayerTest, TestReadThreadedLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead(3);
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -428,6 +519,17 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop(TEST);
 }
 
+TYPED_TEST(DataLayerTest, TestPrefetchStatsLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestPrefetchStats(false);
+}
+
+TYPED_TEST(DataLayerTest, TestPrefetchStatsEncodedLMDB) {
+  this->FillEncoded(DataParameter_DB_LMDB);
+  this->TestPrefetchStats(true);
+}
+
 #endif  // USE_LMDB
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,4 +1,6 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
 #include <string>
 #include <vector>
 
@@ -340,5 +342,121 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestMeanFileCropMirror) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int label = 0;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const int size = channels * height * width;
+  const int crop_size = 2;
+
+  // A mean of half the pixels, with a scale of 2, gives back the pixels.
+  string mean_file;
+  MakeTempFilename(&mean_file);
+  BlobProto blob_mean;
+  blob_mean.set_num(1);
+  blob_mean.set_channels(channels);
+  blob_mean.set_height(height);
+  blob_mean.set_width(width);
+  for (int j = 0; j < size; ++j) {
+    blob_mean.add_data(j * 0.5);
+  }
+  WriteProtoToBinaryFile(blob_mean, mean_file);
+
+  transform_param.set_mean_file(mean_file);
+  transform_param.set_scale(2);
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  Datum datum;
+  FillDatum(label, channels, height, width, unique_pixels, &datum);
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  // The center crop starts at row 1 and column 1.
+  const int h_off = 1;
+  const int w_off = 1;
+  int num_mirrored = 0;
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(datum, &blob);
+    const bool mirrored = blob.cpu_data()[0] != (h_off * width + w_off);
+    num_mirrored += mirrored;
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < crop_size; ++h) {
+        for (int w = 0; w < crop_size; ++w) {
+          const int data_w = mirrored ? crop_size - 1 - w : w;
+          EXPECT_EQ((c * height + h_off + h) * width + w_off + data_w,
+              blob.data_at(0, c, h, w));
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, this->num_iter_);
+}
+
+TYPED_TEST(DataTransformTest, TestMatMeanFileCropMirror) {
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const int size = channels * height * width;
+  const int crop_size = 2;
+
+  // A mean of half the pixels, with a scale of 2, gives back the pixels.
+  string mean_file;
+  MakeTempFilename(&mean_file);
+  BlobProto blob_mean;
+  blob_mean.set_num(1);
+  blob_mean.set_channels(channels);
+  blob_mean.set_height(height);
+  blob_mean.set_width(width);
+  for (int j = 0; j < size; ++j) {
+    blob_mean.add_data(j * 0.5);
+  }
+  WriteProtoToBinaryFile(blob_mean, mean_file);
+
+  transform_param.set_mean_file(mean_file);
+  transform_param.set_scale(2);
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  // The channels of the image are interleaved; the pixels are numbered in
+  // the planar order of the blob.
+  cv::Mat cv_img(height, width, CV_8UC3);
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        cv_img.at<cv::Vec3b>(h, w)[c] = (c * height + h) * width + w;
+      }
+    }
+  }
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  // The center crop starts at row 1 and column 1.
+  const int h_off = 1;
+  const int w_off = 1;
+  int num_mirrored = 0;
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(cv_img, &blob);
+    const bool mirrored = blob.cpu_data()[0] != (h_off * width + w_off);
+    num_mirrored += mirrored;
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < crop_size; ++h) {
+        for (int w = 0; w < crop_size; ++w) {
+          const int data_w = mirrored ? crop_size - 1 - w : w;
+          EXPECT_EQ((c * height + h_off + h) * width + w_off + data_w,
+              blob.data_at(0, c, h, w));
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, this->num_iter_);
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
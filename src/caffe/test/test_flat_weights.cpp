@@ -0,0 +1,147 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class FlatWeightsTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  FlatWeightsTest() : seed_(1701) {}
+
+  virtual void SetUp() {
+    MakeTempDir(&temp_dir_);
+  }
+
+  shared_ptr<Net<Dtype> > MakeNet() {
+    const string proto =
+        "name: 'FlatWeightsNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 3 dim: 4 dim: 5 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'innerprod' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 7 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'conv' "
+        "  top: 'innerprod' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    return shared_ptr<Net<Dtype> >(new Net<Dtype>(param));
+  }
+
+  // Checks that the params of net equal those of source.
+  void CheckParams(const Net<Dtype>& source, const Net<Dtype>& net) {
+    const vector<shared_ptr<Blob<Dtype> > >& params = net.params();
+    ASSERT_EQ(source.params().size(), params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      const Blob<Dtype>& expected = *source.params()[i];
+      ASSERT_TRUE(expected.shape() == params[i]->shape());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_data()[j], params[i]->cpu_data()[j]);
+      }
+    }
+  }
+
+  int seed_;
+  string temp_dir_;
+};
+
+TYPED_TEST_CASE(FlatWeightsTest, TestDtypesAndDevices);
+
+TYPED_TEST(FlatWeightsTest, TestCopy) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  shared_ptr<Net<Dtype> > source = this->MakeNet();
+  NetParameter weights;
+  source->ToProto(&weights);
+  const string filename = this->temp_dir_ + "/weights.caffeflat";
+  WriteFlatWeights<Dtype>(weights, filename);
+  // A net with other weights, loaded through the generic entry point.
+  Caffe::set_random_seed(this->seed_ + 1);
+  shared_ptr<Net<Dtype> > net = this->MakeNet();
+  net->CopyTrainedLayersFrom(filename);
+  this->CheckParams(*source, *net);
+}
+
+TYPED_TEST(FlatWeightsTest, TestAlias) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  shared_ptr<Net<Dtype> > source = this->MakeNet();
+  NetParameter weights;
+  source->ToProto(&weights);
+  const string filename = this->temp_dir_ + "/weights.caffeflat";
+  WriteFlatWeights<Dtype>(weights, filename);
+  Caffe::set_random_seed(this->seed_ + 1);
+  shared_ptr<Net<Dtype> > net = this->MakeNet();
+  net->CopyTrainedLayersFromFlat(filename, true);
+  this->CheckParams(*source, *net);
+  // The params point into the mapping, aligned for vector loads.
+  for (int i = 0; i < net->params().size(); ++i) {
+    const Dtype* data = net->params()[i]->cpu_data();
+    EXPECT_EQ(0, reinterpret_cast<size_t>(data) % kFlatWeightsAlignment);
+  }
+  const vector<Blob<Dtype>*>& top = net->Forward();
+  const vector<Blob<Dtype>*>& source_top = source->Forward();
+  ASSERT_EQ(1, top.size());
+  EXPECT_EQ(source_top[0]->count(), top[0]->count());
+}
+
+TYPED_TEST(FlatWeightsTest, TestConvertType) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  shared_ptr<Net<Dtype> > source = this->MakeNet();
+  NetParameter weights;
+  source->ToProto(&weights);
+  // Stored as double, loaded into nets of either type; aliasing falls back
+  // to a copy when the types differ.
+  const string filename = this->temp_dir_ + "/weights.caffeflat";
+  WriteFlatWeights<double>(weights, filename);
+  Caffe::set_random_seed(this->seed_ + 1);
+  shared_ptr<Net<Dtype> > net = this->MakeNet();
+  net->CopyTrainedLayersFromFlat(filename, true);
+  this->CheckParams(*source, *net);
+  FlatWeights flat(filename);
+  EXPECT_EQ(FlatWeightsIndex::DOUBLE, flat.index().type());
+  // The data layer has no params and is left out of the index.
+  ASSERT_EQ(2, flat.index().layer_size());
+  EXPECT_EQ("conv", flat.index().layer(0).name());
+  EXPECT_EQ(2, flat.index().layer(0).param_size());
+  EXPECT_EQ("innerprod", flat.index().layer(1).name());
+}
+
+}  // namespace caffe
@@ -26,7 +26,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), fused_(false), snapshot_async_(false) {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -37,11 +37,14 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   string snapshot_prefix_;
   shared_ptr<SGDSolver<Dtype> > solver_;
   shared_ptr<P2PSync<Dtype> > sync_;
+  shared_ptr<CPUSync<Dtype> > cpu_sync_;
   int seed_;
   // Dimensions are determined by generate_sample_data.py
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  bool fused_;
+  bool snapshot_async_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -85,6 +88,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
        "lr_policy: 'fixed' "
        "iter_size: " << iter_size << " "
        "device_id: " << device_id << " "
+       "fused_update: " << fused_ << " "
+       "snapshot_async: " << snapshot_async_ << " "
        "net_param { "
        "  name: 'TestNetwork' "
        "  layer { "
@@ -191,6 +196,12 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     }
     if (devices == 1) {
       this->solver_->Solve();
+    } else if (Caffe::mode() == Caffe::CPU) {
+      LOG(INFO) << "Multi-CPU test on " << devices << " workers";
+      Caffe::set_solver_count(devices);
+      this->cpu_sync_.reset(new CPUSync<Dtype>(this->solver_));
+      this->cpu_sync_->Run(devices);
+      Caffe::set_solver_count(1);
     } else {
       LOG(INFO) << "Multi-GPU test on " << devices << " devices";
       vector<int> gpus;
@@ -455,8 +466,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       const int iter_to_check = 0) {
     const int kNum = num_;
     const int kIterSize = 1;
-    // Test over all numbers of devices.
-    int available_devices = 1;
+    // Test over all numbers of devices, or of CPU workers.
+    int available_devices = Caffe::mode() == Caffe::CPU ? 2 : 1;
 #ifndef CPU_ONLY
     if (Caffe::mode() == Caffe::GPU) {
       CUDA_CHECK(cudaGetDeviceCount(&available_devices));
@@ -636,6 +647,18 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -682,6 +705,55 @@ TYPED_TEST(SGDSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccumFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->fused_ = true;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotAsyncFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -735,6 +807,19 @@ TYPED_TEST(AdaGradSolverTest, TestAdaGradLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(AdaGradSolverTest,
+    TestAdaGradLeastSquaresUpdateWithEverythingFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdaGradSolverTest,
       TestAdaGradLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
@@ -869,6 +954,19 @@ TYPED_TEST(NesterovSolverTest, TestNesterovLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(NesterovSolverTest,
+    TestNesterovLeastSquaresUpdateWithEverythingFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(NesterovSolverTest,
            TestNesterovLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
@@ -998,6 +1096,19 @@ TYPED_TEST(AdaDeltaSolverTest, TestAdaDeltaLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(AdaDeltaSolverTest,
+    TestAdaDeltaLeastSquaresUpdateWithEverythingFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.1;
+  const Dtype kWeightDecay = 0.1;
+  const Dtype kMomentum = 0.95;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdaDeltaSolverTest,
            TestAdaDeltaLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
@@ -1101,6 +1212,18 @@ TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1147,6 +1270,18 @@ TYPED_TEST(AdamSolverTest, TestSnapshot) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdamSolverTest, TestSnapshotShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1203,6 +1338,19 @@ TYPED_TEST(RMSPropSolverTest, TestRMSPropLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(RMSPropSolverTest,
+    TestRMSPropLeastSquaresUpdateWithEverythingFused) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.0;
+  const int kNumIters = 4;
+  this->fused_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(RMSPropSolverTest,
       TestRMSPropLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
@@ -1262,4 +1410,282 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+template <typename Dtype>
+class SparseEmbedSolverTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Trains an embedding with sparse gradients through the sum of its
+  // outputs, so that the gradient of a row is the number of its uses.
+  void InitSolver() {
+    const string proto =
+        "base_lr: 0.1 "
+        "lr_policy: 'fixed' "
+        "momentum: 0.9 "
+        "weight_decay: 0.1 "
+        "net_param { "
+        "  layer { "
+        "    name: 'ids' "
+        "    type: 'Input' "
+        "    input_param { shape { dim: 3 } } "
+        "    top: 'ids' "
+        "  } "
+        "  layer { "
+        "    name: 'embed' "
+        "    type: 'Embed' "
+        "    embed_param { "
+        "      num_output: 2 "
+        "      input_dim: 8 "
+        "      bias_term: false "
+        "      sparse_gradient: true "
+        "      weight_filler { type: 'gaussian' } "
+        "    } "
+        "    bottom: 'ids' "
+        "    top: 'embed' "
+        "  } "
+        "  layer { "
+        "    name: 'sum' "
+        "    type: 'Reduction' "
+        "    reduction_param { axis: 0 } "
+        "    bottom: 'embed' "
+        "    top: 'sum' "
+        "    loss_weight: 1 "
+        "  } "
+        "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    solver_.reset(new SGDSolver<Dtype>(param));
+  }
+
+  // Takes a step on ids, checking the weights against a dense SGD update of
+  // the rows used only.
+  void Step(const int ids[3]) {
+    Net<Dtype>* net = solver_->net().get();
+    Blob<Dtype>* weight = net->learnable_params()[0];
+    if (expected_.empty()) {
+      expected_.assign(weight->cpu_data(), weight->cpu_data() +
+          weight->count());
+      history_.assign(weight->count(), 0);
+    }
+    vector<int> uses(weight->shape(0), 0);
+    int used_rows = 0;
+    for (int i = 0; i < 3; ++i) {
+      net->input_blobs()[0]->mutable_cpu_data()[i] = ids[i];
+      used_rows += uses[ids[i]]++ == 0;
+    }
+    for (int i = 0; i < weight->count(); ++i) {
+      const int row = i / weight->shape(1);
+      if (uses[row]) {
+        const Dtype gradient = uses[row] + 0.1 * expected_[i];
+        history_[i] = 0.9 * history_[i] + 0.1 * gradient;
+        expected_[i] -= history_[i];
+      }
+    }
+    solver_->Step(1);
+    const vector<int>* rows =
+        net->layer_by_name("embed")->sparse_param_rows(0);
+    ASSERT_TRUE(rows != NULL);
+    EXPECT_EQ(used_rows, rows->size());
+    const Dtype kEpsilon = 1e-5;
+    for (int i = 0; i < weight->count(); ++i) {
+      EXPECT_NEAR(expected_[i], weight->cpu_data()[i], kEpsilon) << i;
+    }
+  }
+
+  shared_ptr<SGDSolver<Dtype> > solver_;
+  vector<Dtype> expected_;
+  vector<Dtype> history_;
+};
+
+TYPED_TEST_CASE(SparseEmbedSolverTest, TestDtypes);
+
+TYPED_TEST(SparseEmbedSolverTest, TestLazyUpdate) {
+  this->InitSolver();
+  // Row 3 is left with its momentum in the second step.
+  const int first[3] = {1, 3, 3};
+  const int second[3] = {1, 5, 5};
+  this->Step(first);
+  this->Step(second);
+  this->Step(first);
+}
+
+template <typename Dtype>
+class SparseAdaptiveSolverTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Returns a solver of type for the net of SparseEmbedSolverTest, with
+  // sparse gradients or not, and with clipped gradients.
+  Solver<Dtype>* CreateSolver(const string& type, bool sparse) {
+    ostringstream proto;
+    proto <<
+        "type: '" << type << "' "
+        "base_lr: 0.1 "
+        "lr_policy: 'fixed' "
+        "momentum: " << (type == "Adam" || type == "Nesterov" ? 0.9 : 0) << " "
+        "clip_gradients: 2 "
+        "random_seed: 1701 "
+        "net_param { "
+        "  layer { "
+        "    name: 'ids' "
+        "    type: 'Input' "
+        "    input_param { shape { dim: 3 } } "
+        "    top: 'ids' "
+        "  } "
+        "  layer { "
+        "    name: 'embed' "
+        "    type: 'Embed' "
+        "    embed_param { "
+        "      num_output: 2 "
+        "      input_dim: 8 "
+        "      bias_term: false "
+        "      sparse_gradient: " << sparse << " "
+        "      weight_filler { type: 'gaussian' } "
+        "    } "
+        "    bottom: 'ids' "
+        "    top: 'embed' "
+        "  } "
+        "  layer { "
+        "    name: 'sum' "
+        "    type: 'Reduction' "
+        "    reduction_param { axis: 0 } "
+        "    bottom: 'embed' "
+        "    top: 'sum' "
+        "    loss_weight: 1 "
+        "  } "
+        "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    return SolverRegistry<Dtype>::CreateSolver(param);
+  }
+
+  vector<Dtype> Step(Solver<Dtype>* solver, const int ids[3]) {
+    Net<Dtype>* net = solver->net().get();
+    for (int i = 0; i < 3; ++i) {
+      net->input_blobs()[0]->mutable_cpu_data()[i] = ids[i];
+    }
+    solver->Step(1);
+    const Blob<Dtype>& weight = *net->learnable_params()[0];
+    return vector<Dtype>(weight.cpu_data(), weight.cpu_data() + weight.count());
+  }
+
+  // Without weight decay, the history of a row only changes when it has a
+  // gradient. So the lazy update leaves the rows without one as they are, and
+  // matches the dense one on the rows that had a gradient in every step since
+  // their first: row 1 in all steps, row 3 in the first and row 5 in the
+  // second. Row 3 differs after the third, its history having decayed in the
+  // dense update.
+  void TestLazyUpdate(const string& type) {
+    shared_ptr<Solver<Dtype> > lazy(CreateSolver(type, true));
+    shared_ptr<Solver<Dtype> > dense(CreateSolver(type, false));
+    const int ids[3][3] = { {1, 3, 3}, {1, 5, 5}, {1, 3, 3} };
+    const int row_size = 2;
+    const Blob<Dtype>& weight = *lazy->net()->learnable_params()[0];
+    vector<Dtype> previous(weight.cpu_data(),
+        weight.cpu_data() + weight.count());
+    const Dtype kEpsilon = 1e-5;
+    for (int step = 0; step < 3; ++step) {
+      const vector<Dtype> lazy_weights = Step(lazy.get(), ids[step]);
+      const vector<Dtype> dense_weights = Step(dense.get(), ids[step]);
+      for (int i = 0; i < lazy_weights.size(); ++i) {
+        const int row = i / row_size;
+        if (row != ids[step][0] && row != ids[step][1]) {
+          EXPECT_EQ(previous[i], lazy_weights[i]) << step << " " << i;
+        } else if (row == 1 || step < 2) {
+          EXPECT_NEAR(dense_weights[i], lazy_weights[i], kEpsilon)
+              << step << " " << i;
+        }
+        // The update was not skipped.
+        if (row == ids[step][0] || row == ids[step][1]) {
+          EXPECT_NE(previous[i], lazy_weights[i]) << step << " " << i;
+        }
+      }
+      previous = lazy_weights;
+    }
+  }
+};
+
+TYPED_TEST_CASE(SparseAdaptiveSolverTest, TestDtypes);
+
+TYPED_TEST(SparseAdaptiveSolverTest, TestNesterovLazyUpdate) {
+  this->TestLazyUpdate("Nesterov");
+}
+
+TYPED_TEST(SparseAdaptiveSolverTest, TestAdaGradLazyUpdate) {
+  this->TestLazyUpdate("AdaGrad");
+}
+
+TYPED_TEST(SparseAdaptiveSolverTest, TestRMSPropLazyUpdate) {
+  this->TestLazyUpdate("RMSProp");
+}
+
+TYPED_TEST(SparseAdaptiveSolverTest, TestAdamLazyUpdate) {
+  this->TestLazyUpdate("Adam");
+}
+
+template <typename Dtype>
+class FusedThreadedSolverTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Trains an inner product of 4 x 50000 weights, enough for the fused update
+  // to be split over 3 threads, and returns the learned weights.
+  vector<Dtype> Train(bool fused) {
+    const string proto =
+        "base_lr: 0.01 "
+        "lr_policy: 'fixed' "
+        "momentum: 0.9 "
+        "weight_decay: 0.01 "
+        "random_seed: 1701 "
+        "update_threads: 4 "
+        "net_param { "
+        "  layer { "
+        "    name: 'data' "
+        "    type: 'DummyData' "
+        "    dummy_data_param { "
+        "      shape { dim: 2 dim: 50000 } "
+        "      shape { dim: 2 dim: 4 } "
+        "      data_filler { type: 'gaussian' std: 0.01 } "
+        "      data_filler { type: 'gaussian' } "
+        "    } "
+        "    top: 'data' "
+        "    top: 'targets' "
+        "  } "
+        "  layer { "
+        "    name: 'ip' "
+        "    type: 'InnerProduct' "
+        "    inner_product_param { "
+        "      num_output: 4 "
+        "      weight_filler { type: 'gaussian' std: 0.1 } "
+        "    } "
+        "    bottom: 'data' "
+        "    top: 'ip' "
+        "  } "
+        "  layer { "
+        "    name: 'loss' "
+        "    type: 'EuclideanLoss' "
+        "    bottom: 'ip' "
+        "    bottom: 'targets' "
+        "  } "
+        "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.set_fused_update(fused);
+    SGDSolver<Dtype> solver(param);
+    solver.Step(3);
+    vector<Dtype> weights;
+    const vector<Blob<Dtype>*>& params = solver.net()->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      weights.insert(weights.end(), params[i]->cpu_data(),
+          params[i]->cpu_data() + params[i]->count());
+    }
+    return weights;
+  }
+};
+
+TYPED_TEST_CASE(FusedThreadedSolverTest, TestDtypes);
+
+TYPED_TEST(FusedThreadedSolverTest, TestThreadedUpdate) {
+  const vector<TypeParam> expected = this->Train(false);
+  const vector<TypeParam> weights = this->Train(true);
+  ASSERT_EQ(expected.size(), weights.size());
+  for (int i = 0; i < weights.size(); ++i) {
+    EXPECT_NEAR(expected[i], weights[i], 1e-5) << i;
+  }
+}
+
 }  // namespace caffe
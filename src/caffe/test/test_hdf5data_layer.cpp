@@ -86,8 +86,6 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   EXPECT_EQ(this->blob_top_label2_->shape(0), batch_size);
   EXPECT_EQ(this->blob_top_label2_->shape(1), 1);
 
-  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
-
   // Go through the data 10 times (5 batches).
   const int data_size = num_cols * height * width;
   for (int iter = 0; iter < 10; ++iter) {
@@ -133,4 +131,115 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestReadChunked) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  // Chunks of 3 rows split the batches and the 10 rows of each file
+  // unevenly; the rows still come out in order.
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 4;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_source(*(this->filename));
+  const int data_size = 8 * 6 * 5;
+
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int row = 0;
+  for (int iter = 0; iter < 10; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < batch_size; ++i, ++row) {
+      // The two files of 10 rows are read in turn.
+      const int file_row = row % 10;
+      const int file_offset = (row % 20 < 10) ? 0 : 2400;
+      EXPECT_EQ(1 + file_row, this->blob_top_label_->cpu_data()[i]);
+      EXPECT_EQ(2 + file_row, this->blob_top_label2_->cpu_data()[i]);
+      for (int j = 0; j < data_size; ++j) {
+        EXPECT_EQ(file_offset + file_row * data_size + j,
+            this->blob_top_data_->cpu_data()[i * data_size + j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffle) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_shuffle(true);
+  hdf5_data_param->set_shuffle_buffer_size(6);
+  hdf5_data_param->set_source(*(this->filename));
+  const int data_size = 8 * 6 * 5;
+
+  Caffe::set_random_seed(1701);
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int in_order = 0;
+  Dtype previous_label = 0;
+  for (int iter = 0; iter < 8; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < batch_size; ++i) {
+      // The rows of all tops are drawn together.
+      const Dtype label = this->blob_top_label_->cpu_data()[i];
+      ASSERT_GE(label, 1);
+      ASSERT_LE(label, 10);
+      EXPECT_EQ(label + 1, this->blob_top_label2_->cpu_data()[i]);
+      const Dtype* data = this->blob_top_data_->cpu_data() + i * data_size;
+      const int file_offset = data[0] < 2400 ? 0 : 2400;
+      for (int j = 0; j < data_size; ++j) {
+        EXPECT_EQ(file_offset + (label - 1) * data_size + j, data[j]);
+      }
+      in_order += label == previous_label + 1;
+      previous_label = label;
+    }
+  }
+  EXPECT_LT(in_order, 8 * batch_size / 2);
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffleBufferCapped) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_shuffle(true);
+  // More than the 20 rows of the two files.
+  hdf5_data_param->set_shuffle_buffer_size(100);
+  hdf5_data_param->set_source(*(this->filename));
+  const int data_size = 8 * 6 * 5;
+
+  Caffe::set_random_seed(1701);
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The buffer holds each row once, and over the first 20 rows drawn at most
+  // one more copy of each row comes in from the next pass over the source.
+  vector<int> count(20, 0);
+  for (int iter = 0; iter < 20 / batch_size; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < batch_size; ++i) {
+      const int label = this->blob_top_label_->cpu_data()[i];
+      ASSERT_GE(label, 1);
+      ASSERT_LE(label, 10);
+      const int file = this->blob_top_data_->cpu_data()[i * data_size] < 2400 ?
+          0 : 1;
+      EXPECT_LE(++count[file * 10 + label - 1], 2);
+    }
+  }
+}
+
 }  // namespace caffe
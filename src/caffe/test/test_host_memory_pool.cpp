@@ -0,0 +1,110 @@
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostMemoryPoolTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Pinned GPU-mode host memory does not come from the pool.
+    Caffe::set_mode(Caffe::CPU);
+    HostMemoryPool::set_enabled(true);
+    HostMemoryPool::Trim();
+  }
+  virtual void TearDown() {
+    HostMemoryPool::set_enabled(true);
+    HostMemoryPool::set_max_cached_bytes(size_t(1) << 30);
+  }
+};
+
+TEST_F(HostMemoryPoolTest, TestSizeClass) {
+  EXPECT_EQ(64, HostMemoryPool::SizeClass(0));
+  EXPECT_EQ(64, HostMemoryPool::SizeClass(64));
+  EXPECT_EQ(128, HostMemoryPool::SizeClass(65));
+  EXPECT_EQ(1024, HostMemoryPool::SizeClass(1000));
+  EXPECT_EQ(5120, HostMemoryPool::SizeClass(4097));
+  for (size_t size = 1; size < (1 << 20); size = size * 3 / 2 + 1) {
+    const size_t bytes = HostMemoryPool::SizeClass(size);
+    EXPECT_GE(bytes, size);
+    EXPECT_EQ(0, bytes % HostMemoryPool::kAlignment);
+    EXPECT_LE(bytes, size * 5 / 4 + HostMemoryPool::kAlignment);
+  }
+}
+
+TEST_F(HostMemoryPoolTest, TestAlignmentAndReuse) {
+  const HostMemoryPool::Stats before = HostMemoryPool::stats();
+  void* ptr = HostMemoryPool::Allocate(1000);
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % HostMemoryPool::kAlignment);
+  memset(ptr, 1, 1000);
+  HostMemoryPool::Free(ptr, 1000);
+  HostMemoryPool::Stats stats = HostMemoryPool::stats();
+  EXPECT_EQ(before.misses + 1, stats.misses);
+  EXPECT_EQ(1024, stats.cached_bytes);
+  // A request of the same size class gets the cached block back.
+  void* reused = HostMemoryPool::Allocate(990);
+  EXPECT_EQ(ptr, reused);
+  stats = HostMemoryPool::stats();
+  EXPECT_EQ(before.hits + 1, stats.hits);
+  EXPECT_EQ(0, stats.cached_bytes);
+  EXPECT_EQ(before.in_use_bytes + 1024, stats.in_use_bytes);
+  EXPECT_GE(stats.peak_bytes, stats.in_use_bytes);
+  HostMemoryPool::Free(reused, 990);
+  HostMemoryPool::Trim();
+  EXPECT_EQ(0, HostMemoryPool::stats().cached_bytes);
+}
+
+TEST_F(HostMemoryPoolTest, TestLargeBlocks) {
+  HostMemoryPool::set_use_huge_pages(true);
+  const size_t size = 3 * HostMemoryPool::kHugePageSize + 1;
+  char* ptr = static_cast<char*>(HostMemoryPool::Allocate(size));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(ptr) % HostMemoryPool::kAlignment);
+  ptr[0] = 1;
+  ptr[size - 1] = 1;
+  HostMemoryPool::Free(ptr, size);
+  HostMemoryPool::set_use_huge_pages(false);
+  EXPECT_EQ(HostMemoryPool::SizeClass(size),
+            HostMemoryPool::stats().cached_bytes);
+}
+
+TEST_F(HostMemoryPoolTest, TestDisabledAndLimit) {
+  HostMemoryPool::set_enabled(false);
+  void* ptr = HostMemoryPool::Allocate(100);
+  HostMemoryPool::Free(ptr, 100);
+  EXPECT_EQ(0, HostMemoryPool::stats().cached_bytes);
+  HostMemoryPool::set_enabled(true);
+  HostMemoryPool::set_max_cached_bytes(128);
+  void* first = HostMemoryPool::Allocate(100);
+  void* second = HostMemoryPool::Allocate(100);
+  HostMemoryPool::Free(first, 100);
+  HostMemoryPool::Free(second, 100);
+  EXPECT_EQ(128, HostMemoryPool::stats().cached_bytes);
+}
+
+TEST_F(HostMemoryPoolTest, TestSyncedMemoryReuse) {
+  const HostMemoryPool::Stats before = HostMemoryPool::stats();
+  void* first_ptr;
+  {
+    SyncedMemory mem(4000);
+    first_ptr = mem.mutable_cpu_data();
+    memset(first_ptr, 2, 4000);
+  }
+  SyncedMemory mem(4000);
+  EXPECT_EQ(first_ptr, mem.cpu_data());
+  // Reused memory is still zero-initialized.
+  const char* data = static_cast<const char*>(mem.cpu_data());
+  for (int i = 0; i < 4000; ++i) {
+    EXPECT_EQ(0, data[i]);
+  }
+  EXPECT_EQ(before.hits + 1, HostMemoryPool::stats().hits);
+}
+
+}  // namespace caffe
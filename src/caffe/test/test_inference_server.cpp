@@ -0,0 +1,260 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_server.hpp"
+#include "caffe/net_pool.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// A client of the server, sending requests of items of a given size.
+class InferenceClient {
+ public:
+  explicit InferenceClient(const string& unix_path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, unix_path.c_str(), sizeof(addr.sun_path) - 1);
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK_EQ(connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)),
+        0);
+  }
+  explicit InferenceClient(int port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_EQ(connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)),
+        0);
+  }
+  ~InferenceClient() { close(fd_); }
+
+  // Returns the status, and the outputs on success.
+  uint32_t Infer(uint32_t num, const vector<float>& input, int num_outputs,
+      vector<vector<float> >* outputs) {
+    CHECK_EQ(send(fd_, &num, sizeof(num), 0), sizeof(num));
+    if (!input.empty()) {
+      const size_t size = input.size() * sizeof(float);
+      CHECK_EQ(send(fd_, &input[0], size, 0), size);
+    }
+    uint32_t status;
+    Read(&status, sizeof(status));
+    if (status != 0) {
+      return status;
+    }
+    outputs->resize(num_outputs);
+    for (int i = 0; i < num_outputs; ++i) {
+      uint32_t count;
+      Read(&count, sizeof(count));
+      (*outputs)[i].resize(count);
+      Read(&(*outputs)[i][0], count * sizeof(float));
+    }
+    return status;
+  }
+
+ private:
+  void Read(void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+      ssize_t n = recv(fd_, p, size, 0);
+      CHECK_GT(n, 0) << "Connection closed";
+      p += n;
+      size -= n;
+    }
+  }
+
+  int fd_;
+};
+
+class InferenceServerTest : public ::testing::Test {
+ protected:
+  InferenceServerTest() : seed_(1701) {}
+
+  virtual void SetUp() {
+    const string proto =
+        "name: 'InferenceServerNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 1 dim: 3 dim: 4 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'innerprod' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 7 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerprod' "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'innerprod' "
+        "  top: 'prob' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    param_.mutable_state()->set_phase(TEST);
+    Caffe::set_random_seed(seed_);
+    pool_.reset(new NetPool<float>(param_, "", 2));
+  }
+
+  // Returns the outputs of the first net for the input items.
+  vector<float> Expected(const string& blob_name, int num,
+      const vector<float>& input) {
+    Net<float>* net = pool_->Acquire();
+    Blob<float>* data = net->input_blobs()[0];
+    data->Reshape(num, 3, 4, 5);
+    caffe_copy(input.size(), &input[0], data->mutable_cpu_data());
+    net->Forward();
+    const Blob<float>& blob = *net->blob_by_name(blob_name);
+    vector<float> expected(blob.cpu_data(), blob.cpu_data() + blob.count());
+    pool_->Release(net);
+    return expected;
+  }
+
+  vector<float> RandomInput(int num) {
+    Blob<float> blob(num, 3, 4, 5);
+    FillerParameter filler_param;
+    GaussianFiller<float> filler(filler_param);
+    filler.Fill(&blob);
+    return vector<float>(blob.cpu_data(), blob.cpu_data() + blob.count());
+  }
+
+  int seed_;
+  NetParameter param_;
+  shared_ptr<NetPool<float> > pool_;
+};
+
+// Sends the requests one after the other, checking the outputs.
+static void RunClient(InferenceClient* client,
+    const vector<vector<float> >* inputs,
+    const vector<vector<float> >* expected, int* errors) {
+  for (int i = 0; i < inputs->size(); ++i) {
+    vector<vector<float> > outputs;
+    const int num = (*inputs)[i].size() / 60;
+    if (client->Infer(num, (*inputs)[i], 1, &outputs) != 0 ||
+        outputs[0].size() != (*expected)[i].size()) {
+      ++*errors;
+      continue;
+    }
+    for (int j = 0; j < outputs[0].size(); ++j) {
+      *errors += fabs(outputs[0][j] - (*expected)[i][j]) > 1e-5;
+    }
+  }
+}
+
+TEST_F(InferenceServerTest, TestUnixSocket) {
+  string temp_dir;
+  MakeTempDir(&temp_dir);
+  const string path = temp_dir + "/server.sock";
+  InferenceServer server(pool_.get(), vector<string>(), 8, 1000);
+  server.Listen("unix:" + path);
+  InferenceClient client(path);
+  const vector<float> input = this->RandomInput(3);
+  vector<vector<float> > outputs;
+  EXPECT_EQ(0, client.Infer(3, input, 1, &outputs));
+  // The outputs of the net, here the softmax.
+  const vector<float> expected = this->Expected("prob", 3, input);
+  ASSERT_EQ(expected.size(), outputs[0].size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected[i], outputs[0][i], 1e-5);
+  }
+  // Requests larger than a batch are refused.
+  EXPECT_EQ(1, client.Infer(9, vector<float>(), 1, &outputs));
+}
+
+TEST_F(InferenceServerTest, TestDynamicBatching) {
+  vector<string> outputs(1, "innerprod");
+  // The clients send requests of 1, 2, 3 and 1 items at a time, together the
+  // max batch size. With a delay far longer than the test, a batch is only
+  // run once full, so each round of requests is exactly one batch.
+  const int num_clients = 4;
+  const int num_requests = 5;
+  InferenceServer server(pool_.get(), outputs, 7, 10000000);
+  server.Listen("tcp:0");
+  vector<shared_ptr<InferenceClient> > clients;
+  vector<vector<vector<float> > > inputs(num_clients);
+  vector<vector<vector<float> > > expected(num_clients);
+  for (int c = 0; c < num_clients; ++c) {
+    clients.push_back(shared_ptr<InferenceClient>(
+        new InferenceClient(server.port())));
+    for (int i = 0; i < num_requests; ++i) {
+      const int num = 1 + c % 3;
+      inputs[c].push_back(this->RandomInput(num));
+      expected[c].push_back(this->Expected("innerprod", num, inputs[c][i]));
+    }
+  }
+  InferenceServerStats stats;
+  server.TakeStats(&stats);
+  vector<int> errors(num_clients, 0);
+  boost::thread_group threads;
+  for (int c = 0; c < num_clients; ++c) {
+    threads.create_thread(boost::bind(&RunClient, clients[c].get(),
+        &inputs[c], &expected[c], &errors[c]));
+  }
+  threads.join_all();
+  for (int c = 0; c < num_clients; ++c) {
+    EXPECT_EQ(0, errors[c]);
+  }
+  server.TakeStats(&stats);
+  EXPECT_EQ(num_clients * num_requests, stats.requests);
+  int items = 0;
+  for (int c = 0; c < num_clients; ++c) {
+    for (int i = 0; i < num_requests; ++i) {
+      items += inputs[c][i].size() / 60;
+    }
+  }
+  EXPECT_EQ(items, stats.items);
+  EXPECT_EQ(num_requests, stats.batches);
+  EXPECT_LE(stats.p50_ms, stats.p99_ms);
+}
+
+TEST_F(InferenceServerTest, TestFailedBatch) {
+  // The output has an item per input item for the single item of the net as
+  // loaded, but always a single item.
+  LayerParameter* flatten = param_.add_layer();
+  flatten->set_name("flatten");
+  flatten->set_type("Reshape");
+  flatten->add_bottom("innerprod");
+  flatten->add_top("flat");
+  flatten->mutable_reshape_param()->mutable_shape()->add_dim(1);
+  flatten->mutable_reshape_param()->mutable_shape()->add_dim(-1);
+  pool_.reset(new NetPool<float>(param_, "", 1));
+  InferenceServer server(pool_.get(), vector<string>(1, "flat"), 8, 0);
+  server.Listen("tcp:0");
+  InferenceClient client(server.port());
+  vector<vector<float> > outputs;
+  // A batch of 3 items fails, and the server still serves the next request.
+  EXPECT_EQ(2, client.Infer(3, this->RandomInput(3), 1, &outputs));
+  const vector<float> input = this->RandomInput(1);
+  ASSERT_EQ(0, client.Infer(1, input, 1, &outputs));
+  const vector<float> expected = this->Expected("flat", 1, input);
+  ASSERT_EQ(expected.size(), outputs[0].size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected[i], outputs[0][i], 1e-5);
+  }
+}
+
+}  // namespace caffe
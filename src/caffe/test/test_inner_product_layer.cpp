@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -208,6 +211,125 @@ TYPED_TEST(InnerProductLayerTest, TestForwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("uniform");
+    shared_ptr<InnerProductLayer<Dtype> > layer(
+        new InnerProductLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> ref_top;
+    ref_top.CopyFrom(*this->blob_top_, false, true);
+    // The same weights with int8 precision, once with a calibrated bottom
+    // scale (the bottom is uniform in [0, 1]) and once with a dynamic one.
+    for (int dynamic = 0; dynamic < 2; ++dynamic) {
+      QuantizationParameter* quant_param =
+          layer_param.mutable_quantization_param();
+      quant_param->set_precision(QuantizationParameter_Precision_INT8);
+      quant_param->set_bottom_scale(dynamic ? 0 : 127);
+      shared_ptr<InnerProductLayer<Dtype> > int8_layer(
+          new InnerProductLayer<Dtype>(layer_param));
+      int8_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < layer->blobs().size(); ++i) {
+        int8_layer->blobs()[i]->CopyFrom(*layer->blobs()[i]);
+      }
+      int8_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      const Dtype* data = this->blob_top_->cpu_data();
+      const Dtype* ref_data = ref_top.cpu_data();
+      const Dtype tolerance = 0.03 * ref_top.asum_data() / ref_top.count()
+          + 0.03;
+      for (int i = 0; i < ref_top.count(); ++i) {
+        EXPECT_NEAR(data[i], ref_data[i], tolerance);
+      }
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8WeightsChangedInPlace) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_bias_term(false);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  layer_param.mutable_quantization_param()->set_precision(
+      QuantizationParameter_Precision_INT8);
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> first_top;
+  first_top.CopyFrom(*this->blob_top_, false, true);
+  // Doubling the weights in place keeps their pointer, but not the output.
+  caffe_scal(layer.blobs()[0]->count(), Dtype(2),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < first_top.count(); ++i) {
+    EXPECT_NEAR(2 * first_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+        1e-4);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardInt8LoadedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    LOG(ERROR) << "Skipping test: INT8 precision is CPU only.";
+    return;
+  }
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  const int M = this->blob_bottom_->num();
+  const int N = 10;
+  const int K = this->blob_bottom_->count(1);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(N);
+  inner_product_param->set_bias_term(false);
+  QuantizationParameter* quant_param = layer_param.mutable_quantization_param();
+  quant_param->set_precision(QuantizationParameter_Precision_INT8);
+  quant_param->set_bottom_scale(127);
+  // Int8 weights in [-50, 50] with a scale of 10 + n for output n, which
+  // quantizing their float values again would not give back.
+  BlobProto* weights = layer_param.add_blobs();
+  weights->mutable_shape()->add_dim(N);
+  weights->mutable_shape()->add_dim(K);
+  string weight_int8(N * K, 0);
+  for (int i = 0; i < N * K; ++i) {
+    weight_int8[i] = static_cast<char>(i % 101 - 50);
+  }
+  weights->set_int8_data(weight_int8);
+  for (int n = 0; n < N; ++n) {
+    weights->add_int8_scale(10 + n);
+  }
+  InnerProductLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* bottom = this->blob_bottom_->cpu_data();
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      int sum = 0;
+      for (int k = 0; k < K; ++k) {
+        const int bottom_int8 = std::floor(bottom[m * K + k] * 127 + 0.5);
+        sum += static_cast<signed char>(weight_int8[n * K + k]) * bottom_int8;
+      }
+      const Dtype expected = sum / (Dtype(127) * (10 + n));
+      EXPECT_NEAR(expected, this->blob_top_->cpu_data()[m * N + n],
+          1e-5 * std::max(Dtype(1), std::fabs(expected)));
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_nobatch_);
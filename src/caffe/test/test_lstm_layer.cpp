@@ -285,4 +285,92 @@ TYPED_TEST(LSTMLayerTest, TestGradientNonZeroContBufferSize2WithStaticInput) {
 }
 
 
+TYPED_TEST(LSTMLayerTest, TestFusedMatchesUnrolled) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBlobs(3, 2);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  LSTMLayer<Dtype> unrolled(this->layer_param_);
+  unrolled.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->layer_param_.mutable_recurrent_param()->set_engine(
+      RecurrentParameter_Engine_FUSED);
+  LSTMLayer<Dtype> fused(this->layer_param_);
+  Blob<Dtype> fused_top;
+  vector<Blob<Dtype>*> fused_top_vec(1, &fused_top);
+  fused.SetUp(this->blob_bottom_vec_, fused_top_vec);
+  // Both engines have the same parameters.
+  ASSERT_EQ(unrolled.blobs().size(), fused.blobs().size());
+  for (int i = 0; i < fused.blobs().size(); ++i) {
+    ASSERT_TRUE(unrolled.blobs()[i]->shape() == fused.blobs()[i]->shape());
+    fused.blobs()[i]->CopyFrom(*unrolled.blobs()[i]);
+  }
+  // Two batches, the second starting from the hidden state of the first.
+  const Dtype kEpsilon = 1e-4;
+  for (int batch = 0; batch < 2; ++batch) {
+    unrolled.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    fused.Forward(this->blob_bottom_vec_, fused_top_vec);
+    ASSERT_TRUE(this->blob_top_.shape() == fused_top.shape());
+    for (int i = 0; i < fused_top.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_.cpu_data()[i], fused_top.cpu_data()[i],
+          kEpsilon) << "batch = " << batch << "; i = " << i;
+    }
+  }
+  // The same gradients from the same top diff.
+  Blob<Dtype> top_diff(fused_top.shape());
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_.mutable_cpu_diff());
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      fused_top.mutable_cpu_diff());
+  vector<bool> propagate_down(3, true);
+  propagate_down[1] = false;
+  unrolled.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  Blob<Dtype> bottom_diff, static_diff;
+  bottom_diff.CopyFrom(this->blob_bottom_, true, true);
+  static_diff.CopyFrom(this->blob_bottom_static_, true, true);
+  fused.Backward(fused_top_vec, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < bottom_diff.count(); ++i) {
+    EXPECT_NEAR(bottom_diff.cpu_diff()[i], this->blob_bottom_.cpu_diff()[i],
+        kEpsilon);
+  }
+  for (int i = 0; i < static_diff.count(); ++i) {
+    EXPECT_NEAR(static_diff.cpu_diff()[i],
+        this->blob_bottom_static_.cpu_diff()[i], kEpsilon);
+  }
+  for (int i = 0; i < fused.blobs().size(); ++i) {
+    const Blob<Dtype>& expected = *unrolled.blobs()[i];
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_diff()[j], fused.blobs()[i]->cpu_diff()[j],
+          kEpsilon) << "param " << i << "; j = " << j;
+    }
+  }
+}
+
+TYPED_TEST(LSTMLayerTest, TestFusedGradientNonZeroContWithStaticInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBlobs(2, 2);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  this->layer_param_.mutable_recurrent_param()->set_engine(
+      RecurrentParameter_Engine_FUSED);
+  LSTMLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 2);
+}
+
 }  // namespace caffe
@@ -0,0 +1,181 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/margin_softmax_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class MarginSoftmaxLossLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // 2 x 4 samples of 5 features, the features from axis 2 on.
+  MarginSoftmaxLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(2, 4, 5, 1)),
+        blob_bottom_label_(new Blob<Dtype>(2, 4, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    // Features of unequal norms, which the cosines do not depend on.
+    const int num = blob_bottom_label_->count();
+    const int dim = blob_bottom_data_->count(2);
+    for (int i = 0; i < num; ++i) {
+      caffe_scal(dim, Dtype(i + 1),
+          blob_bottom_data_->mutable_cpu_data() + i * dim);
+    }
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    // Eight different classes, in all three blocks.
+    for (int i = 0; i < num; ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = (3 * i) % kNumClasses;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    MarginSoftmaxParameter* param =
+        layer_param_.mutable_margin_softmax_param();
+    param->set_num_output(kNumClasses);
+    param->set_axis(2);
+    // Blocks of 4 of the 10 classes, the last one partial.
+    param->set_block_size(4);
+    param->set_scale(4);
+    param->set_margin(0.3);
+    param->mutable_weight_filler()->set_type("gaussian");
+  }
+  virtual ~MarginSoftmaxLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  // The loss with the params of layer, computed class by class.
+  Dtype ReferenceLoss(Layer<Dtype>* layer, bool angular) {
+    const Dtype* weight = layer->blobs()[0]->cpu_data();
+    const int num = blob_bottom_label_->count();
+    const int dim = blob_bottom_data_->count(2);
+    const Dtype scale = 4;
+    const Dtype margin = 0.3;
+    Dtype loss = 0;
+    for (int i = 0; i < num; ++i) {
+      const Dtype* x = blob_bottom_data_->cpu_data() + i * dim;
+      const int label = blob_bottom_label_->cpu_data()[i];
+      Dtype sum = 0;
+      Dtype target_logit = 0;
+      for (int c = 0; c < kNumClasses; ++c) {
+        const Dtype* w = weight + c * dim;
+        const Dtype cosine = caffe_cpu_dot(dim, x, w) /
+            std::sqrt(caffe_cpu_dot(dim, x, x) * caffe_cpu_dot(dim, w, w));
+        Dtype logit = scale * cosine;
+        if (c == label) {
+          if (!angular) {
+            logit = scale * (cosine - margin);
+          } else if (cosine > -std::cos(margin)) {
+            logit = scale * std::cos(std::acos(cosine) + margin);
+          } else {
+            logit = scale * (cosine - margin * std::sin(margin));
+          }
+          target_logit = logit;
+        }
+        sum += std::exp(logit);
+      }
+      loss += std::log(sum) - target_logit;
+    }
+    return loss / num;
+  }
+
+  // Turns samples 0 and 5 nearly opposite to the weight of their label,
+  // where the ANGULAR margin falls back to cos(theta) - m sin(m).
+  void OpposeTargetWeights(Layer<Dtype>* layer) {
+    const Dtype* weight = layer->blobs()[0]->cpu_data();
+    const int dim = blob_bottom_data_->count(2);
+    const int samples[2] = {0, 5};
+    for (int k = 0; k < 2; ++k) {
+      const int i = samples[k];
+      Dtype* x = blob_bottom_data_->mutable_cpu_data() + i * dim;
+      const Dtype* w =
+          weight + static_cast<int>(blob_bottom_label_->cpu_data()[i]) * dim;
+      // -w, off by a little of the original feature.
+      const Dtype ratio = std::sqrt(caffe_cpu_dot(dim, w, w) /
+          caffe_cpu_dot(dim, x, x));
+      caffe_cpu_axpby(dim, Dtype(-1), w, Dtype(0.05) * ratio, x);
+      const Dtype cosine = caffe_cpu_dot(dim, x, w) /
+          std::sqrt(caffe_cpu_dot(dim, x, x) * caffe_cpu_dot(dim, w, w));
+      ASSERT_LE(cosine, -std::cos(Dtype(0.3)));
+    }
+  }
+
+  static const int kNumClasses = 10;
+  LayerParameter layer_param_;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MarginSoftmaxLossLayerTest, TestDtypes);
+
+TYPED_TEST(MarginSoftmaxLossLayerTest, TestForwardAdditive) {
+  MarginSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(&layer, false),
+      this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(MarginSoftmaxLossLayerTest, TestForwardAngular) {
+  this->layer_param_.mutable_margin_softmax_param()->set_margin_type(
+      MarginSoftmaxParameter_MarginType_ANGULAR);
+  MarginSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(&layer, true),
+      this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(MarginSoftmaxLossLayerTest, TestForwardAngularFallback) {
+  this->layer_param_.mutable_margin_softmax_param()->set_margin_type(
+      MarginSoftmaxParameter_MarginType_ANGULAR);
+  MarginSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->OpposeTargetWeights(&layer);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(&layer, true),
+      this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(MarginSoftmaxLossLayerTest, TestGradientAdditive) {
+  MarginSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(MarginSoftmaxLossLayerTest, TestGradientAngular) {
+  this->layer_param_.mutable_margin_softmax_param()->set_margin_type(
+      MarginSoftmaxParameter_MarginType_ANGULAR);
+  MarginSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(MarginSoftmaxLossLayerTest, TestGradientAngularFallback) {
+  this->layer_param_.mutable_margin_softmax_param()->set_margin_type(
+      MarginSoftmaxParameter_MarginType_ANGULAR);
+  MarginSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->OpposeTargetWeights(&layer);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
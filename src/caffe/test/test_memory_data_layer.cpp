@@ -2,6 +2,7 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
@@ -115,6 +116,62 @@ TYPED_TEST(MemoryDataLayerTest, TestForward) {
   }
 }
 
+// Fills the slots of layer with the batches of data and labels in order.
+template <typename Dtype>
+void FillBatchSlots(MemoryDataLayer<Dtype>* layer, const Blob<Dtype>* data,
+    const Blob<Dtype>* labels) {
+  const int batch_size = layer->batch_size();
+  for (int n = 0; n < data->num(); n += batch_size) {
+    Batch<Dtype>* batch = layer->ReserveBatch();
+    caffe_copy(batch->data_.count(), data->cpu_data() + data->offset(n),
+        batch->data_.mutable_cpu_data());
+    caffe_copy(batch_size, labels->cpu_data() + n,
+        batch->label_.mutable_cpu_data());
+    layer->CommitBatch(batch);
+  }
+}
+
+TYPED_TEST(MemoryDataLayerTest, TestRingForward) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_ring_size(2);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The tops point at the slot that was committed.
+  Batch<Dtype>* batch = layer.ReserveBatch();
+  caffe_set(batch->data_.count(), Dtype(3), batch->data_.mutable_cpu_data());
+  caffe_set(this->batch_size_, Dtype(5), batch->label_.mutable_cpu_data());
+  layer.CommitBatch(batch);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(batch->data_.cpu_data(), this->data_blob_->cpu_data());
+  EXPECT_EQ(batch->label_.cpu_data(), this->label_blob_->cpu_data());
+  EXPECT_EQ(Dtype(3), this->data_blob_->cpu_data()[0]);
+  EXPECT_EQ(Dtype(5), this->label_blob_->cpu_data()[0]);
+  // A producer thread running ahead of Forward by at most the two slots.
+  boost::thread producer(&FillBatchSlots<Dtype>, &layer, this->data_,
+      this->labels_);
+  for (int i = 0; i < this->batches_; ++i) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(this->batch_size_, this->data_blob_->num());
+    const Dtype* expected =
+        this->data_->cpu_data() + this->data_->offset(this->batch_size_ * i);
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(expected[j], this->data_blob_->cpu_data()[j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * i + j]);
+    }
+  }
+  producer.join();
+}
+
 #ifdef USE_OPENCV
 TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   typedef typename TypeParam::Dtype Dtype;
@@ -0,0 +1,133 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Runs the inputs begin, begin + step, ... through nets of the pool.
+template <typename Dtype>
+void RunNetPool(NetPool<Dtype>* pool,
+    const vector<shared_ptr<Blob<Dtype> > >* inputs,
+    vector<vector<Dtype> >* outputs, int begin, int step) {
+  for (int i = begin; i < inputs->size(); i += step) {
+    Net<Dtype>* net = pool->Acquire();
+    net->input_blobs()[0]->CopyFrom(*(*inputs)[i]);
+    const Blob<Dtype>* top = net->Forward()[0];
+    (*outputs)[i].assign(top->cpu_data(), top->cpu_data() + top->count());
+    pool->Release(net);
+  }
+}
+
+template <typename Dtype>
+class NetPoolTest : public ::testing::Test {
+ protected:
+  NetPoolTest() : seed_(1701) {}
+
+  virtual void SetUp() {
+    const string proto =
+        "name: 'NetPoolNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'innerprod' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 7 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'conv' "
+        "  top: 'innerprod' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    param_.mutable_state()->set_phase(TEST);
+  }
+
+  int seed_;
+  NetParameter param_;
+};
+
+TYPED_TEST_CASE(NetPoolTest, TestDtypes);
+
+TYPED_TEST(NetPoolTest, TestSharedWeights) {
+  NetPool<TypeParam> pool(this->param_, "", 3);
+  EXPECT_EQ(3, pool.size());
+  vector<Net<TypeParam>*> nets;
+  for (int i = 0; i < pool.size(); ++i) {
+    nets.push_back(pool.Acquire());
+  }
+  EXPECT_TRUE(pool.TryAcquire() == NULL);
+  const vector<shared_ptr<Blob<TypeParam> > >& params =
+      pool.weights_net()->params();
+  for (int i = 0; i < nets.size(); ++i) {
+    ASSERT_EQ(params.size(), nets[i]->params().size());
+    for (int j = 0; j < params.size(); ++j) {
+      EXPECT_EQ(params[j]->cpu_data(), nets[i]->params()[j]->cpu_data());
+    }
+    // Each net has its own activations.
+    for (int j = 0; j < i; ++j) {
+      EXPECT_NE(nets[i]->blobs()[1]->cpu_data(),
+          nets[j]->blobs()[1]->cpu_data());
+    }
+  }
+  pool.Release(nets[1]);
+  EXPECT_EQ(nets[1], pool.TryAcquire());
+}
+
+TYPED_TEST(NetPoolTest, TestConcurrentForward) {
+  Caffe::set_random_seed(this->seed_);
+  NetPool<TypeParam> pool(this->param_, "", 2);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  const int num_inputs = 16;
+  vector<shared_ptr<Blob<TypeParam> > > inputs;
+  for (int i = 0; i < num_inputs; ++i) {
+    inputs.push_back(shared_ptr<Blob<TypeParam> >(
+        new Blob<TypeParam>(2, 3, 4, 5)));
+    filler.Fill(inputs[i].get());
+  }
+  // The outputs of a single thread, then of four threads sharing the pool.
+  vector<vector<TypeParam> > expected(num_inputs);
+  RunNetPool(&pool, &inputs, &expected, 0, 1);
+  vector<vector<TypeParam> > outputs(num_inputs);
+  boost::thread_group threads;
+  const int num_threads = 4;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.create_thread(boost::bind(&RunNetPool<TypeParam>, &pool,
+        &inputs, &outputs, i, num_threads));
+  }
+  threads.join_all();
+  for (int i = 0; i < num_inputs; ++i) {
+    ASSERT_EQ(expected[i].size(), outputs[i].size());
+    for (int j = 0; j < expected[i].size(); ++j) {
+      EXPECT_EQ(expected[i][j], outputs[i][j]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,139 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/net_profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class NetProfilerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void SetUp() {
+    const string proto =
+        "name: 'ProfiledNet' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 3 dim: 5 dim: 5 } "
+        "    data_filler { type: 'gaussian' } "
+        "    shape { dim: 4 dim: 10 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 2 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(NetProfilerTest, TestDtypesAndDevices);
+
+TYPED_TEST(NetProfilerTest, TestStats) {
+  typedef typename TypeParam::Dtype Dtype;
+  EXPECT_FALSE(this->net_->profiler());
+  this->net_->set_profiling(true);
+  for (int i = 0; i < 3; ++i) {
+    this->net_->ForwardBackward();
+  }
+  this->net_->set_profiling(false);
+  this->net_->ForwardBackward();
+  const vector<typename NetProfiler<Dtype>::LayerStats>& stats =
+      this->net_->profiler()->stats();
+  ASSERT_EQ(4, stats.size());
+  for (int i = 0; i < stats.size(); ++i) {
+    EXPECT_EQ(this->net_->layer_names()[i], stats[i].name);
+    EXPECT_EQ(3, stats[i].forward_count);
+    EXPECT_GE(stats[i].forward_ms, 0);
+  }
+  // The data layer needs no backward; the others do.
+  EXPECT_EQ(0, stats[0].backward_count);
+  EXPECT_EQ(0, stats[0].forward_flops);
+  EXPECT_EQ(3, stats[1].backward_count);
+  EXPECT_EQ(3, stats[3].backward_count);
+  // conv: 4 x 2 x 3 x 3 outputs, each a 3 x 3 x 3 dot product.
+  EXPECT_EQ(3 * 2. * (4 * 2 * 3 * 3) * 27, stats[1].forward_flops);
+  // ip: a 4 x 18 by 18 x 10 product.
+  EXPECT_EQ(3 * 2. * 4 * 18 * 10, stats[2].forward_flops);
+  EXPECT_EQ(2 * stats[2].forward_flops, stats[2].backward_flops);
+  // Forward reads the bottom and the params; backward also reads the top.
+  const int param_count = 10 * 18 + 10;
+  EXPECT_EQ(3 * (2 * (4 * 18 + param_count) + 4 * 10) * sizeof(Dtype),
+            stats[2].bytes_read);
+  EXPECT_EQ(2 * (4 * 10 + param_count) * sizeof(Dtype),
+            stats[2].memory_bytes);
+  const string summary = this->net_->profiler()->Summary();
+  EXPECT_NE(string::npos, summary.find("InnerProduct"));
+  this->net_->profiler()->Reset();
+  EXPECT_EQ(0, this->net_->profiler()->stats()[1].forward_count);
+}
+
+TYPED_TEST(NetProfilerTest, TestChromeTrace) {
+  this->net_->set_profiling(true);
+  this->net_->ForwardBackward();
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->profiler()->WriteChromeTrace(filename);
+  std::ifstream in(filename.c_str());
+  std::stringstream trace;
+  trace << in.rdbuf();
+  const string json = trace.str();
+  EXPECT_EQ(0, json.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["));
+  // Four forward calls and three backward calls.
+  int num_events = 0;
+  for (size_t pos = json.find("\"ph\": \"X\""); pos != string::npos;
+       pos = json.find("\"ph\": \"X\"", pos + 1)) {
+    ++num_events;
+  }
+  EXPECT_EQ(7, num_events);
+  EXPECT_NE(string::npos,
+            json.find("{\"name\": \"conv\", \"cat\": \"backward\""));
+  EXPECT_EQ("]}\n", json.substr(json.size() - 3));
+}
+
+}  // namespace caffe
@@ -0,0 +1,281 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/batch_triplet_loss_layer.hpp"
+#include "caffe/layers/pairwise_distance_layer.hpp"
+#include "caffe/layers/retrieval_accuracy_layer.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class PairwiseDistanceLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Features over several axes, which the distances flatten.
+  PairwiseDistanceLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(9, 2, 2, 1)),
+        blob_bottom_label_(new Blob<Dtype>(9, 1, 1, 1)),
+        blob_top_dist_(new Blob<Dtype>()),
+        blob_top_same_(new Blob<Dtype>()),
+        blob_top_different_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    // Groups of the same label, as BatchTripletLossLayer expects them, of
+    // unequal sizes: 3, 1, 2 and 3, the last of the label of the first.
+    const int group_end[4] = {3, 4, 6, 9};
+    const int group_label[4] = {5, 2, 0, 5};
+    for (int i = 0, group = 0; i < blob_bottom_label_->count(); ++i) {
+      if (i == group_end[group]) { ++group; }
+      blob_bottom_label_->mutable_cpu_data()[i] = group_label[group];
+    }
+    blob_top_vec_.push_back(blob_top_dist_);
+  }
+  virtual ~PairwiseDistanceLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_dist_;
+    delete blob_top_same_;
+    delete blob_top_different_;
+  }
+
+  void TestForward(PairwiseDistanceParameter_Metric metric) {
+    LayerParameter layer_param;
+    layer_param.mutable_pairwise_distance_param()->set_metric(metric);
+    PairwiseDistanceLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    const int num = blob_bottom_data_->num();
+    const int dim = blob_bottom_data_->count(1);
+    EXPECT_EQ(num, blob_top_dist_->num());
+    EXPECT_EQ(num, blob_top_dist_->channels());
+    for (int i = 0; i < num; ++i) {
+      const Dtype* x = blob_bottom_data_->cpu_data() + i * dim;
+      for (int j = 0; j < num; ++j) {
+        const Dtype* y = blob_bottom_data_->cpu_data() + j * dim;
+        Dtype expected = 0;
+        switch (metric) {
+        case PairwiseDistanceParameter_Metric_EUCLIDEAN:
+          for (int k = 0; k < dim; ++k) {
+            expected += (x[k] - y[k]) * (x[k] - y[k]);
+          }
+          break;
+        case PairwiseDistanceParameter_Metric_COSINE:
+          expected = 1 - caffe_cpu_dot(dim, x, y) /
+              std::sqrt(caffe_cpu_dot(dim, x, x) * caffe_cpu_dot(dim, y, y));
+          break;
+        default:
+          expected = -caffe_cpu_dot(dim, x, y);
+        }
+        EXPECT_NEAR(expected, blob_top_dist_->cpu_data()[i * num + j], 1e-4);
+      }
+    }
+  }
+
+  void TestGradient(PairwiseDistanceParameter_Metric metric) {
+    LayerParameter layer_param;
+    layer_param.mutable_pairwise_distance_param()->set_metric(metric);
+    PairwiseDistanceLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+    checker.CheckGradientExhaustive(&layer, blob_bottom_vec_,
+        blob_top_vec_, 0);
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_dist_;
+  Blob<Dtype>* const blob_top_same_;
+  Blob<Dtype>* const blob_top_different_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(PairwiseDistanceLayerTest, TestDtypes);
+
+TYPED_TEST(PairwiseDistanceLayerTest, TestForwardEuclidean) {
+  this->TestForward(PairwiseDistanceParameter_Metric_EUCLIDEAN);
+}
+
+TYPED_TEST(PairwiseDistanceLayerTest, TestForwardCosine) {
+  this->TestForward(PairwiseDistanceParameter_Metric_COSINE);
+}
+
+TYPED_TEST(PairwiseDistanceLayerTest, TestForwardDot) {
+  this->TestForward(PairwiseDistanceParameter_Metric_DOT);
+}
+
+TYPED_TEST(PairwiseDistanceLayerTest, TestLabelMasks) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_label_);
+  this->blob_top_vec_.push_back(this->blob_top_same_);
+  this->blob_top_vec_.push_back(this->blob_top_different_);
+  LayerParameter layer_param;
+  PairwiseDistanceLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam* label = this->blob_bottom_label_->cpu_data();
+  const int num = this->blob_bottom_data_->num();
+  for (int i = 0; i < num; ++i) {
+    for (int j = 0; j < num; ++j) {
+      EXPECT_EQ(label[i] == label[j] && i != j,
+          this->blob_top_same_->cpu_data()[i * num + j]);
+      EXPECT_EQ(label[i] != label[j],
+          this->blob_top_different_->cpu_data()[i * num + j]);
+    }
+  }
+}
+
+TYPED_TEST(PairwiseDistanceLayerTest, TestGradientEuclidean) {
+  this->TestGradient(PairwiseDistanceParameter_Metric_EUCLIDEAN);
+}
+
+TYPED_TEST(PairwiseDistanceLayerTest, TestGradientCosine) {
+  this->TestGradient(PairwiseDistanceParameter_Metric_COSINE);
+}
+
+TYPED_TEST(PairwiseDistanceLayerTest, TestGradientDot) {
+  this->TestGradient(PairwiseDistanceParameter_Metric_DOT);
+}
+
+// BatchTripletLossLayer on precomputed distances matches it on the features.
+TYPED_TEST(PairwiseDistanceLayerTest, TestBatchTripletLossPrecomputed) {
+  typedef TypeParam Dtype;
+  LayerParameter loss_param;
+  loss_param.mutable_triplet_loss_param()->set_margin(1);
+  loss_param.mutable_triplet_loss_param()->set_mu(0.5);
+  Blob<Dtype> loss;
+  Blob<Dtype> accuracy;
+  vector<Blob<Dtype>*> loss_top;
+  loss_top.push_back(&loss);
+  loss_top.push_back(&accuracy);
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+
+  vector<Blob<Dtype>*> loss_bottom;
+  loss_bottom.push_back(this->blob_bottom_data_);
+  loss_bottom.push_back(this->blob_bottom_label_);
+  BatchTripletLossLayer<Dtype> direct(loss_param);
+  direct.SetUp(loss_bottom, loss_top);
+  direct.Forward(loss_bottom, loss_top);
+  direct.Backward(loss_top, propagate_down, loss_bottom);
+  const Dtype expected_loss = loss.cpu_data()[0];
+  const Dtype expected_accuracy = accuracy.cpu_data()[0];
+  Blob<Dtype> expected_diff;
+  expected_diff.CopyFrom(*this->blob_bottom_data_, true, true);
+
+  LayerParameter dist_param;
+  PairwiseDistanceLayer<Dtype> dist(dist_param);
+  dist.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  loss_param.mutable_triplet_loss_param()->set_precomputed_distance(true);
+  loss_bottom[0] = this->blob_top_dist_;
+  BatchTripletLossLayer<Dtype> precomputed(loss_param);
+  precomputed.SetUp(loss_bottom, loss_top);
+  caffe_set(this->blob_bottom_data_->count(), Dtype(0),
+      this->blob_bottom_data_->mutable_cpu_diff());
+  dist.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  precomputed.Forward(loss_bottom, loss_top);
+  precomputed.Backward(loss_top, propagate_down, loss_bottom);
+  dist.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  EXPECT_NEAR(expected_loss, loss.cpu_data()[0], 1e-4);
+  EXPECT_EQ(expected_accuracy, accuracy.cpu_data()[0]);
+  for (int i = 0; i < expected_diff.count(); ++i) {
+    EXPECT_NEAR(expected_diff.cpu_diff()[i],
+        this->blob_bottom_data_->cpu_diff()[i], 1e-4);
+  }
+}
+
+// In a net, the distances are shared by a loss and a metric through the Split
+// layer the net inserts, and only the loss backpropagates to the features.
+TYPED_TEST(PairwiseDistanceLayerTest, TestSharedInNet) {
+  typedef TypeParam Dtype;
+  const string proto =
+      "layer { name: 'input' type: 'Input' top: 'data' top: 'label' "
+      "  input_param { shape { dim: 9 dim: 2 dim: 2 dim: 1 } "
+      "                shape { dim: 9 dim: 1 dim: 1 dim: 1 } } } "
+      "layer { name: 'embed' type: 'InnerProduct' bottom: 'data' "
+      "  top: 'embed' inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'dist' type: 'PairwiseDistance' bottom: 'embed' "
+      "  bottom: 'label' top: 'dist' top: 'same' top: 'different' } "
+      "layer { name: 'loss' type: 'BatchTripletLoss' bottom: 'dist' "
+      "  bottom: 'label' top: 'loss' top: 'triplet_accuracy' "
+      "  triplet_loss_param { margin: 1 mu: 0.5 "
+      "    precomputed_distance: true } } "
+      "layer { name: 'recall' type: 'RetrievalAccuracy' bottom: 'dist' "
+      "  bottom: 'same' bottom: 'different' top: 'recall' "
+      "  accuracy_param { top_k: 2 } } ";
+  NetParameter net_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &net_param));
+  Net<Dtype> net(net_param);
+  int num_dist_splits = 0;
+  for (int i = 0; i < net.layers().size(); ++i) {
+    if (string(net.layers()[i]->type()) == "Split" &&
+        net.blob_names()[net.bottom_ids(i)[0]] == "dist") {
+      ++num_dist_splits;
+      EXPECT_EQ(2, net.top_vecs()[i].size());
+    }
+  }
+  EXPECT_EQ(1, num_dist_splits);
+  net.blob_by_name("data")->CopyFrom(*this->blob_bottom_data_);
+  net.blob_by_name("label")->CopyFrom(*this->blob_bottom_label_);
+  net.Forward();
+  net.Backward();
+
+  // The same on the embedded features, layer by layer.
+  Blob<Dtype>* embed = net.blob_by_name("embed").get();
+  Blob<Dtype> features;
+  features.CopyFrom(*embed, false, true);
+  vector<Blob<Dtype>*> bottom;
+  bottom.push_back(&features);
+  bottom.push_back(this->blob_bottom_label_);
+  LayerParameter loss_param;
+  loss_param.mutable_triplet_loss_param()->set_margin(1);
+  loss_param.mutable_triplet_loss_param()->set_mu(0.5);
+  BatchTripletLossLayer<Dtype> loss_layer(loss_param);
+  Blob<Dtype> loss;
+  Blob<Dtype> accuracy;
+  vector<Blob<Dtype>*> loss_top;
+  loss_top.push_back(&loss);
+  loss_top.push_back(&accuracy);
+  loss_layer.SetUp(bottom, loss_top);
+  loss_layer.Forward(bottom, loss_top);
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  loss_layer.Backward(loss_top, propagate_down, bottom);
+  EXPECT_NEAR(loss.cpu_data()[0], net.blob_by_name("loss")->cpu_data()[0],
+      1e-4);
+  EXPECT_GT(embed->asum_diff(), 0);
+  for (int i = 0; i < features.count(); ++i) {
+    EXPECT_NEAR(features.cpu_diff()[i], embed->cpu_diff()[i], 1e-4);
+  }
+
+  LayerParameter dist_param;
+  PairwiseDistanceLayer<Dtype> dist_layer(dist_param);
+  vector<Blob<Dtype>*> dist_top;
+  dist_top.push_back(this->blob_top_dist_);
+  dist_top.push_back(this->blob_top_same_);
+  dist_top.push_back(this->blob_top_different_);
+  dist_layer.SetUp(bottom, dist_top);
+  dist_layer.Forward(bottom, dist_top);
+  LayerParameter recall_param;
+  recall_param.mutable_accuracy_param()->set_top_k(2);
+  RetrievalAccuracyLayer<Dtype> recall_layer(recall_param);
+  Blob<Dtype> recall;
+  vector<Blob<Dtype>*> recall_top(1, &recall);
+  recall_layer.SetUp(dist_top, recall_top);
+  recall_layer.Forward(dist_top, recall_top);
+  EXPECT_EQ(recall.cpu_data()[0], net.blob_by_name("recall")->cpu_data()[0]);
+}
+
+}  // namespace caffe
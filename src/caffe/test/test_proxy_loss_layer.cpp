@@ -0,0 +1,194 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/proxy_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ProxyLossLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Batches hold several samples of a few of the classes.
+  ProxyLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(9, 3, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(9, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    // Four samples of class 5, three of class 0 and two of class 2; the
+    // other four classes are not in the batch.
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = i < 4 ? 5 : (i < 7 ? 0 : 2);
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    ProxyLossParameter* param = layer_param_.mutable_proxy_loss_param();
+    param->set_num_output(kNumClasses);
+    param->set_alpha(4);
+  }
+  virtual ~ProxyLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  // The cosine similarity of feature i to proxy c of layer.
+  Dtype Similarity(Layer<Dtype>* layer, int i, int c) {
+    const int dim = blob_bottom_data_->count(1);
+    const Dtype* x = blob_bottom_data_->cpu_data() + i * dim;
+    const Dtype* p = layer->blobs()[0]->cpu_data() + c * dim;
+    return caffe_cpu_dot(dim, x, p) /
+        std::sqrt(caffe_cpu_dot(dim, x, x) * caffe_cpu_dot(dim, p, p));
+  }
+
+  // Whether class c has samples in the batch: 0, 2 and 5 do.
+  bool InBatch(int c) {
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      if (blob_bottom_label_->cpu_data()[i] == c) { return true; }
+    }
+    return false;
+  }
+
+  // The ProxyNCA loss with the proxies of layer, over the proxies of the
+  // classes in the batch if batch_only, and of all classes otherwise.
+  Dtype ReferenceNCALoss(Layer<Dtype>* layer, bool batch_only) {
+    const int num = blob_bottom_data_->num();
+    Dtype loss = 0;
+    for (int i = 0; i < num; ++i) {
+      const int label = blob_bottom_label_->cpu_data()[i];
+      Dtype sum = 0;
+      for (int c = 0; c < kNumClasses; ++c) {
+        if (batch_only && !InBatch(c)) { continue; }
+        sum += std::exp(4 * Similarity(layer, i, c));
+      }
+      loss += std::log(sum) - 4 * Similarity(layer, i, label);
+    }
+    return loss / num;
+  }
+
+  // The ProxyAnchor loss, with a margin of 0.1, likewise.
+  Dtype ReferenceAnchorLoss(Layer<Dtype>* layer, bool batch_only) {
+    const int num = blob_bottom_data_->num();
+    Dtype pos_loss = 0;
+    Dtype neg_loss = 0;
+    int num_positive = 0;
+    int num_proxies = 0;
+    for (int c = 0; c < kNumClasses; ++c) {
+      if (batch_only && !InBatch(c)) { continue; }
+      ++num_proxies;
+      Dtype pos_sum = 0;
+      Dtype neg_sum = 0;
+      bool has_positive = false;
+      for (int i = 0; i < num; ++i) {
+        const Dtype s = Similarity(layer, i, c);
+        if (blob_bottom_label_->cpu_data()[i] == c) {
+          pos_sum += std::exp(-4 * (s - 0.1));
+          has_positive = true;
+        } else {
+          neg_sum += std::exp(4 * (s + 0.1));
+        }
+      }
+      if (has_positive) {
+        pos_loss += std::log(1 + pos_sum);
+        ++num_positive;
+      }
+      neg_loss += std::log(1 + neg_sum);
+    }
+    EXPECT_EQ(3, num_positive);
+    EXPECT_EQ(batch_only ? 3 : kNumClasses, num_proxies);
+    return pos_loss / num_positive + neg_loss / num_proxies;
+  }
+
+  static const int kNumClasses = 7;
+  LayerParameter layer_param_;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ProxyLossLayerTest, TestDtypes);
+
+TYPED_TEST(ProxyLossLayerTest, TestForwardNCA) {
+  this->layer_param_.mutable_proxy_loss_param()->set_method(
+      ProxyLossParameter_Method_NCA);
+  ProxyLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceNCALoss(&layer, false),
+      this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(ProxyLossLayerTest, TestForwardAnchor) {
+  this->layer_param_.mutable_proxy_loss_param()->set_margin(0.1);
+  ProxyLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceAnchorLoss(&layer, false),
+      this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(ProxyLossLayerTest, TestGradientNCA) {
+  this->layer_param_.mutable_proxy_loss_param()->set_method(
+      ProxyLossParameter_Method_NCA);
+  ProxyLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(ProxyLossLayerTest, TestGradientAnchor) {
+  ProxyLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(ProxyLossLayerTest, TestBatchProxiesOnly) {
+  this->layer_param_.mutable_proxy_loss_param()->set_batch_proxies_only(true);
+  // The losses only count the 3 proxies of the classes in the batch, not
+  // all 7.
+  this->layer_param_.mutable_proxy_loss_param()->set_margin(0.1);
+  ProxyLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceAnchorLoss(&layer, true),
+      this->blob_top_loss_->cpu_data()[0], 1e-4);
+  LayerParameter nca_param(this->layer_param_);
+  nca_param.mutable_proxy_loss_param()->set_method(
+      ProxyLossParameter_Method_NCA);
+  ProxyLossLayer<TypeParam> nca_layer(nca_param);
+  nca_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  nca_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceNCALoss(&nca_layer, true),
+      this->blob_top_loss_->cpu_data()[0], 1e-4);
+
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  // Only the proxies of classes 0, 2 and 5 have gradients.
+  const vector<int>* rows = layer.sparse_param_rows(0);
+  ASSERT_TRUE(rows != NULL);
+  EXPECT_EQ(3, rows->size());
+  const int dim = this->blob_bottom_data_->count(1);
+  for (int c = 0; c < this->kNumClasses; ++c) {
+    if (c == 0 || c == 2 || c == 5) { continue; }
+    for (int j = 0; j < dim; ++j) {
+      EXPECT_EQ(0, layer.blobs()[0]->cpu_diff()[c * dim + j]);
+    }
+  }
+}
+
+}  // namespace caffe
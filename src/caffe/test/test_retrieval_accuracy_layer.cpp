@@ -0,0 +1,105 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/retrieval_accuracy_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class RetrievalAccuracyLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  RetrievalAccuracyLayerTest()
+      : blob_bottom_dist_(new Blob<Dtype>(4, 4, 1, 1)),
+        blob_bottom_same_(new Blob<Dtype>(4, 4, 1, 1)),
+        blob_bottom_different_(new Blob<Dtype>(4, 4, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {
+    // Features 0, 1 and 3 share a label; 2 has a label of its own, so it is
+    // not a query.
+    const int label[4] = {0, 0, 1, 0};
+    const int num = 4;
+    for (int i = 0; i < num; ++i) {
+      for (int j = 0; j < num; ++j) {
+        blob_bottom_same_->mutable_cpu_data()[i * num + j] =
+            label[i] == label[j] && i != j;
+        blob_bottom_different_->mutable_cpu_data()[i * num + j] =
+            label[i] != label[j];
+      }
+    }
+    // Feature 2 is nearer to 0 than 1 and 3 are, and farther from 1 and 3
+    // than they are from each other.
+    SetDistance(0, 1, 3);
+    SetDistance(0, 2, 1);
+    SetDistance(0, 3, 5);
+    SetDistance(1, 2, 4);
+    SetDistance(1, 3, 2);
+    SetDistance(2, 3, 3);
+    blob_bottom_vec_.push_back(blob_bottom_dist_);
+    blob_bottom_vec_.push_back(blob_bottom_same_);
+    blob_bottom_vec_.push_back(blob_bottom_different_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~RetrievalAccuracyLayerTest() {
+    delete blob_bottom_dist_;
+    delete blob_bottom_same_;
+    delete blob_bottom_different_;
+    delete blob_top_;
+  }
+
+  void SetDistance(int i, int j, Dtype distance) {
+    const int num = blob_bottom_dist_->num();
+    blob_bottom_dist_->mutable_cpu_data()[i * num + j] = distance;
+    blob_bottom_dist_->mutable_cpu_data()[j * num + i] = distance;
+  }
+
+  Dtype RecallAt(int top_k) {
+    LayerParameter layer_param;
+    layer_param.mutable_accuracy_param()->set_top_k(top_k);
+    RetrievalAccuracyLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    return blob_top_->cpu_data()[0];
+  }
+
+  Blob<Dtype>* const blob_bottom_dist_;
+  Blob<Dtype>* const blob_bottom_same_;
+  Blob<Dtype>* const blob_bottom_different_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(RetrievalAccuracyLayerTest, TestDtypes);
+
+TYPED_TEST(RetrievalAccuracyLayerTest, TestSetup) {
+  LayerParameter layer_param;
+  RetrievalAccuracyLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(0, this->blob_top_->num_axes());
+}
+
+TYPED_TEST(RetrievalAccuracyLayerTest, TestForward) {
+  // 0 retrieves 2 first; 1 and 3 retrieve each other.
+  EXPECT_NEAR(TypeParam(2) / 3, this->RecallAt(1), 1e-6);
+  EXPECT_EQ(1, this->RecallAt(2));
+}
+
+TYPED_TEST(RetrievalAccuracyLayerTest, TestForwardTie) {
+  // 2 is as near to 3 as 1 is, and ranks first.
+  this->SetDistance(2, 3, 2);
+  EXPECT_NEAR(TypeParam(1) / 3, this->RecallAt(1), 1e-6);
+  EXPECT_EQ(1, this->RecallAt(2));
+}
+
+TYPED_TEST(RetrievalAccuracyLayerTest, TestForwardNoQueries) {
+  caffe_set(this->blob_bottom_same_->count(), TypeParam(0),
+      this->blob_bottom_same_->mutable_cpu_data());
+  EXPECT_EQ(0, this->RecallAt(1));
+}
+
+}  // namespace caffe
@@ -0,0 +1,238 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class SampledSoftmaxLossLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // A few samples over many more classes, as the layer is meant for.
+  SampledSoftmaxLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(5, 3, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(5, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    // The labels are 3, 16 and 29, two of them twice: with 3 shards, of
+    // classes [0, 10), [10, 21) and [21, 32), one in each shard.
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = 3 + 13 * (i % 3);
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    SampledSoftmaxParameter* param =
+        layer_param_.mutable_sampled_softmax_param();
+    param->set_num_output(kNumClasses);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+  }
+  virtual ~SampledSoftmaxLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  // The softmax loss of the params of layer over all classes.
+  Dtype ReferenceLoss(Layer<Dtype>* layer) {
+    const Dtype* weight = layer->blobs()[0]->cpu_data();
+    const Dtype* bias = layer->blobs()[1]->cpu_data();
+    const int num = blob_bottom_data_->num();
+    const int dim = blob_bottom_data_->count(1);
+    Dtype loss = 0;
+    for (int i = 0; i < num; ++i) {
+      const Dtype* x = blob_bottom_data_->cpu_data() + i * dim;
+      vector<Dtype> logits(kNumClasses);
+      for (int c = 0; c < kNumClasses; ++c) {
+        logits[c] = bias[c] + caffe_cpu_dot(dim, x, weight + c * dim);
+      }
+      Dtype sum = 0;
+      for (int c = 0; c < kNumClasses; ++c) {
+        sum += std::exp(logits[c]);
+      }
+      const int label = blob_bottom_label_->cpu_data()[i];
+      loss += std::log(sum) - logits[label];
+    }
+    return loss / num;
+  }
+
+  static const int kNumClasses = 32;
+  LayerParameter layer_param_;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SampledSoftmaxLossLayerTest, TestDtypes);
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestForwardSharded) {
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_shards(3);
+  SampledSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(&layer), this->blob_top_loss_->cpu_data()[0],
+      1e-4);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradientSharded) {
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_shards(3);
+  SampledSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradientBlocked) {
+  // Blocks of 2 classes for the 5 samples, several to a shard.
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_shards(3);
+  this->layer_param_.mutable_sampled_softmax_param()->set_block_size(10);
+  SampledSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(&layer), this->blob_top_loss_->cpu_data()[0],
+      1e-4);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestSampledAllClasses) {
+  // Drawing all the other classes gives the exact loss and gradients.
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_sampled(
+      this->kNumClasses);
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_shards(2);
+  this->layer_param_.set_phase(TRAIN);
+  SampledSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(&layer), this->blob_top_loss_->cpu_data()[0],
+      1e-4);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestSampledRows) {
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_sampled(2);
+  this->layer_param_.set_phase(TRAIN);
+  SampledSoftmaxLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  this->blob_top_loss_->mutable_cpu_diff()[0] = 1;
+  caffe_set(layer.blobs()[0]->count(), TypeParam(0),
+      layer.blobs()[0]->mutable_cpu_diff());
+  caffe_set(layer.blobs()[1]->count(), TypeParam(0),
+      layer.blobs()[1]->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  // The three classes of the labels and the two drawn ones have gradients.
+  const vector<int>* rows = layer.sparse_param_rows(0);
+  ASSERT_TRUE(rows != NULL);
+  EXPECT_EQ(5, rows->size());
+  vector<bool> used(this->kNumClasses, false);
+  for (int i = 0; i < rows->size(); ++i) {
+    used[(*rows)[i]] = true;
+  }
+  EXPECT_TRUE(used[3] && used[16] && used[29]);
+  const int dim = layer.blobs()[0]->shape(1);
+  for (int c = 0; c < this->kNumClasses; ++c) {
+    if (used[c]) { continue; }
+    for (int j = 0; j < dim; ++j) {
+      EXPECT_EQ(0, layer.blobs()[0]->cpu_diff()[c * dim + j]);
+    }
+    EXPECT_EQ(0, layer.blobs()[1]->cpu_diff()[c]);
+  }
+  layer.ClearSparseParamRows();
+  EXPECT_EQ(0, layer.sparse_param_rows(0)->size());
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestSampledLogQ) {
+  typedef TypeParam Dtype;
+  // 4 of the 29 classes not in the labels are drawn, each standing for 29 / 4
+  // of them: their logits are offset by log(29 / 4).
+  const int kNumSampled = 4;
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_sampled(
+      kNumSampled);
+  this->layer_param_.mutable_sampled_softmax_param()->set_num_shards(2);
+  this->layer_param_.mutable_sampled_softmax_param()->set_block_size(10);
+  this->layer_param_.set_phase(TRAIN);
+  SampledSoftmaxLossLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  this->blob_top_loss_->mutable_cpu_diff()[0] = 1;
+  caffe_set(layer.blobs()[0]->count(), Dtype(0),
+      layer.blobs()[0]->mutable_cpu_diff());
+  caffe_set(layer.blobs()[1]->count(), Dtype(0),
+      layer.blobs()[1]->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  // The classes of the batch are those with gradients.
+  const vector<int> classes = *layer.sparse_param_rows(0);
+  ASSERT_EQ(3 + kNumSampled, classes.size());
+  const Dtype log_q = std::log(Dtype(this->kNumClasses - 3) / kNumSampled);
+  const Dtype* weight = layer.blobs()[0]->cpu_data();
+  const Dtype* bias = layer.blobs()[1]->cpu_data();
+  const int num = this->blob_bottom_data_->num();
+  const int dim = this->blob_bottom_data_->count(1);
+  Dtype loss = 0;
+  vector<Dtype> weight_diff(this->kNumClasses * dim, 0);
+  vector<Dtype> bias_diff(this->kNumClasses, 0);
+  vector<Dtype> bottom_diff(num * dim, 0);
+  for (int i = 0; i < num; ++i) {
+    const Dtype* x = this->blob_bottom_data_->cpu_data() + i * dim;
+    const int label = this->blob_bottom_label_->cpu_data()[i];
+    vector<Dtype> logits(classes.size());
+    Dtype sum = 0;
+    Dtype label_logit = 0;
+    for (int j = 0; j < classes.size(); ++j) {
+      const int c = classes[j];
+      logits[j] = bias[c] + caffe_cpu_dot(dim, x, weight + c * dim);
+      // The classes of the labels, 3, 16 and 29, are not drawn.
+      if (c % 13 != 3) {
+        logits[j] += log_q;
+      }
+      if (c == label) {
+        label_logit = logits[j];
+      }
+      sum += std::exp(logits[j]);
+    }
+    loss += std::log(sum) - label_logit;
+    for (int j = 0; j < classes.size(); ++j) {
+      const int c = classes[j];
+      const Dtype grad = (std::exp(logits[j]) / sum - (c == label)) / num;
+      caffe_axpy(dim, grad, x, &weight_diff[c * dim]);
+      bias_diff[c] += grad;
+      caffe_axpy(dim, grad, weight + c * dim, &bottom_diff[i * dim]);
+    }
+  }
+  const Dtype kEpsilon = 1e-4;
+  EXPECT_NEAR(loss / num, this->blob_top_loss_->cpu_data()[0], kEpsilon);
+  for (int i = 0; i < weight_diff.size(); ++i) {
+    EXPECT_NEAR(weight_diff[i], layer.blobs()[0]->cpu_diff()[i], kEpsilon);
+  }
+  for (int i = 0; i < bias_diff.size(); ++i) {
+    EXPECT_NEAR(bias_diff[i], layer.blobs()[1]->cpu_diff()[i], kEpsilon);
+  }
+  for (int i = 0; i < bottom_diff.size(); ++i) {
+    EXPECT_NEAR(bottom_diff[i], this->blob_bottom_data_->cpu_diff()[i],
+        kEpsilon);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,55 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SnapshotWriterTest : public MultiDeviceTest<TypeParam> {};
+
+TYPED_TEST_CASE(SnapshotWriterTest, TestDtypesAndDevices);
+
+TYPED_TEST(SnapshotWriterTest, TestStageBlobsToHost) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<shared_ptr<Blob<Dtype> > > blobs;
+  blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(2, 3, 4, 5)));
+  blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(7, 1, 1, 1)));
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < blobs.size(); ++i) {
+    filler.Fill(blobs[i].get());
+    caffe_copy(blobs[i]->count(), blobs[i]->cpu_data(),
+        blobs[i]->mutable_cpu_diff());
+    caffe_scal(blobs[i]->count(), Dtype(2), blobs[i]->mutable_cpu_diff());
+    // Training leaves the blobs on the device in GPU mode.
+    if (Caffe::mode() == Caffe::GPU) {
+      blobs[i]->mutable_gpu_data();
+      blobs[i]->mutable_gpu_diff();
+    }
+  }
+  vector<shared_ptr<Blob<Dtype> > > staged;
+  // The second time, the staged blobs are reused.
+  for (int pass = 0; pass < 2; ++pass) {
+    SnapshotWriter<Dtype>::StageBlobs(blobs, true, &staged);
+    ASSERT_EQ(blobs.size(), staged.size());
+    for (int i = 0; i < blobs.size(); ++i) {
+      EXPECT_EQ(SyncedMemory::HEAD_AT_CPU, staged[i]->data()->head());
+      EXPECT_EQ(SyncedMemory::HEAD_AT_CPU, staged[i]->diff()->head());
+      ASSERT_TRUE(staged[i]->shape() == blobs[i]->shape());
+      for (int j = 0; j < blobs[i]->count(); ++j) {
+        EXPECT_EQ(blobs[i]->cpu_data()[j], staged[i]->cpu_data()[j]);
+        EXPECT_EQ(blobs[i]->cpu_diff()[j], staged[i]->cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
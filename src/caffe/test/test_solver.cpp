@@ -106,4 +106,84 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestAsyncTestNets) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "test_interval: 5 "
+     "test_iter: 3 "
+     "test_async: true "
+     "max_iter: 10 "
+     "base_lr: 0.01 "
+     "lr_policy: 'fixed' "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "        dim: 3 "
+     "        dim: 4 "
+     "      } "
+     "      shape { "
+     "        dim: 5 "
+     "      } "
+     "      data_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "      data_filler { "
+     "        type: 'constant' "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'accuracy' "
+     "    type: 'Accuracy' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "    top: 'accuracy' "
+     "    exclude: { phase: TRAIN } "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  ASSERT_EQ(1, this->solver_->test_nets().size());
+  const vector<shared_ptr<Blob<Dtype> > >& params =
+      this->solver_->net()->layer_by_name("innerprod")->blobs();
+  const vector<shared_ptr<Blob<Dtype> > >& test_params =
+      this->solver_->test_nets()[0]->layer_by_name("innerprod")->blobs();
+  ASSERT_EQ(params.size(), test_params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    // The test net holds a copy of the final weights, not the weights.
+    EXPECT_NE(params[i]->cpu_data(), test_params[i]->cpu_data());
+    ASSERT_EQ(params[i]->count(), test_params[i]->count());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(params[i]->cpu_data()[j], test_params[i]->cpu_data()[j]);
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,84 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/internal_thread.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/spsc_queue.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SpscQueueTest : public ::testing::Test {
+ protected:
+  SpscQueueTest() {
+    for (int i = 0; i < 16; ++i) {
+      batches_.push_back(&batch_storage_[i]);
+    }
+  }
+
+  Batch<float> batch_storage_[16];
+  vector<Batch<float>*> batches_;
+};
+
+TEST_F(SpscQueueTest, TestCapacity) {
+  SpscQueue<Batch<float>*> queue(3);
+  EXPECT_EQ(3, queue.capacity());
+  EXPECT_EQ(0, queue.size());
+  Batch<float>* batch;
+  EXPECT_FALSE(queue.try_pop(&batch));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(queue.try_push(batches_[i]));
+  }
+  EXPECT_FALSE(queue.try_push(batches_[3]));
+  EXPECT_EQ(3, queue.size());
+  // Elements come out in order, and the ring wraps around.
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(batches_[i], queue.pop());
+    queue.push(batches_[i + 3]);
+    EXPECT_EQ(3, queue.size());
+  }
+}
+
+class SpscProducer : public InternalThread {
+ public:
+  SpscProducer(SpscQueue<Batch<float>*>* queue,
+      const vector<Batch<float>*>& batches, int count)
+      : queue_(queue), batches_(batches), count_(count) {}
+
+ protected:
+  virtual void InternalThreadEntry() {
+    for (int i = 0; i < count_; ++i) {
+      queue_->push(batches_[i % batches_.size()]);
+    }
+  }
+
+  SpscQueue<Batch<float>*>* queue_;
+  vector<Batch<float>*> batches_;
+  int count_;
+};
+
+TEST_F(SpscQueueTest, TestProducerConsumer) {
+  SpscQueue<Batch<float>*> queue(4);
+  const int count = 100000;
+  SpscProducer producer(&queue, batches_, count);
+  producer.StartInternalThread();
+  for (int i = 0; i < count; ++i) {
+    ASSERT_EQ(batches_[i % batches_.size()], queue.pop());
+  }
+  producer.StopInternalThread();
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_F(SpscQueueTest, TestStopWhileWaiting) {
+  // A producer blocked on a full queue must still honor interruption.
+  SpscQueue<Batch<float>*> queue(1);
+  SpscProducer producer(&queue, batches_, 2);
+  producer.StartInternalThread();
+  producer.StopInternalThread();
+  EXPECT_FALSE(producer.is_started());
+  EXPECT_EQ(1, queue.size());
+}
+
+}  // namespace caffe
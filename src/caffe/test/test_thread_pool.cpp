@@ -0,0 +1,77 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static void CountAt(int* counts, int i) {
+  ++counts[i];
+}
+
+class ThreadPoolTest : public ::testing::Test {
+ public:
+  ThreadPoolTest() : pool_(3) {}
+
+  // Runs num_tasks tasks on pool_ rounds times, checking each ran once.
+  void RunRounds(int num_tasks, int rounds) {
+    for (int round = 0; round < rounds; ++round) {
+      vector<int> counts(num_tasks, 0);
+      pool_.Run(num_tasks, boost::bind(&CountAt, &counts[0], _1));
+      for (int i = 0; i < num_tasks; ++i) {
+        EXPECT_EQ(1, counts[i]) << i;
+      }
+    }
+  }
+
+  // Task i of an outer Run counts on its own slice of counts.
+  void RunNested(vector<int>* counts, int i) {
+    pool_.Run(4, boost::bind(&CountAt, &(*counts)[i * 4], _1));
+  }
+
+ protected:
+  ThreadPool pool_;
+};
+
+TEST_F(ThreadPoolTest, TestRunsEveryTaskOnce) {
+  EXPECT_EQ(3, pool_.num_workers());
+  this->RunRounds(1, 1);
+  this->RunRounds(100, 50);
+}
+
+TEST_F(ThreadPoolTest, TestConcurrentCallers) {
+  boost::thread_group callers;
+  for (int i = 0; i < 3; ++i) {
+    callers.create_thread(boost::bind(&ThreadPoolTest::RunRounds, this, 64,
+        20));
+  }
+  this->RunRounds(64, 20);
+  callers.join_all();
+}
+
+TEST_F(ThreadPoolTest, TestNestedRun) {
+  vector<int> counts(6 * 4, 0);
+  pool_.Run(6, boost::bind(&ThreadPoolTest::RunNested, this, &counts, _1));
+  for (int i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(1, counts[i]) << i;
+  }
+}
+
+TEST_F(ThreadPoolTest, TestShared) {
+  shared_ptr<ThreadPool> pool = ThreadPool::Shared();
+  EXPECT_EQ(pool.get(), ThreadPool::Shared().get());
+  EXPECT_GE(pool->num_workers(), 1);
+  vector<int> counts(10, 0);
+  pool->Run(10, boost::bind(&CountAt, &counts[0], _1));
+  for (int i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(1, counts[i]) << i;
+  }
+}
+
+}  // namespace caffe
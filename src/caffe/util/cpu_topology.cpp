@@ -0,0 +1,132 @@
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/cpu_topology.hpp"
+
+namespace caffe {
+
+static bool ReadFirstLine(const string& filename, string* line) {
+  std::ifstream file(filename.c_str());
+  return file && std::getline(file, *line);
+}
+
+CPUTopology::CPUTopology() {
+  string line;
+  vector<int> nodes;
+  if (ReadFirstLine("/sys/devices/system/node/online", &line)
+      && ParseCPUList(line, &nodes)) {
+    for (int i = 0; i < nodes.size(); ++i) {
+      ostringstream filename;
+      filename << "/sys/devices/system/node/node" << nodes[i] << "/cpulist";
+      vector<int> cpus;
+      // Nodes with memory only are left out.
+      if (ReadFirstLine(filename.str(), &line) && ParseCPUList(line, &cpus)
+          && cpus.size()) {
+        node_cpus_.push_back(cpus);
+      }
+    }
+  }
+  if (node_cpus_.empty()) {
+    const int count = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    node_cpus_.resize(1);
+    for (int i = 0; i < count; ++i) {
+      node_cpus_[0].push_back(i);
+    }
+  }
+}
+
+const CPUTopology& CPUTopology::Get() {
+  static CPUTopology topology;
+  return topology;
+}
+
+int CPUTopology::num_cpus() const {
+  int count = 0;
+  for (int i = 0; i < node_cpus_.size(); ++i) {
+    count += node_cpus_[i].size();
+  }
+  return count;
+}
+
+string CPUTopology::Describe() const {
+  ostringstream s;
+  for (int i = 0; i < node_cpus_.size(); ++i) {
+    s << (i ? ", " : "") << "node " << i << ": CPUs "
+      << FormatCPUList(node_cpus_[i]);
+  }
+  return s.str();
+}
+
+bool ParseCPUList(const string& list, vector<int>* cpus) {
+  cpus->clear();
+  std::istringstream s(list);
+  string range;
+  while (std::getline(s, range, ',')) {
+    int first, last;
+    char dash;
+    std::istringstream r(range);
+    if (!(r >> first)) {
+      return false;
+    }
+    if (r >> dash) {
+      if (dash != '-' || !(r >> last) || last < first) {
+        return false;
+      }
+    } else {
+      last = first;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+  }
+  return true;
+}
+
+string FormatCPUList(const vector<int>& cpus) {
+  ostringstream s;
+  for (int i = 0; i < cpus.size(); ) {
+    int j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+      ++j;
+    }
+    s << (i ? "," : "") << cpus[i];
+    if (j > i) {
+      s << "-" << cpus[j];
+    }
+    i = j + 1;
+  }
+  return s.str();
+}
+
+bool SetThreadAffinity(const vector<int>& cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (cpus.empty()) {
+    const CPUTopology& topology = CPUTopology::Get();
+    for (int node = 0; node < topology.num_nodes(); ++node) {
+      for (int i = 0; i < topology.cpus(node).size(); ++i) {
+        CPU_SET(topology.cpus(node)[i], &set);
+      }
+    }
+  } else {
+    for (int i = 0; i < cpus.size(); ++i) {
+      CPU_SET(cpus[i], &set);
+    }
+  }
+  // On Linux, pid 0 stands for the calling thread.
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+}  // namespace caffe
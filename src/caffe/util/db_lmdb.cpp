@@ -48,6 +48,10 @@ LMDBTransaction* LMDB::NewTransaction() {
   return new LMDBTransaction(mdb_env_);
 }
 
+void LMDB::SetMapSize(size_t size) {
+  MDB_CHECK(mdb_env_set_mapsize(mdb_env_, size));
+}
+
 void LMDBTransaction::Put(const string& key, const string& value) {
   keys.push_back(key);
   values.push_back(value);
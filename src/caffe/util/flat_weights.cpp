@@ -0,0 +1,169 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/util/flat_weights.hpp"
+
+namespace caffe {
+
+namespace {
+
+const char kFlatWeightsMagic[8] = {'C', 'A', 'F', 'F', 'E', 'F', 'L', 'T'};
+
+struct FlatWeightsHeader {
+  char magic[8];
+  uint64_t index_offset;
+  uint64_t index_size;
+};
+
+size_t ElementSize(FlatWeightsIndex::Type type) {
+  return type == FlatWeightsIndex::DOUBLE ? sizeof(double) : sizeof(float);
+}
+
+uint64_t ParamCount(const FlatWeightsIndex::Param& param) {
+  uint64_t count = 1;
+  for (int i = 0; i < param.shape().dim_size(); ++i) {
+    CHECK_GE(param.shape().dim(i), 0);
+    count *= param.shape().dim(i);
+  }
+  return count;
+}
+
+}  // namespace
+
+FlatWeights::FlatWeights(const string& filename)
+    : filename_(filename), fd_(-1), map_(NULL), size_(0) {
+  fd_ = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd_, -1) << "File not found: " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd_, &st), 0) << "Cannot stat " << filename;
+  size_ = st.st_size;
+  CHECK_GE(size_, sizeof(FlatWeightsHeader))
+      << filename << " is not a flat weights file";
+  // A private writable mapping shares the page cache with other processes,
+  // while a blob that aliases it can still be written to, on a copy of the
+  // pages touched.
+  void* map = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, 0);
+  CHECK(map != MAP_FAILED) << "Cannot map " << filename;
+  map_ = static_cast<char*>(map);
+  const FlatWeightsHeader* header =
+      reinterpret_cast<const FlatWeightsHeader*>(map_);
+  CHECK(memcmp(header->magic, kFlatWeightsMagic, sizeof(header->magic)) == 0)
+      << filename << " is not a flat weights file";
+  CHECK_LE(header->index_offset + header->index_size, size_)
+      << filename << " is truncated";
+  CHECK(index_.ParseFromArray(map_ + header->index_offset,
+      header->index_size)) << "Cannot parse the index of " << filename;
+  const size_t element_size = ElementSize(index_.type());
+  for (int i = 0; i < index_.layer_size(); ++i) {
+    for (int j = 0; j < index_.layer(i).param_size(); ++j) {
+      const FlatWeightsIndex::Param& param = index_.layer(i).param(j);
+      CHECK_EQ(param.offset() % element_size, 0);
+      CHECK_LE(param.offset() + ParamCount(param) * element_size,
+          header->index_offset) << filename << " is corrupted";
+    }
+  }
+}
+
+FlatWeights::~FlatWeights() {
+  if (map_) {
+    munmap(map_, size_);
+  }
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+const void* FlatWeights::data(const FlatWeightsIndex::Param& param) const {
+  return map_ + param.offset();
+}
+
+template <typename Dtype>
+void FlatWeights::CopyTo(const FlatWeightsIndex::Param& param,
+    Dtype* dst) const {
+  const uint64_t count = ParamCount(param);
+  if (index_.type() == FlatWeightsIndex::DOUBLE) {
+    const double* src = static_cast<const double*>(data(param));
+    for (uint64_t i = 0; i < count; ++i) {
+      dst[i] = src[i];
+    }
+  } else {
+    const float* src = static_cast<const float*>(data(param));
+    for (uint64_t i = 0; i < count; ++i) {
+      dst[i] = src[i];
+    }
+  }
+}
+
+template void FlatWeights::CopyTo(const FlatWeightsIndex::Param& param,
+    float* dst) const;
+template void FlatWeights::CopyTo(const FlatWeightsIndex::Param& param,
+    double* dst) const;
+
+bool IsFlatWeightsFilename(const string& filename) {
+  const size_t length = sizeof(kFlatWeightsExtension) - 1;
+  return filename.size() >= length &&
+      filename.compare(filename.size() - length, length,
+          kFlatWeightsExtension) == 0;
+}
+
+template <typename Dtype>
+void WriteFlatWeights(const NetParameter& param, const string& filename) {
+  std::ofstream file(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(file) << "Cannot create " << filename;
+  FlatWeightsIndex index;
+  index.set_type(sizeof(Dtype) == sizeof(double) ?
+      FlatWeightsIndex::DOUBLE : FlatWeightsIndex::FLOAT);
+  const vector<char> padding(kFlatWeightsAlignment, 0);
+  uint64_t offset = sizeof(FlatWeightsHeader);
+  file.write(padding.data(), offset);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    if (layer_param.blobs_size() == 0) {
+      continue;
+    }
+    FlatWeightsIndex::Layer* layer = index.add_layer();
+    layer->set_name(layer_param.name());
+    for (int j = 0; j < layer_param.blobs_size(); ++j) {
+      // Decodes every storage of BlobProto, including the legacy 4D shape.
+      Blob<Dtype> blob;
+      blob.FromProto(layer_param.blobs(j), true);
+      const uint64_t aligned = (offset + kFlatWeightsAlignment - 1)
+          / kFlatWeightsAlignment * kFlatWeightsAlignment;
+      file.write(padding.data(), aligned - offset);
+      FlatWeightsIndex::Param* flat_param = layer->add_param();
+      for (int k = 0; k < blob.num_axes(); ++k) {
+        flat_param->mutable_shape()->add_dim(blob.shape(k));
+      }
+      flat_param->set_offset(aligned);
+      file.write(reinterpret_cast<const char*>(blob.cpu_data()),
+          blob.count() * sizeof(Dtype));
+      offset = aligned + blob.count() * sizeof(Dtype);
+    }
+  }
+  string serialized;
+  CHECK(index.SerializeToString(&serialized));
+  file.write(serialized.data(), serialized.size());
+  FlatWeightsHeader header;
+  memcpy(header.magic, kFlatWeightsMagic, sizeof(header.magic));
+  header.index_offset = offset;
+  header.index_size = serialized.size();
+  file.seekp(0);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  CHECK(file) << "Cannot write " << filename;
+}
+
+template void WriteFlatWeights<float>(const NetParameter& param,
+    const string& filename);
+template void WriteFlatWeights<double>(const NetParameter& param,
+    const string& filename);
+
+}  // namespace caffe
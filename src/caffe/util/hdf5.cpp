@@ -81,6 +81,57 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+// Reads blob->shape(0) rows of a dataset, starting at row start, with a
+// hyperslab selection converted to mem_type.
+template <typename Dtype>
+static void hdf5_load_nd_dataset_rows_helper(hid_t file_id,
+    const char* dataset_name_, hsize_t start, hid_t mem_type,
+    Blob<Dtype>* blob) {
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open HDF5 dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset_id);
+  const int num_axes = blob->num_axes();
+  CHECK_EQ(H5Sget_simple_extent_ndims(file_space), num_axes)
+      << "Unexpected number of axes in " << dataset_name_;
+  std::vector<hsize_t> dims(num_axes);
+  H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+  std::vector<hsize_t> offset(num_axes, 0);
+  std::vector<hsize_t> count(num_axes);
+  offset[0] = start;
+  for (int i = 0; i < num_axes; ++i) {
+    count[i] = blob->shape(i);
+    if (i > 0) {
+      CHECK_EQ(dims[i], count[i]) << "Unexpected shape of " << dataset_name_;
+    }
+  }
+  CHECK_LE(start + count[0], dims[0]) << "Rows out of range of "
+      << dataset_name_;
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      offset.data(), NULL, count.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name_;
+  hid_t mem_space = H5Screate_simple(num_axes, count.data(), NULL);
+  status = H5Dread(dataset_id, mem_type, mem_space, file_space, H5P_DEFAULT,
+      blob->mutable_cpu_data());
+  CHECK_GE(status, 0) << "Failed to read rows of " << dataset_name_;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset_id);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id,
+    const char* dataset_name_, hsize_t start, Blob<float>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, start,
+      H5T_NATIVE_FLOAT, blob);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id,
+    const char* dataset_name_, hsize_t start, Blob<double>* blob) {
+  hdf5_load_nd_dataset_rows_helper(file_id, dataset_name_, start,
+      H5T_NATIVE_DOUBLE, blob);
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
@@ -0,0 +1,209 @@
+#include <sys/mman.h>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/host_memory_pool.hpp"
+
+namespace caffe {
+
+const size_t HostMemoryPool::kAlignment;
+const size_t HostMemoryPool::kHugePageSize;
+
+class HostMemoryPool::Impl {
+ public:
+  Impl() : enabled_(true), use_huge_pages_(false),
+      max_cached_bytes_(size_t(1) << 30) {
+    stats_.in_use_bytes = 0;
+    stats_.cached_bytes = 0;
+    stats_.peak_bytes = 0;
+    stats_.hits = 0;
+    stats_.misses = 0;
+  }
+
+  void* Allocate(size_t size) {
+    const size_t bytes = SizeClass(size);
+    const pair<int, size_t> key = Key(bytes);
+    bool use_huge_pages;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      use_huge_pages = use_huge_pages_;
+      stats_.in_use_bytes += bytes;
+      vector<void*>& blocks = free_blocks_[key];
+      if (!blocks.empty()) {
+        void* ptr = blocks.back();
+        blocks.pop_back();
+        stats_.cached_bytes -= bytes;
+        ++stats_.hits;
+        return ptr;
+      }
+      ++stats_.misses;
+      stats_.peak_bytes = std::max(stats_.peak_bytes,
+          stats_.in_use_bytes + stats_.cached_bytes);
+    }
+    return SystemAllocate(bytes, use_huge_pages);
+  }
+
+  void Free(void* ptr, size_t size) {
+    const size_t bytes = SizeClass(size);
+    const pair<int, size_t> key = Key(bytes);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stats_.in_use_bytes -= bytes;
+      if (enabled_ && stats_.cached_bytes + bytes <= max_cached_bytes_) {
+        free_blocks_[key].push_back(ptr);
+        stats_.cached_bytes += bytes;
+        return;
+      }
+    }
+    SystemFree(ptr, bytes);
+  }
+
+  void Trim() {
+    map<pair<int, size_t>, vector<void*> > blocks;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      blocks.swap(free_blocks_);
+      stats_.cached_bytes = 0;
+    }
+    for (map<pair<int, size_t>, vector<void*> >::iterator it =
+         blocks.begin(); it != blocks.end(); ++it) {
+      for (int i = 0; i < it->second.size(); ++i) {
+        SystemFree(it->second[i], it->first.second);
+      }
+    }
+  }
+
+  Stats stats() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return stats_;
+  }
+
+  void set_enabled(bool enabled) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      enabled_ = enabled;
+    }
+    if (!enabled) {
+      Trim();
+    }
+  }
+
+  bool enabled() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return enabled_;
+  }
+
+  void set_max_cached_bytes(size_t bytes) {
+    boost::mutex::scoped_lock lock(mutex_);
+    max_cached_bytes_ = bytes;
+  }
+
+  void set_use_huge_pages(bool use) {
+    boost::mutex::scoped_lock lock(mutex_);
+    use_huge_pages_ = use;
+  }
+
+ private:
+  // Cached blocks are kept apart per NUMA node, so that a thread placed on
+  // a node is not handed memory that was first touched on another. Blocks
+  // are assumed to be freed by a thread of the node that allocated them.
+  static pair<int, size_t> Key(size_t bytes) {
+    return make_pair(Caffe::numa_node(), bytes);
+  }
+
+  // Blocks of kHugePageSize and more are mapped so that they can be backed by
+  // huge pages and go straight back to the system when released; smaller
+  // ones come from the C allocator.
+  void* SystemAllocate(size_t bytes, bool use_huge_pages) {
+    void* ptr = NULL;
+    if (bytes >= kHugePageSize) {
+      ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      CHECK(ptr != MAP_FAILED) << "host allocation of size " << bytes
+          << " failed";
+#ifdef MADV_HUGEPAGE
+      if (use_huge_pages) {
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+      }
+#endif
+    } else {
+      CHECK_EQ(posix_memalign(&ptr, kAlignment, bytes), 0)
+          << "host allocation of size " << bytes << " failed";
+    }
+    return ptr;
+  }
+
+  void SystemFree(void* ptr, size_t bytes) {
+    if (bytes >= kHugePageSize) {
+      munmap(ptr, bytes);
+    } else {
+      free(ptr);
+    }
+  }
+
+  boost::mutex mutex_;
+  map<pair<int, size_t>, vector<void*> > free_blocks_;
+  Stats stats_;
+  bool enabled_;
+  bool use_huge_pages_;
+  size_t max_cached_bytes_;
+};
+
+HostMemoryPool::Impl& HostMemoryPool::Get() {
+  // Intentionally leaked, so that SyncedMemory of static objects can still be
+  // freed during exit.
+  static Impl* impl = new Impl();
+  return *impl;
+}
+
+size_t HostMemoryPool::SizeClass(size_t size) {
+  if (size <= kAlignment) {
+    return kAlignment;
+  }
+  // Round up to a quarter of the largest power of two not above size.
+  size_t power = kAlignment;
+  while (power <= size / 2) {
+    power *= 2;
+  }
+  const size_t step = std::max(power / 4, kAlignment);
+  return (size + step - 1) / step * step;
+}
+
+void* HostMemoryPool::Allocate(size_t size) {
+  return Get().Allocate(size);
+}
+
+void HostMemoryPool::Free(void* ptr, size_t size) {
+  Get().Free(ptr, size);
+}
+
+HostMemoryPool::Stats HostMemoryPool::stats() {
+  return Get().stats();
+}
+
+void HostMemoryPool::Trim() {
+  Get().Trim();
+}
+
+void HostMemoryPool::set_enabled(bool enabled) {
+  Get().set_enabled(enabled);
+}
+
+bool HostMemoryPool::enabled() {
+  return Get().enabled();
+}
+
+void HostMemoryPool::set_max_cached_bytes(size_t bytes) {
+  Get().set_max_cached_bytes(bytes);
+}
+
+void HostMemoryPool::set_use_huge_pages(bool use) {
+  Get().set_use_huge_pages(use);
+}
+
+}  // namespace caffe
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/net.hpp"
+#include "caffe/util/net_profiler.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+NetProfiler<Dtype>::NetProfiler(const Net<Dtype>& net, int max_trace_events)
+    : net_(net), max_trace_events_(max_trace_events), start_us_(0) {
+  CHECK_GE(max_trace_events, 0);
+  origin_ = boost::posix_time::microsec_clock::local_time();
+  Reset();
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Reset() {
+  const int num_layers = net_.layers().size();
+  stats_.clear();
+  stats_.resize(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    LayerStats& s = stats_[i];
+    s.name = net_.layer_names()[i];
+    s.type = net_.layers()[i]->type();
+    s.forward_count = s.backward_count = 0;
+    s.forward_ms = s.backward_ms = 0;
+    s.forward_flops = s.backward_flops = 0;
+    s.bytes_read = s.bytes_written = 0;
+    s.memory_bytes = 0;
+  }
+  events_.clear();
+  dropped_events_ = 0;
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Start() {
+  start_us_ = (boost::posix_time::microsec_clock::local_time() - origin_)
+      .total_microseconds();
+  timer_.Start();
+}
+
+template <typename Dtype>
+double NetProfiler<Dtype>::ForwardFlops(int layer_id) const {
+  Layer<Dtype>& layer = *net_.layers()[layer_id];
+  const vector<Blob<Dtype>*>& bottom = net_.bottom_vecs()[layer_id];
+  const vector<Blob<Dtype>*>& top = net_.top_vecs()[layer_id];
+  const string type = layer.type();
+  if (bottom.empty()) {
+    // Data layers do no arithmetic on the net's side.
+    return 0;
+  }
+  if (type == "Convolution" && top.size() > 0) {
+    // Every output is a dot product over (channels / group) * kernel taps.
+    const Blob<Dtype>& weight = *layer.blobs()[0];
+    return 2. * top[0]->count() * (weight.count() / weight.shape(0)) *
+        top.size();
+  }
+  if (type == "Deconvolution") {
+    const Blob<Dtype>& weight = *layer.blobs()[0];
+    return 2. * bottom[0]->count() * (weight.count() / weight.shape(0)) *
+        bottom.size();
+  }
+  if (type == "InnerProduct") {
+    const int num_output = layer.layer_param().inner_product_param()
+        .num_output();
+    return 2. * layer.blobs()[0]->count() * (top[0]->count() / num_output);
+  }
+  // Everything else is costed as one operation per input or output element,
+  // whichever is larger.
+  double bottom_count = 0, top_count = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_count += bottom[i]->count();
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    top_count += top[i]->count();
+  }
+  return std::max(bottom_count, top_count);
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::Stop(int layer_id, bool backward) {
+  timer_.Stop();
+  const double dur_us = timer_.MicroSeconds();
+  Layer<Dtype>& layer = *net_.layers()[layer_id];
+  const vector<Blob<Dtype>*>& bottom = net_.bottom_vecs()[layer_id];
+  const vector<Blob<Dtype>*>& top = net_.top_vecs()[layer_id];
+  double bottom_bytes = 0, top_bytes = 0, param_bytes = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_bytes += bottom[i]->count() * sizeof(Dtype);
+  }
+  for (int i = 0; i < top.size(); ++i) {
+    top_bytes += top[i]->count() * sizeof(Dtype);
+  }
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    param_bytes += layer.blobs()[i]->count() * sizeof(Dtype);
+  }
+  LayerStats& s = stats_[layer_id];
+  s.memory_bytes = 2 * (top_bytes + param_bytes);
+  const double flops = ForwardFlops(layer_id);
+  if (backward) {
+    // Layers with params compute both the bottom and the param gradients.
+    ++s.backward_count;
+    s.backward_ms += dur_us / 1000.;
+    s.backward_flops += layer.blobs().size() > 0 ? 2 * flops : flops;
+    s.bytes_read += top_bytes + bottom_bytes + param_bytes;
+    s.bytes_written += bottom_bytes + param_bytes;
+  } else {
+    ++s.forward_count;
+    s.forward_ms += dur_us / 1000.;
+    s.forward_flops += flops;
+    s.bytes_read += bottom_bytes + param_bytes;
+    s.bytes_written += top_bytes;
+  }
+  if (events_.size() < max_trace_events_) {
+    TraceEvent event = { layer_id, backward, start_us_, dur_us };
+    events_.push_back(event);
+  } else {
+    ++dropped_events_;
+  }
+}
+
+template <typename Dtype>
+string NetProfiler<Dtype>::Summary() const {
+  double total_ms = 0;
+  vector<pair<double, int> > order;
+  for (int i = 0; i < stats_.size(); ++i) {
+    const double ms = stats_[i].forward_ms + stats_[i].backward_ms;
+    total_ms += ms;
+    order.push_back(make_pair(-ms, i));
+  }
+  std::sort(order.begin(), order.end());
+  ostringstream out;
+  out << std::fixed << std::setprecision(2);
+  out << std::left << std::setw(24) << "layer" << std::setw(18) << "type"
+      << std::right << std::setw(8) << "calls" << std::setw(12) << "fwd ms"
+      << std::setw(12) << "bwd ms" << std::setw(8) << "%"
+      << std::setw(10) << "GFLOP" << std::setw(10) << "GFLOP/s"
+      << std::setw(10) << "MB rd" << std::setw(10) << "MB wr"
+      << std::setw(10) << "mem MB" << "\n";
+  double total_flops = 0;
+  for (int j = 0; j < order.size(); ++j) {
+    const LayerStats& s = stats_[order[j].second];
+    const double ms = s.forward_ms + s.backward_ms;
+    const double gflop = (s.forward_flops + s.backward_flops) / 1e9;
+    total_flops += gflop;
+    out << std::left << std::setw(24) << s.name.substr(0, 23)
+        << std::setw(18) << s.type.substr(0, 17) << std::right
+        << std::setw(8) << s.forward_count
+        << std::setw(12) << s.forward_ms << std::setw(12) << s.backward_ms
+        << std::setw(8) << (total_ms > 0 ? 100 * ms / total_ms : 0.)
+        << std::setw(10) << gflop
+        << std::setw(10) << (ms > 0 ? gflop / ms * 1000 : 0.)
+        << std::setw(10) << s.bytes_read / 1e6
+        << std::setw(10) << s.bytes_written / 1e6
+        << std::setw(10) << s.memory_bytes / 1e6 << "\n";
+  }
+  out << "Total " << total_ms << " ms, " << total_flops << " GFLOP";
+  if (dropped_events_ > 0) {
+    out << " (" << dropped_events_ << " calls not kept in the trace)";
+  }
+  return out.str();
+}
+
+static string JsonEscape(const string& s) {
+  string escaped;
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      escaped += '\\';
+    }
+    escaped += s[i];
+  }
+  return escaped;
+}
+
+template <typename Dtype>
+void NetProfiler<Dtype>::WriteChromeTrace(const string& filename) const {
+  std::ofstream out(filename.c_str());
+  CHECK(out.good()) << "Failed to open trace file " << filename;
+  out << std::fixed << std::setprecision(1);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  for (int i = 0; i < events_.size(); ++i) {
+    const TraceEvent& e = events_[i];
+    const LayerStats& s = stats_[e.layer_id];
+    out << "{\"name\": \"" << JsonEscape(s.name) << "\", \"cat\": \""
+        << (e.backward ? "backward" : "forward")
+        << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << e.backward
+        << ", \"ts\": " << e.ts_us << ", \"dur\": " << e.dur_us
+        << ", \"args\": {\"type\": \"" << JsonEscape(s.type) << "\"}}"
+        << (i + 1 < events_.size() ? ",\n" : "\n");
+  }
+  out << "]}\n";
+  CHECK(out.good()) << "Failed to write trace file " << filename;
+}
+
+INSTANTIATE_CLASS(NetProfiler);
+
+}  // namespace caffe
@@ -0,0 +1,606 @@
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// floor(v + 0.5) as the truncation of v + 0.5, less one where that rounded
+// up, so that there is no call to floor.
+template <typename Dtype>
+static inline int8_t quantize_value(const Dtype x, const Dtype scale) {
+  const Dtype v = std::min(Dtype(127), std::max(Dtype(-127), x * scale))
+      + Dtype(0.5);
+  const int t = static_cast<int>(v);
+  return static_cast<int8_t>(t - (t > v));
+}
+
+template <typename Dtype>
+static void quantize_span(const int n, const Dtype scale, const Dtype* x,
+    int8_t* q) {
+  for (int i = 0; i < n; ++i) {
+    q[i] = quantize_value(x[i], scale);
+  }
+}
+
+#if defined(__GNUC__) && defined(__SSE2__)
+// Sixteen floats at a time. The compiler turns the saturation of the scalar
+// loop into branches, which mispredict on real activations; the vector
+// min/max do not branch.
+template <>
+void quantize_span<float>(const int n, const float scale, const float* x,
+    int8_t* q) {
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128 hi = _mm_set1_ps(127.f);
+  const __m128 lo = _mm_set1_ps(-127.f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v[4];
+    for (int j = 0; j < 4; ++j) {
+      __m128 f = _mm_mul_ps(_mm_loadu_ps(x + i + 4 * j), s);
+      f = _mm_add_ps(_mm_max_ps(_mm_min_ps(f, hi), lo), half);
+      const __m128i t = _mm_cvttps_epi32(f);
+      // The compare is all ones, -1, where the truncation rounded up.
+      v[j] = _mm_add_epi32(t, _mm_castps_si128(
+          _mm_cmpgt_ps(_mm_cvtepi32_ps(t), f)));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(q + i),
+        _mm_packs_epi16(_mm_packs_epi32(v[0], v[1]),
+                        _mm_packs_epi32(v[2], v[3])));
+  }
+  for (; i < n; ++i) {
+    q[i] = quantize_value(x[i], scale);
+  }
+}
+#endif
+
+template <typename Dtype>
+Dtype caffe_cpu_int8_scale(const int n, const Dtype* x) {
+  // Eight running maxima, so that the loop is not one long dependency chain.
+  Dtype lane_max[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    for (int j = 0; j < 8; ++j) {
+      lane_max[j] = std::max(lane_max[j], std::fabs(x[i + j]));
+    }
+  }
+  for (; i < n; ++i) {
+    lane_max[0] = std::max(lane_max[0], std::fabs(x[i]));
+  }
+  const Dtype max_abs = *std::max_element(lane_max, lane_max + 8);
+  return max_abs > 0 ? Dtype(127) / max_abs : Dtype(1);
+}
+
+template float caffe_cpu_int8_scale<float>(const int n, const float* x);
+template double caffe_cpu_int8_scale<double>(const int n, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* q) {
+  quantize_span(n, scale, x, q);
+}
+
+template void caffe_cpu_quantize<float>(const int n, const float scale,
+    const float* x, int8_t* q);
+template void caffe_cpu_quantize<double>(const int n, const double scale,
+    const double* x, int8_t* q);
+
+template <typename Dtype>
+void caffe_cpu_quantize_transpose(const int rows, const int cols,
+    const Dtype scale, const Dtype* x, int8_t* q) {
+  // Walk the source in row-major order and scatter into the transpose in
+  // tiles, so that both sides stay within a few cache lines.
+  const int kTile = 32;
+  for (int r0 = 0; r0 < rows; r0 += kTile) {
+    const int r1 = std::min(rows, r0 + kTile);
+    for (int c0 = 0; c0 < cols; c0 += kTile) {
+      const int c1 = std::min(cols, c0 + kTile);
+      for (int r = r0; r < r1; ++r) {
+        int8_t q_row[kTile];
+        quantize_span(c1 - c0, scale, x + r * cols + c0, q_row);
+        for (int c = c0; c < c1; ++c) {
+          q[c * rows + r] = q_row[c - c0];
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_quantize_transpose<float>(const int rows,
+    const int cols, const float scale, const float* x, int8_t* q);
+template void caffe_cpu_quantize_transpose<double>(const int rows,
+    const int cols, const double scale, const double* x, int8_t* q);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* x,
+    int8_t* q, Dtype* inv_scale) {
+  for (int r = 0; r < rows; ++r) {
+    const Dtype scale = caffe_cpu_int8_scale(cols, x + r * cols);
+    caffe_cpu_quantize(cols, scale, x + r * cols, q + r * cols);
+    inv_scale[r] = Dtype(1) / scale;
+  }
+}
+
+template void caffe_cpu_quantize_rows<float>(const int rows, const int cols,
+    const float* x, int8_t* q, float* inv_scale);
+template void caffe_cpu_quantize_rows<double>(const int rows, const int cols,
+    const double* x, int8_t* q, double* inv_scale);
+
+// C = A * B^T for an M x K block of A and an N x K block of B, rows K apart
+// (the rows are already laid out for dot products, so nothing is packed), into
+// C with rows ldc apart. The portable kernel: four columns of the output share
+// every load of an A row.
+static void gemm_int8_block(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C, const int ldc) {
+  for (int m = 0; m < M; ++m) {
+    const int8_t* a = A + m * K;
+    int32_t* c = C + m * ldc;
+    int n = 0;
+    for (; n + 4 <= N; n += 4) {
+      const int8_t* b0 = B + n * K;
+      const int8_t* b1 = b0 + K;
+      const int8_t* b2 = b1 + K;
+      const int8_t* b3 = b2 + K;
+      int32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+      for (int k = 0; k < K; ++k) {
+        const int32_t av = a[k];
+        s0 += av * b0[k];
+        s1 += av * b1[k];
+        s2 += av * b2[k];
+        s3 += av * b3[k];
+      }
+      c[n] = s0;
+      c[n + 1] = s1;
+      c[n + 2] = s2;
+      c[n + 3] = s3;
+    }
+    for (; n < N; ++n) {
+      const int8_t* b = B + n * K;
+      int32_t s = 0;
+      for (int k = 0; k < K; ++k) {
+        s += static_cast<int32_t>(a[k]) * b[k];
+      }
+      c[n] = s;
+    }
+  }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// The AVX2 kernel, compiled for AVX2 whatever the build flags and used when
+// the CPU has it. vpmaddubsw multiplies 32 unsigned by 32 signed bytes and
+// adds pairs into 16 bits: |a| times b with the sign of a, which cannot
+// saturate for values in [-127, 127]. vpmaddwd then widens to 32 bits.
+
+__attribute__((target("avx2")))
+static inline int32_t hsum_epi32_avx2(const __m256i v) {
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+      _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+// Adds the products of MR rows of A and NR rows of B over [k_begin, k_end)
+// to C, or stores them if !accumulate.
+template <int MR, int NR>
+__attribute__((target("avx2")))
+static inline void gemm_int8_tile_avx2(const int K, const int k_begin,
+    const int k_end, const int8_t* A, const int8_t* B, int32_t* C,
+    const int ldc, const bool accumulate) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc[MR][NR];
+  for (int i = 0; i < MR; ++i) {
+    for (int j = 0; j < NR; ++j) {
+      acc[i][j] = _mm256_setzero_si256();
+    }
+  }
+  int k = k_begin;
+  for (; k + 32 <= k_end; k += 32) {
+    __m256i b[NR];
+    for (int j = 0; j < NR; ++j) {
+      b[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+          B + j * K + k));
+    }
+    for (int i = 0; i < MR; ++i) {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+          A + i * K + k));
+      const __m256i a_abs = _mm256_abs_epi8(a);
+      for (int j = 0; j < NR; ++j) {
+        const __m256i pairs =
+            _mm256_maddubs_epi16(a_abs, _mm256_sign_epi8(b[j], a));
+        acc[i][j] = _mm256_add_epi32(acc[i][j],
+            _mm256_madd_epi16(pairs, ones));
+      }
+    }
+  }
+  for (int i = 0; i < MR; ++i) {
+    for (int j = 0; j < NR; ++j) {
+      int32_t s = hsum_epi32_avx2(acc[i][j]);
+      for (int kk = k; kk < k_end; ++kk) {
+        s += static_cast<int32_t>(A[i * K + kk]) * B[j * K + kk];
+      }
+      int32_t* c = C + i * ldc + j;
+      *c = accumulate ? *c + s : s;
+    }
+  }
+}
+
+// The AVX2 version of gemm_int8_block, in 2 x 4 tiles. The reduction axis is
+// split in blocks so that the 6 rows of a tile stay in L1.
+__attribute__((target("avx2")))
+static void gemm_int8_block_avx2(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C, const int ldc) {
+  const int kBlockK = 4096;
+  const int k_blocks = std::max(1, (K + kBlockK - 1) / kBlockK);
+  for (int block = 0; block < k_blocks; ++block) {
+    const int k0 = block * kBlockK;
+    const int k1 = std::min(K, k0 + kBlockK);
+    const bool accumulate = block > 0;
+    int m = 0;
+    for (; m + 2 <= M; m += 2) {
+      const int8_t* a = A + m * K;
+      int32_t* c = C + m * ldc;
+      int n = 0;
+      for (; n + 4 <= N; n += 4) {
+        gemm_int8_tile_avx2<2, 4>(K, k0, k1, a, B + n * K, c + n, ldc,
+            accumulate);
+      }
+      for (; n < N; ++n) {
+        gemm_int8_tile_avx2<2, 1>(K, k0, k1, a, B + n * K, c + n, ldc,
+            accumulate);
+      }
+    }
+    if (m < M) {
+      const int8_t* a = A + m * K;
+      int32_t* c = C + m * ldc;
+      int n = 0;
+      for (; n + 4 <= N; n += 4) {
+        gemm_int8_tile_avx2<1, 4>(K, k0, k1, a, B + n * K, c + n, ldc,
+            accumulate);
+      }
+      for (; n < N; ++n) {
+        gemm_int8_tile_avx2<1, 1>(K, k0, k1, a, B + n * K, c + n, ldc,
+            accumulate);
+      }
+    }
+  }
+}
+
+// The AVX-512 VNNI kernel, a register-blocked outer product on a packed
+// panel of B. vpdpbusd adds the products of 4 consecutive unsigned bytes by 4
+// signed bytes into each of 16 int32 lanes, without saturating: with B packed
+// so that a vector holds 4 reduction steps of 16 columns, one broadcast word
+// of A updates 16 outputs. A is made unsigned by flipping its sign bit, i.e.
+// adding 128, which adds 128 times the column sums of B; those are taken
+// back from the results.
+
+// Packs the columns [0, cols) of B (rows of the N x K matrix, K apart) over
+// the reduction range [k0, k1) in groups of 16 columns: group g is steps
+// vectors of 64 bytes, vector s holding bytes k0 + 4 s ... k0 + 4 s + 3 of
+// each column. Columns past cols and bytes past k1 are zero. col_sum gets 128
+// times the sum of each column over the range.
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void gemm_int8_pack_vnni(const int K, const int cols, const int k0,
+    const int k1, const int8_t* B, int8_t* packed, int32_t* col_sum) {
+  const int groups = (cols + 15) / 16;
+  const int steps = (k1 - k0 + 3) / 4;
+  const int full_steps = (k1 - k0) / 4;
+  int32_t* words = reinterpret_cast<int32_t*>(packed);
+  for (int g = 0; g < groups; ++g) {
+    int32_t* group = words + g * steps * 16;
+    for (int c = 0; c < 16; ++c) {
+      const int n = g * 16 + c;
+      if (n >= cols) {
+        for (int step = 0; step < steps; ++step) {
+          group[step * 16 + c] = 0;
+        }
+        continue;
+      }
+      const int8_t* src = B + n * K + k0;
+      for (int step = 0; step < full_steps; ++step) {
+        memcpy(&group[step * 16 + c], src + step * 4, 4);
+      }
+      if (full_steps < steps) {
+        int32_t word = 0;
+        memcpy(&word, src + full_steps * 4, k1 - k0 - full_steps * 4);
+        group[full_steps * 16 + c] = word;
+      }
+    }
+    const __m512i ones = _mm512_set1_epi8(1);
+    __m512i sum = _mm512_setzero_si512();
+    for (int step = 0; step < steps; ++step) {
+      sum = _mm512_dpbusd_epi32(sum, ones,
+          _mm512_loadu_si512(group + step * 16));
+    }
+    _mm512_storeu_si512(col_sum + g * 16,
+        _mm512_mullo_epi32(sum, _mm512_set1_epi32(128)));
+  }
+}
+
+// Adds one reduction step: the words of MR rows of A times NG packed vectors.
+template <int MR, int NG>
+__attribute__((target("avx512f,avx512bw,avx512vnni"), always_inline))
+static inline void gemm_int8_step_vnni(const int32_t* words,
+    const int8_t* packed, const int group_bytes, __m512i (*acc)[NG]) {
+  const int32_t flip = static_cast<int32_t>(0x80808080u);
+  __m512i b[NG];
+#pragma GCC unroll 2
+  for (int g = 0; g < NG; ++g) {
+    b[g] = _mm512_loadu_si512(packed + g * group_bytes);
+  }
+#pragma GCC unroll 8
+  for (int i = 0; i < MR; ++i) {
+    const __m512i a = _mm512_set1_epi32(words[i] ^ flip);
+#pragma GCC unroll 2
+    for (int g = 0; g < NG; ++g) {
+      acc[i][g] = _mm512_dpbusd_epi32(acc[i][g], a, b[g]);
+    }
+  }
+}
+
+// C[0, MR) x [0, cols) (= or +=) the products of MR rows of A (K apart,
+// starting at the reduction range) with NG packed groups of 16 columns.
+template <int MR, int NG>
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static inline void gemm_int8_tile_vnni(const int K, const int k_len,
+    const int8_t* A, const int8_t* packed, const int32_t* col_sum,
+    int32_t* C, const int ldc, const int cols, const bool accumulate) {
+  const int steps = (k_len + 3) / 4;
+  const int full_steps = k_len / 4;
+  const int group_bytes = steps * 64;
+  __m512i acc[MR][NG];
+  for (int i = 0; i < MR; ++i) {
+    for (int g = 0; g < NG; ++g) {
+      acc[i][g] = _mm512_setzero_si512();
+    }
+  }
+  int32_t words[MR];
+  for (int step = 0; step < full_steps; ++step) {
+#pragma GCC unroll 8
+    for (int i = 0; i < MR; ++i) {
+      memcpy(&words[i], A + i * K + step * 4, 4);
+    }
+    gemm_int8_step_vnni<MR, NG>(words, packed + step * 64, group_bytes, acc);
+  }
+  if (full_steps < steps) {
+    for (int i = 0; i < MR; ++i) {
+      words[i] = 0;
+      memcpy(&words[i], A + i * K + full_steps * 4, k_len - full_steps * 4);
+    }
+    gemm_int8_step_vnni<MR, NG>(words, packed + full_steps * 64, group_bytes,
+        acc);
+  }
+  for (int g = 0; g < NG; ++g) {
+    const int valid = std::min(16, cols - g * 16);
+    const __mmask16 mask = valid == 16 ? 0xFFFF : (1 << valid) - 1;
+    const __m512i sum = _mm512_loadu_si512(col_sum + g * 16);
+    for (int i = 0; i < MR; ++i) {
+      int32_t* c = C + i * ldc + g * 16;
+      __m512i r = _mm512_sub_epi32(acc[i][g], sum);
+      if (accumulate) {
+        r = _mm512_add_epi32(r, _mm512_maskz_loadu_epi32(mask, c));
+      }
+      _mm512_mask_storeu_epi32(c, mask, r);
+    }
+  }
+}
+
+// Runs MR rows of A over all the columns of a packed panel, 32 at a time.
+template <int MR>
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void gemm_int8_rows_vnni(const int K, const int k_len, const int8_t* A,
+    const int8_t* packed, const int32_t* col_sum, int32_t* C, const int ldc,
+    const int cols, const bool accumulate) {
+  const int group_bytes = (k_len + 3) / 4 * 64;
+  int n = 0;
+  for (; n + 16 < cols; n += 32) {
+    gemm_int8_tile_vnni<MR, 2>(K, k_len, A, packed + n / 16 * group_bytes,
+        col_sum + n, C + n, ldc, cols - n, accumulate);
+  }
+  if (n < cols) {
+    gemm_int8_tile_vnni<MR, 1>(K, k_len, A, packed + n / 16 * group_bytes,
+        col_sum + n, C + n, ldc, cols - n, accumulate);
+  }
+}
+
+// The VNNI version of gemm_int8_block, in 8 x 32 tiles. B is packed a panel
+// of columns and a block of the reduction axis at a time, small enough to
+// stay in L2 while all the rows of A go over it.
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void gemm_int8_block_vnni(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C, const int ldc) {
+  const int kBlockK = 1024;
+  const int kPanelCols = 256;
+  const int panel_cols = std::min(kPanelCols, (N + 15) / 16 * 16);
+  const int block_k = std::min(kBlockK, (K + 3) / 4 * 4);
+  vector<int8_t> packed(panel_cols * block_k);
+  vector<int32_t> col_sum(panel_cols);
+  for (int n0 = 0; n0 < N; n0 += kPanelCols) {
+    const int cols = std::min(kPanelCols, N - n0);
+    for (int k0 = 0; k0 < K || k0 == 0; k0 += kBlockK) {
+      const int k_len = std::min(kBlockK, K - k0);
+      const bool accumulate = k0 > 0;
+      gemm_int8_pack_vnni(K, cols, k0, k0 + k_len, B + n0 * K, &packed[0],
+          &col_sum[0]);
+      const int8_t* a = A + k0;
+      int32_t* c = C + n0;
+      int m = 0;
+      for (; m + 8 <= M; m += 8) {
+        gemm_int8_rows_vnni<8>(K, k_len, a + m * K, &packed[0], &col_sum[0],
+            c + m * ldc, ldc, cols, accumulate);
+      }
+      a += m * K;
+      c += m * ldc;
+      switch (M - m) {
+      case 7:
+        gemm_int8_rows_vnni<7>(K, k_len, a, &packed[0], &col_sum[0], c, ldc,
+            cols, accumulate);
+        break;
+      case 6:
+        gemm_int8_rows_vnni<6>(K, k_len, a, &packed[0], &col_sum[0], c, ldc,
+            cols, accumulate);
+        break;
+      case 5:
+        gemm_int8_rows_vnni<5>(K, k_len, a, &packed[0], &col_sum[0], c, ldc,
+            cols, accumulate);
+        break;
+      case 4:
+        gemm_int8_rows_vnni<4>(K, k_len, a, &packed[0], &col_sum[0], c, ldc,
+            cols, accumulate);
+        break;
+      case 3:
+        gemm_int8_rows_vnni<3>(K, k_len, a, &packed[0], &col_sum[0], c, ldc,
+            cols, accumulate);
+        break;
+      case 2:
+        gemm_int8_rows_vnni<2>(K, k_len, a, &packed[0], &col_sum[0], c, ldc,
+            cols, accumulate);
+        break;
+      case 1:
+        gemm_int8_rows_vnni<1>(K, k_len, a, &packed[0], &col_sum[0], c, ldc,
+            cols, accumulate);
+        break;
+      }
+    }
+  }
+}
+#endif
+
+// Runs gemm_int8_block over the columns of C, a panel of B at a time, so
+// that a panel stays in L2 while all the rows of A go over it.
+static void gemm_int8_panels(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C, const int ldc) {
+  const int kPanelBytes = 256 * 1024;
+  const int panel = std::max(4, kPanelBytes / std::max(K, 1) / 4 * 4);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  const bool vnni = __builtin_cpu_supports("avx512vnni") &&
+      __builtin_cpu_supports("avx512bw");
+  const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+  for (int n0 = 0; n0 < N; n0 += panel) {
+    const int cols = std::min(panel, N - n0);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if (vnni) {
+      gemm_int8_block_vnni(M, cols, K, A, B + n0 * K, C + n0, ldc);
+      continue;
+    }
+    if (avx2) {
+      gemm_int8_block_avx2(M, cols, K, A, B + n0 * K, C + n0, ldc);
+      continue;
+    }
+#endif
+    gemm_int8_block(M, cols, K, A, B + n0 * K, C + n0, ldc);
+  }
+}
+
+struct GemmInt8Parts {
+  int M, N, K;
+  const int8_t* A;
+  const int8_t* B;
+  int32_t* C;
+  int parts;
+  bool split_rows;
+};
+
+// Computes part `part` of the rows, or of the columns, of C.
+static void gemm_int8_part(const GemmInt8Parts* p, const int part) {
+  const int size = p->split_rows ? p->M : p->N;
+  const int begin = static_cast<int64_t>(size) * part / p->parts;
+  const int end = static_cast<int64_t>(size) * (part + 1) / p->parts;
+  if (p->split_rows) {
+    gemm_int8_panels(end - begin, p->N, p->K, p->A + begin * p->K, p->B,
+        p->C + begin * p->N, p->N);
+  } else {
+    gemm_int8_panels(p->M, end - begin, p->K, p->A, p->B + begin * p->K,
+        p->C + begin, p->N);
+  }
+}
+
+void caffe_cpu_gemm_int8(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C) {
+  // Small products are not worth splitting over threads.
+  const int64_t kMinWorkPerPart = 1 << 22;
+  const int64_t work = static_cast<int64_t>(M) * N * K;
+  shared_ptr<ThreadPool> pool;
+  int parts = 1;
+  if (work >= 2 * kMinWorkPerPart) {
+    pool = ThreadPool::Shared();
+    parts = std::min<int64_t>(pool->num_workers() + 1,
+        work / kMinWorkPerPart);
+  }
+  // Split the larger side, in parts of at least 4 columns or 2 rows.
+  const bool split_rows = M / 2 > N / 4;
+  parts = std::min(parts, std::max(1, split_rows ? M / 2 : N / 4));
+  if (parts == 1) {
+    gemm_int8_panels(M, N, K, A, B, C, N);
+    return;
+  }
+  const GemmInt8Parts p = { M, N, K, A, B, C, parts, split_rows };
+  pool->Run(parts, boost::bind(&gemm_int8_part, &p, _1));
+}
+
+template <typename Dtype>
+void caffe_cpu_requantize(const int M, const int N, const int32_t* C,
+    const Dtype alpha, const Dtype* row_scale, const Dtype* col_scale,
+    Dtype* Y) {
+  for (int m = 0; m < M; ++m) {
+    const Dtype row_alpha = row_scale ? alpha * row_scale[m] : alpha;
+    const int32_t* c = C + m * N;
+    Dtype* y = Y + m * N;
+    if (col_scale) {
+      for (int n = 0; n < N; ++n) {
+        y[n] = row_alpha * col_scale[n] * c[n];
+      }
+    } else {
+      for (int n = 0; n < N; ++n) {
+        y[n] = row_alpha * c[n];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_requantize<float>(const int M, const int N,
+    const int32_t* C, const float alpha, const float* row_scale,
+    const float* col_scale, float* Y);
+template void caffe_cpu_requantize<double>(const int M, const int N,
+    const int32_t* C, const double alpha, const double* row_scale,
+    const double* col_scale, double* Y);
+
+void QuantizeBlobProto(BlobProto* proto) {
+  const int count = proto->data_size();
+  if (count == 0) {
+    return;
+  }
+  int rows = 1;
+  if (proto->shape().dim_size() > 0) {
+    rows = proto->shape().dim(0);
+  } else if (proto->has_num()) {
+    rows = proto->num();
+  }
+  CHECK_GT(rows, 0);
+  CHECK_EQ(count % rows, 0) << "blob count is not a multiple of its num";
+  const int cols = count / rows;
+  vector<int8_t> q(count);
+  vector<float> inv_scale(rows);
+  caffe_cpu_quantize_rows(rows, cols, proto->data().data(), &q[0],
+      &inv_scale[0]);
+  proto->clear_data();
+  proto->clear_int8_scale();
+  for (int r = 0; r < rows; ++r) {
+    proto->add_int8_scale(1.f / inv_scale[r]);
+  }
+  proto->set_int8_data(string(reinterpret_cast<const char*>(&q[0]), count));
+}
+
+}  // namespace caffe
@@ -10,6 +10,7 @@ namespace {
   static volatile sig_atomic_t got_sigint = false;
   static volatile sig_atomic_t got_sighup = false;
   static bool already_hooked_up = false;
+  static bool sigterm_hooked_up = false;
 
   void handle_signal(int signal) {
     switch (signal) {
@@ -17,16 +18,18 @@ namespace {
       got_sighup = true;
       break;
     case SIGINT:
+    case SIGTERM:
       got_sigint = true;
       break;
     }
   }
 
-  void HookupHandler() {
+  void HookupHandler(bool handle_sigterm) {
     if (already_hooked_up) {
       LOG(FATAL) << "Tried to hookup signal handlers more than once.";
     }
     already_hooked_up = true;
+    sigterm_hooked_up = handle_sigterm;
 
     struct sigaction sa;
     // Setup the handler
@@ -42,6 +45,9 @@ namespace {
     if (sigaction(SIGINT, &sa, NULL) == -1) {
       LOG(FATAL) << "Cannot install SIGINT handler.";
     }
+    if (handle_sigterm && sigaction(SIGTERM, &sa, NULL) == -1) {
+      LOG(FATAL) << "Cannot install SIGTERM handler.";
+    }
   }
 
   // Set the signal handlers to the default.
@@ -61,6 +67,9 @@ namespace {
       if (sigaction(SIGINT, &sa, NULL) == -1) {
         LOG(FATAL) << "Cannot uninstall SIGINT handler.";
       }
+      if (sigterm_hooked_up && sigaction(SIGTERM, &sa, NULL) == -1) {
+        LOG(FATAL) << "Cannot uninstall SIGTERM handler.";
+      }
 
       already_hooked_up = false;
     }
@@ -86,10 +95,11 @@ namespace {
 namespace caffe {
 
 SignalHandler::SignalHandler(SolverAction::Enum SIGINT_action,
-                             SolverAction::Enum SIGHUP_action):
+                             SolverAction::Enum SIGHUP_action,
+                             bool handle_SIGTERM):
   SIGINT_action_(SIGINT_action),
   SIGHUP_action_(SIGHUP_action) {
-  HookupHandler();
+  HookupHandler(handle_SIGTERM);
 }
 
 SignalHandler::~SignalHandler() {
@@ -0,0 +1,134 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::SnapshotWriter(int max_pending) {
+  CHECK_GT(max_pending, 0);
+  for (int i = 0; i < max_pending; ++i) {
+    stagings_.push_back(shared_ptr<Staging>(new Staging()));
+    free_.push(stagings_.back().get());
+  }
+}
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::~SnapshotWriter() {
+  Flush();
+  this->StopInternalThread();
+}
+
+template <typename Dtype>
+typename SnapshotWriter<Dtype>::Staging* SnapshotWriter<Dtype>::Acquire() {
+  return free_.pop("Waiting for a pending snapshot to be written");
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Submit(Staging* staging) {
+  CHECK(this->is_started());
+  full_.push(staging);
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Release(Staging* staging) {
+  free_.push(staging);
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Flush() {
+  // All stagings are free once nothing is pending.
+  vector<Staging*> stagings;
+  for (int i = 0; i < stagings_.size(); ++i) {
+    stagings.push_back(free_.pop());
+  }
+  for (int i = 0; i < stagings.size(); ++i) {
+    free_.push(stagings[i]);
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::StageNet(const Net<Dtype>& net, bool write_diff,
+    Staging* staging) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net.layers();
+  NetParameter& net_param = staging->net_param;
+  net_param.Clear();
+  net_param.set_name(net.name());
+  staging->write_diff = write_diff;
+  staging->layer_blobs.resize(layers.size());
+  for (int i = 0; i < layers.size(); ++i) {
+    LayerParameter* layer_param = net_param.add_layer();
+    layer_param->CopyFrom(layers[i]->layer_param());
+    layer_param->clear_blobs();
+    StageBlobs(layers[i]->blobs(), write_diff, &staging->layer_blobs[i]);
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::StageBlobs(
+    const vector<shared_ptr<Blob<Dtype> > >& blobs, bool copy_diff,
+    vector<shared_ptr<Blob<Dtype> > >* staged) {
+  staged->resize(blobs.size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (!(*staged)[i]) {
+      (*staged)[i].reset(new Blob<Dtype>());
+    }
+    // Copy into host memory, in GPU mode too (where Blob::CopyFrom copies to
+    // the device), so that the writer thread never touches the GPU.
+    Blob<Dtype>* blob = (*staged)[i].get();
+    blob->ReshapeLike(*blobs[i]);
+    caffe_copy(blob->count(), blobs[i]->cpu_data(), blob->mutable_cpu_data());
+    if (copy_diff) {
+      caffe_copy(blob->count(), blobs[i]->cpu_diff(),
+          blob->mutable_cpu_diff());
+    }
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      Staging* staging = full_.pop();
+      Write(staging);
+      free_.push(staging);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Write(Staging* staging) {
+  NetParameter& net_param = staging->net_param;
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer_param = net_param.mutable_layer(i);
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = staging->layer_blobs[i];
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j]->ToProto(layer_param->add_blobs(), staging->write_diff);
+    }
+  }
+  WriteProtoToBinaryFile(net_param, staging->model_filename);
+  LOG(INFO) << "Wrote snapshot " << staging->model_filename;
+  // Only the staged blobs are kept for the next snapshot.
+  net_param.Clear();
+  if (staging->state_filename.empty()) {
+    return;
+  }
+  SolverState& state = staging->state;
+  state.clear_history();
+  for (int i = 0; i < staging->history.size(); ++i) {
+    staging->history[i]->ToProto(state.add_history());
+  }
+  WriteProtoToBinaryFile(state, staging->state_filename.c_str());
+  LOG(INFO) << "Wrote solver state " << staging->state_filename;
+  state.clear_history();
+}
+
+INSTANTIATE_CLASS(SnapshotWriter);
+
+}  // namespace caffe
@@ -0,0 +1,94 @@
+#include <boost/thread.hpp>
+#include <string>
+
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/spsc_queue.hpp"
+
+namespace caffe {
+
+// The indices are published with release stores and read with acquire loads,
+// so an element written to the ring is visible to the thread that sees the
+// index that covers it.
+static inline size_t load_acquire(const size_t* index) {
+  return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(size_t* index, size_t value) {
+  __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+// Spins for a few rounds, then yields, then sleeps for 100us at a time.
+static void backoff(int* round) {
+  const int kSpinRounds = 64;
+  const int kYieldRounds = 128;
+  ++*round;
+  if (*round < kSpinRounds) {
+    return;
+  }
+  boost::this_thread::interruption_point();
+  if (*round < kYieldRounds) {
+    boost::this_thread::yield();
+  } else {
+    boost::this_thread::sleep(boost::posix_time::microseconds(100));
+  }
+}
+
+template<typename T>
+SpscQueue<T>::SpscQueue(int capacity)
+    : buffer_(capacity), head_(0), tail_(0) {
+  CHECK_GT(capacity, 0);
+}
+
+template<typename T>
+bool SpscQueue<T>::try_push(const T& t) {
+  const size_t tail = tail_;
+  if (tail - load_acquire(&head_) == buffer_.size()) {
+    return false;
+  }
+  buffer_[tail % buffer_.size()] = t;
+  store_release(&tail_, tail + 1);
+  return true;
+}
+
+template<typename T>
+void SpscQueue<T>::push(const T& t) {
+  for (int round = 0; !try_push(t); ) {
+    backoff(&round);
+  }
+}
+
+template<typename T>
+bool SpscQueue<T>::try_pop(T* t) {
+  const size_t head = head_;
+  if (head == load_acquire(&tail_)) {
+    return false;
+  }
+  *t = buffer_[head % buffer_.size()];
+  store_release(&head_, head + 1);
+  return true;
+}
+
+template<typename T>
+T SpscQueue<T>::pop(const string& log_on_wait) {
+  T t;
+  for (int round = 0; !try_pop(&t); ) {
+    if (round == 0 && !log_on_wait.empty()) {
+      LOG_EVERY_N(INFO, 1000) << log_on_wait;
+    }
+    backoff(&round);
+  }
+  return t;
+}
+
+template<typename T>
+size_t SpscQueue<T>::size() const {
+  // head_ is read first: tail_ can only have grown since, so the difference
+  // never wraps around.
+  const size_t head = load_acquire(&head_);
+  return load_acquire(&tail_) - head;
+}
+
+template class SpscQueue<Batch<float>*>;
+template class SpscQueue<Batch<double>*>;
+
+}  // namespace caffe
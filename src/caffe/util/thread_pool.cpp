@@ -0,0 +1,129 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::Impl {
+ public:
+  explicit Impl(int num_workers) : num_workers_(num_workers), stop_(false) {
+    for (int i = 0; i < num_workers; ++i) {
+      threads_.create_thread(boost::bind(&Impl::WorkerEntry, this));
+    }
+  }
+  ~Impl() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    work_.notify_all();
+    threads_.join_all();
+  }
+
+  void Run(int num_tasks, const boost::function<void(int)>& task) {
+    if (num_tasks <= 1 || num_workers_ == 0) {
+      for (int i = 0; i < num_tasks; ++i) {
+        task(i);
+      }
+      return;
+    }
+    Job job = { &task, num_tasks, 0, num_tasks };
+    boost::mutex::scoped_lock lock(mutex_);
+    jobs_.push_back(&job);
+    work_.notify_all();
+    // The caller takes tasks of its own job along with the workers.
+    for (int i = Claim(&job); i >= 0; i = Claim(&job)) {
+      lock.unlock();
+      task(i);
+      lock.lock();
+      --job.pending;
+    }
+    while (job.pending > 0) {
+      done_.wait(lock);
+    }
+  }
+
+  int num_workers() const { return num_workers_; }
+
+ private:
+  struct Job {
+    const boost::function<void(int)>* task;
+    int num_tasks;
+    // The next task to hand out, and the number of tasks not done yet.
+    int next;
+    int pending;
+  };
+
+  // Hands out the next task of job, or returns -1 if all of them have been.
+  // A job leaves the queue with its last task. Called with mutex_ held.
+  int Claim(Job* job) {
+    if (job->next == job->num_tasks) {
+      return -1;
+    }
+    const int i = job->next++;
+    if (job->next == job->num_tasks) {
+      jobs_.erase(std::find(jobs_.begin(), jobs_.end(), job));
+    }
+    return i;
+  }
+
+  void WorkerEntry() {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (true) {
+      while (!stop_ && jobs_.empty()) {
+        work_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      Job* job = jobs_.front();
+      const int i = Claim(job);
+      lock.unlock();
+      (*job->task)(i);
+      lock.lock();
+      if (--job->pending == 0) {
+        done_.notify_all();
+      }
+    }
+  }
+
+  const int num_workers_;
+  boost::thread_group threads_;
+  boost::mutex mutex_;
+  // Signaled when jobs are queued or the pool stops, and when a job is done.
+  boost::condition_variable work_;
+  boost::condition_variable done_;
+  std::deque<Job*> jobs_;
+  bool stop_;
+};
+
+ThreadPool::ThreadPool(int num_workers) : impl_(new Impl(num_workers)) {
+  CHECK_GE(num_workers, 0);
+}
+
+ThreadPool::~ThreadPool() {}
+
+void ThreadPool::Run(int num_tasks, const boost::function<void(int)>& task) {
+  impl_->Run(num_tasks, task);
+}
+
+int ThreadPool::num_workers() const {
+  return impl_->num_workers();
+}
+
+static boost::mutex shared_pool_mutex_;
+static shared_ptr<ThreadPool> shared_pool_;
+
+shared_ptr<ThreadPool> ThreadPool::Shared() {
+  boost::mutex::scoped_lock lock(shared_pool_mutex_);
+  if (!shared_pool_) {
+    const int cpus = boost::thread::hardware_concurrency();
+    shared_pool_.reset(new ThreadPool(std::max(cpus - 1, 1)));
+  }
+  return shared_pool_;
+}
+
+}  // namespace caffe
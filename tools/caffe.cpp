@@ -6,6 +6,8 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <unistd.h>
+
 #include <cstring>
 #include <map>
 #include <string>
@@ -13,6 +15,9 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/inference_server.hpp"
+#include "caffe/util/cpu_topology.hpp"
+#include "caffe/util/flat_weights.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -30,6 +35,14 @@ DEFINE_string(gpu, "",
     "Optional; run in GPU mode on given device IDs separated by ','."
     "Use '-gpu all' to run on all available GPUs. The effective training "
     "batch size is multiplied by the number of devices.");
+DEFINE_int32(cpu_workers, 1,
+    "Optional; in CPU mode, train with this many solver threads sharing the "
+    "weights. The effective training batch size is multiplied by the number "
+    "of workers.");
+DEFINE_int32(numa_node, -1,
+    "Optional; in CPU mode, pin the training threads to the CPUs of this "
+    "NUMA node and place their memory there. With --cpu_workers, workers "
+    "are spread over the nodes round robin starting from this one.");
 DEFINE_string(solver, "",
     "The solver definition protocol buffer text file.");
 DEFINE_string(model, "",
@@ -41,6 +54,28 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(profile_interval, -1,
+    "Optional; profile the train net and log a per-layer summary every "
+    "this many iterations, overriding the solver's profile_interval.");
+DEFINE_string(profile_trace, "",
+    "Optional; also write a Chrome trace of each profile interval to "
+    "<profile_trace>_iter_<iter>.json.");
+DEFINE_string(listen, "",
+    "For serve; the address to listen on, unix:PATH for a Unix domain "
+    "socket or tcp:PORT for a port of localhost.");
+DEFINE_int32(serve_threads, 1,
+    "For serve; the number of threads running batches, each with a net "
+    "sharing the weights.");
+DEFINE_int32(max_batch_size, 32,
+    "For serve; the max number of items run in a batch.");
+DEFINE_int32(max_batch_delay_us, 2000,
+    "For serve; the max time a request waits for others to batch with.");
+DEFINE_string(outputs, "",
+    "For serve; the blobs returned for each request, separated by ','. "
+    "Defaults to the outputs of the net.");
+DEFINE_int32(stats_interval, 10,
+    "For serve; the interval in seconds between logs of the statistics, "
+    "0 for none.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -159,6 +194,12 @@ int train() {
 
   caffe::SolverParameter solver_param;
   caffe::ReadSolverParamsFromTextFileOrDie(FLAGS_solver, &solver_param);
+  if (FLAGS_profile_interval >= 0) {
+    solver_param.set_profile_interval(FLAGS_profile_interval);
+  }
+  if (FLAGS_profile_trace.size()) {
+    solver_param.set_profile_trace(FLAGS_profile_trace);
+  }
 
   // If the gpus flag is not provided, allow the mode and device to be set
   // in the solver prototxt.
@@ -174,9 +215,19 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  CHECK_GT(FLAGS_cpu_workers, 0);
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(FLAGS_cpu_workers);
+    if (FLAGS_numa_node >= 0) {
+      const caffe::CPUTopology& topology = caffe::CPUTopology::Get();
+      LOG(INFO) << "CPU topology: " << topology.Describe();
+      CHECK_LT(FLAGS_numa_node, topology.num_nodes()) << "No such NUMA node.";
+      Caffe::set_numa_node(FLAGS_numa_node);
+      LOG(INFO) << "Training threads pinned to NUMA node " << FLAGS_numa_node
+          << ", CPUs " << caffe::FormatCPUList(topology.cpus(FLAGS_numa_node));
+    }
   } else {
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
@@ -215,6 +266,9 @@ int train() {
   if (gpus.size() > 1) {
     caffe::P2PSync<float> sync(solver, NULL, solver->param());
     sync.Run(gpus);
+  } else if (gpus.size() == 0 && FLAGS_cpu_workers > 1) {
+    caffe::CPUSync<float> sync(solver);
+    sync.Run(FLAGS_cpu_workers);
   } else {
     LOG(INFO) << "Starting Optimization";
     solver->Solve();
@@ -248,7 +302,12 @@ int test() {
   }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST);
-  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  if (caffe::IsFlatWeightsFilename(FLAGS_weights)) {
+    // Scoring never writes the weights, so they can alias the mapped file.
+    caffe_net.CopyTrainedLayersFromFlat(FLAGS_weights, true);
+  } else {
+    caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<int> test_score_output_id;
@@ -297,6 +356,66 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Serve: run the requests of clients through the model in dynamic batches.
+int serve() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to serve.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to serve.";
+  CHECK_GT(FLAGS_listen.size(), 0) << "Need an address to listen on.";
+
+  // Set device id and mode
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  caffe::NetPool<float> pool(FLAGS_model, caffe::TEST, FLAGS_weights,
+      FLAGS_serve_threads);
+  vector<string> outputs;
+  if (FLAGS_outputs.size()) {
+    boost::split(outputs, FLAGS_outputs, boost::is_any_of(","));
+  }
+  CHECK_GE(FLAGS_stats_interval, 0) << "stats_interval must not be negative.";
+  caffe::InferenceServer server(&pool, outputs, FLAGS_max_batch_size,
+      FLAGS_max_batch_delay_us);
+  // SIGINT and SIGTERM stop the server, which closes the connections and
+  // removes a Unix socket.
+  caffe::SignalHandler signal_handler(caffe::SolverAction::STOP,
+      caffe::SolverAction::NONE, true);
+  caffe::ActionCallback requested_action = signal_handler.GetActionFunction();
+  server.Listen(FLAGS_listen);
+  const int kPollMs = 100;
+  int elapsed_ms = 0;
+  while (requested_action() != caffe::SolverAction::STOP) {
+    usleep(kPollMs * 1000);
+    elapsed_ms += kPollMs;
+    if (FLAGS_stats_interval == 0
+        || elapsed_ms < FLAGS_stats_interval * 1000) {
+      continue;
+    }
+    elapsed_ms = 0;
+    caffe::InferenceServerStats stats;
+    server.TakeStats(&stats);
+    if (stats.requests == 0) {
+      continue;
+    }
+    LOG(INFO) << stats.requests / stats.seconds << " requests/s, "
+        << stats.items / stats.seconds << " items/s, "
+        << static_cast<float>(stats.items) / stats.batches
+        << " items per batch, latency p50 " << stats.p50_ms << " ms, p99 "
+        << stats.p99_ms << " ms";
+  }
+  LOG(INFO) << "Stopping the server.";
+  server.Stop();
+  return 0;
+}
+RegisterBrewFunction(serve);
+
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
@@ -397,6 +516,7 @@ int main(int argc, char** argv) {
       "commands:\n"
       "  train           train or finetune a model\n"
       "  test            score a model\n"
+      "  serve           serve a model over a socket, batching requests\n"
       "  device_query    show GPU diagnostic information\n"
       "  time            benchmark model execution time");
   // Run tool or show usage.
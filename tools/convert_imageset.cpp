@@ -7,6 +7,11 @@
 // should be a list of files as well as their labels, in the format as
 //   subfolder1/file1.JPEG 7
 //   ....
+//
+// The images are read and encoded by --threads threads, in blocks of
+// --batch_size images that are committed in order, one transaction each.
+// With --mean_file, the mean image is computed in the same pass, as
+// compute_image_mean would compute it from the resulting database.
 
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
@@ -14,12 +19,15 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/db_lmdb.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
@@ -42,6 +50,191 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 0,
+    "Number of threads reading the images; 0 uses one per core");
+DEFINE_int32(batch_size, 1000,
+    "Number of images committed to the db per transaction");
+DEFINE_int32(lmdb_map_size, 0,
+    "Optional: Initial size of the lmdb map in MB, which otherwise doubles "
+    "each time a transaction fills it");
+DEFINE_string(mean_file, "",
+    "Optional: Write the mean image to this file while converting the images");
+
+#ifdef USE_OPENCV
+// Reads blocks of images on a pool of threads, while the main thread
+// writes the blocks to the db in the order of the list.
+class ImagesetConverter {
+ public:
+  ImagesetConverter(const std::vector<std::pair<std::string, int> >& lines,
+      const std::string& root_folder, int num_threads)
+      : lines_(lines), root_folder_(root_folder),
+        num_blocks_((lines.size() + FLAGS_batch_size - 1) / FLAGS_batch_size),
+        blocks_(2 * num_threads), next_block_(0), written_blocks_(0),
+        sums_(num_threads), counts_(num_threads, 0), data_size_(-1) {
+    for (int i = 0; i < num_threads; ++i) {
+      threads_.create_thread(boost::bind(&ImagesetConverter::Read, this, i));
+    }
+  }
+  ~ImagesetConverter() {
+    threads_.interrupt_all();
+    threads_.join_all();
+  }
+
+  void Write(db::DB* db) {
+    int count = 0;
+    for (int b = 0; b < num_blocks_; ++b) {
+      Block& block = blocks_[b % blocks_.size()];
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (!block.done) {
+          condition_.wait(lock);
+        }
+      }
+      scoped_ptr<db::Transaction> txn(db->NewTransaction());
+      for (int i = 0; i < block.records.size(); ++i) {
+        txn->Put(block.records[i].first, block.records[i].second);
+      }
+      txn->Commit();
+      count += block.records.size();
+      LOG(INFO) << "Processed " << count << " files.";
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        block.records.clear();
+        block.done = false;
+        ++written_blocks_;
+      }
+      condition_.notify_all();
+    }
+  }
+
+  // Sums the images read by all threads into the mean image.
+  void GetMean(BlobProto* mean) {
+    CHECK_GE(data_size_, 0) << "No image was converted";
+    mean->set_num(1);
+    mean->set_channels(mean_shape_.channels());
+    mean->set_height(mean_shape_.height());
+    mean->set_width(mean_shape_.width());
+    int count = 0;
+    for (int i = 0; i < counts_.size(); ++i) {
+      count += counts_[i];
+    }
+    for (int j = 0; j < data_size_; ++j) {
+      double sum = 0;
+      for (int i = 0; i < sums_.size(); ++i) {
+        sum += sums_[i].empty() ? 0 : sums_[i][j];
+      }
+      mean->add_data(sum / count);
+    }
+    LOG(INFO) << "Computed the mean of " << count << " images.";
+  }
+
+ protected:
+  struct Block {
+    Block() : done(false) {}
+    bool done;
+    // The keys and serialized datums of the images of the block
+    std::vector<std::pair<std::string, std::string> > records;
+  };
+
+  void Read(int thread_id) {
+    try {
+      while (true) {
+        int b;
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          // Stay at most blocks_.size() blocks ahead of the writer
+          while (next_block_ < num_blocks_ &&
+              next_block_ >= written_blocks_ + blocks_.size()) {
+            condition_.wait(lock);
+          }
+          if (next_block_ == num_blocks_) {
+            return;
+          }
+          b = next_block_++;
+        }
+        Block& block = blocks_[b % blocks_.size()];
+        const int end = std::min<int>((b + 1) * FLAGS_batch_size,
+            lines_.size());
+        for (int line_id = b * FLAGS_batch_size; line_id < end; ++line_id) {
+          ReadOne(thread_id, line_id, &block);
+        }
+        {
+          boost::mutex::scoped_lock lock(mutex_);
+          block.done = true;
+        }
+        condition_.notify_all();
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted exception is expected on shutdown
+    }
+  }
+
+  void ReadOne(int thread_id, int line_id, Block* block) {
+    std::string enc = FLAGS_encode_type;
+    if (FLAGS_encoded && !enc.size()) {
+      // Guess the encoding type from the file name
+      string fn = lines_[line_id].first;
+      size_t p = fn.rfind('.');
+      if ( p == fn.npos )
+        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+      enc = fn.substr(p);
+      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    }
+    Datum datum;
+    bool status = ReadImageToDatum(root_folder_ + lines_[line_id].first,
+        lines_[line_id].second, std::max<int>(0, FLAGS_resize_height),
+        std::max<int>(0, FLAGS_resize_width), !FLAGS_gray, enc, &datum);
+    if (status == false) return;
+    const bool compute_mean = FLAGS_mean_file.size();
+    Datum decoded;
+    if (compute_mean) {
+      decoded = datum;
+      DecodeDatumNative(&decoded);
+    }
+    const Datum& shape = compute_mean ? decoded : datum;
+    const int data_size = shape.channels() * shape.height() * shape.width();
+    if (FLAGS_check_size || compute_mean) {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (data_size_ < 0) {
+        data_size_ = data_size;
+        mean_shape_ = shape;
+      } else {
+        CHECK_EQ(data_size, data_size_) << "Incorrect data field size "
+            << data_size << " of " << lines_[line_id].first;
+      }
+    }
+    if (compute_mean) {
+      const std::string& data = decoded.data();
+      std::vector<double>& sum = sums_[thread_id];
+      sum.resize(data.size(), 0);
+      for (int i = 0; i < data.size(); ++i) {
+        sum[i] += static_cast<uint8_t>(data[i]);
+      }
+      ++counts_[thread_id];
+    }
+    // sequential
+    string key_str = caffe::format_int(line_id, 8) + "_" + lines_[line_id].first;
+    string out;
+    CHECK(datum.SerializeToString(&out));
+    block->records.push_back(std::make_pair(key_str, out));
+  }
+
+  const std::vector<std::pair<std::string, int> >& lines_;
+  const std::string root_folder_;
+  const int num_blocks_;
+  std::vector<Block> blocks_;
+  int next_block_;
+  int written_blocks_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  boost::thread_group threads_;
+  // The sum of the images read by each thread, for the mean
+  std::vector<std::vector<double> > sums_;
+  std::vector<int> counts_;
+  int data_size_;
+  Datum mean_shape_;
+};
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -66,11 +259,6 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  const bool is_color = !FLAGS_gray;
-  const bool check_size = FLAGS_check_size;
-  const bool encoded = FLAGS_encoded;
-  const string encode_type = FLAGS_encode_type;
-
   std::ifstream infile(argv[2]);
   std::vector<std::pair<std::string, int> > lines;
   std::string line;
@@ -88,69 +276,35 @@ int main(int argc, char** argv) {
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
 
-  if (encode_type.size() && !encoded)
+  if (FLAGS_encode_type.size() && !FLAGS_encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
-
-  int resize_height = std::max<int>(0, FLAGS_resize_height);
-  int resize_width = std::max<int>(0, FLAGS_resize_width);
+  CHECK_GT(FLAGS_batch_size, 0);
+  int num_threads = FLAGS_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max<int>(1, boost::thread::hardware_concurrency());
+  }
+  LOG(INFO) << "Reading the images with " << num_threads << " threads.";
 
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+#ifdef USE_LMDB
+  db::LMDB* lmdb = dynamic_cast<db::LMDB*>(db.get());
+  if (lmdb && FLAGS_lmdb_map_size > 0) {
+    lmdb->SetMapSize(static_cast<size_t>(FLAGS_lmdb_map_size) << 20);
+  }
+#endif  // USE_LMDB
 
   // Storing to db
-  std::string root_folder(argv[1]);
-  Datum datum;
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
-      }
-    }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
+  ImagesetConverter converter(lines, argv[1], num_threads);
+  converter.Write(db.get());
+  db->Close();
 
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
-    }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
+  if (FLAGS_mean_file.size()) {
+    BlobProto mean;
+    converter.GetMean(&mean);
+    LOG(INFO) << "Write the mean to " << FLAGS_mean_file;
+    WriteProtoToBinaryFile(mean, FLAGS_mean_file);
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
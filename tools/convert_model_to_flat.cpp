@@ -0,0 +1,63 @@
+// This program converts trained weights to the flat format, which nets load
+// by memory mapping the file (see caffe/util/flat_weights.hpp).
+// Usage:
+//    convert_model_to_flat [FLAGS] INPUT_CAFFEMODEL OUTPUT_FILE
+//
+// The input is a binary proto .caffemodel, upgraded if needed. The output
+// should have the .caffeflat extension for Net::CopyTrainedLayersFrom to
+// recognize it.
+
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/flat_weights.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_bool(double, false,
+    "Store the weights as double instead of float.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert trained weights to the flat format\n"
+        "that nets load by memory mapping.\n"
+        "Usage:\n"
+        "    convert_model_to_flat [FLAGS] INPUT_CAFFEMODEL OUTPUT_FILE\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/convert_model_to_flat");
+    return 1;
+  }
+  const string input_filename(argv[1]);
+  const string output_filename(argv[2]);
+  if (!IsFlatWeightsFilename(output_filename)) {
+    LOG(WARNING) << output_filename << " does not end with "
+        << kFlatWeightsExtension << "; Net::CopyTrainedLayersFrom will not "
+        << "recognize it as flat weights.";
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(input_filename, &net_param);
+  if (FLAGS_double) {
+    WriteFlatWeights<double>(net_param, output_filename);
+  } else {
+    WriteFlatWeights<float>(net_param, output_filename);
+  }
+  LOG(INFO) << "Wrote the weights of " << input_filename << " to "
+      << output_filename;
+  return 0;
+}
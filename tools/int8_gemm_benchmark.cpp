@@ -0,0 +1,148 @@
+// This program times the INT8 CPU matrix product against the float one it
+// replaces in the INT8 Convolution and InnerProduct layers.
+// Usage:
+//   int8_gemm_benchmark [FLAGS]
+//
+// C = A * B^T is computed for an M x K matrix A and an N x K matrix B, with
+// caffe_cpu_gemm<float> and with caffe_cpu_gemm_int8. The int8 time is given
+// both for the product alone and with the quantization of A and the
+// requantization of C around it, as the layers run it. The defaults are the
+// shape of a 3x3 convolution with 64 input and output channels on a 56x56
+// map; an InnerProduct layer is M = batch size, N = num_output, K = inputs.
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(M, 64, "The rows of A and C.");
+DEFINE_int32(N, 3136, "The rows of B, the columns of C.");
+DEFINE_int32(K, 576, "The reduction dimension.");
+DEFINE_int32(iterations, 50, "The number of products to time.");
+
+// Returns the mean milliseconds of FLAGS_iterations calls to fn, after one
+// warm-up call.
+template <typename Fn>
+static double TimeMs(Fn fn) {
+  fn();
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    fn();
+  }
+  timer.Stop();
+  return timer.MilliSeconds() / FLAGS_iterations;
+}
+
+struct FloatGemm {
+  const Blob<float>* a;
+  const Blob<float>* b;
+  Blob<float>* c;
+  void operator()() const {
+    caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, FLAGS_M, FLAGS_N, FLAGS_K,
+        1.f, a->cpu_data(), b->cpu_data(), 0.f, c->mutable_cpu_data());
+  }
+};
+
+struct Int8Gemm {
+  const int8_t* a;
+  const int8_t* b;
+  int32_t* c;
+  void operator()() const {
+    caffe_cpu_gemm_int8(FLAGS_M, FLAGS_N, FLAGS_K, a, b, c);
+  }
+};
+
+// The product with the work the layers do around it.
+struct Int8GemmWithQuantization {
+  const Blob<float>* a;
+  int8_t* a_int8;
+  const int8_t* b;
+  const float* b_inv_scale;
+  int32_t* c_int32;
+  Blob<float>* c;
+  void operator()() const {
+    const int count = FLAGS_M * FLAGS_K;
+    const float scale = caffe_cpu_int8_scale(count, a->cpu_data());
+    caffe_cpu_quantize(count, scale, a->cpu_data(), a_int8);
+    caffe_cpu_gemm_int8(FLAGS_M, FLAGS_N, FLAGS_K, a_int8, b, c_int32);
+    caffe_cpu_requantize<float>(FLAGS_M, FLAGS_N, c_int32, 1.f / scale,
+        NULL, b_inv_scale, c->mutable_cpu_data());
+  }
+};
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time the INT8 CPU matrix product against the\n"
+        "float one.\n"
+        "Usage:\n"
+        "    int8_gemm_benchmark [--M=...] [--N=...] [--K=...]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_M, 0);
+  CHECK_GT(FLAGS_N, 0);
+  CHECK_GT(FLAGS_K, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+  Caffe::set_mode(Caffe::CPU);
+
+  Blob<float> a(1, 1, FLAGS_M, FLAGS_K);
+  Blob<float> b(1, 1, FLAGS_N, FLAGS_K);
+  Blob<float> c(1, 1, FLAGS_M, FLAGS_N);
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  filler.Fill(&a);
+  filler.Fill(&b);
+  vector<int8_t> a_int8(FLAGS_M * FLAGS_K);
+  vector<int8_t> b_int8(FLAGS_N * FLAGS_K);
+  vector<float> b_inv_scale(FLAGS_N);
+  vector<int32_t> c_int32(FLAGS_M * FLAGS_N);
+  caffe_cpu_quantize(a.count(), caffe_cpu_int8_scale(a.count(), a.cpu_data()),
+      a.cpu_data(), &a_int8[0]);
+  caffe_cpu_quantize_rows(FLAGS_N, FLAGS_K, b.cpu_data(), &b_int8[0],
+      &b_inv_scale[0]);
+
+  const FloatGemm float_gemm = { &a, &b, &c };
+  const Int8Gemm int8_gemm = { &a_int8[0], &b_int8[0], &c_int32[0] };
+  const Int8GemmWithQuantization int8_layer_gemm = { &a, &a_int8[0],
+      &b_int8[0], &b_inv_scale[0], &c_int32[0], &c };
+  const double float_ms = TimeMs(float_gemm);
+  const double int8_ms = TimeMs(int8_gemm);
+  const double int8_layer_ms = TimeMs(int8_layer_gemm);
+
+  // The relative error of the int8 result.
+  Blob<float> ref_c(1, 1, FLAGS_M, FLAGS_N);
+  caffe_cpu_gemm<float>(CblasNoTrans, CblasTrans, FLAGS_M, FLAGS_N, FLAGS_K,
+      1.f, a.cpu_data(), b.cpu_data(), 0.f, ref_c.mutable_cpu_data());
+  caffe_sub(c.count(), c.cpu_data(), ref_c.cpu_data(), c.mutable_cpu_diff());
+  const float error = std::sqrt(c.sumsq_diff() / ref_c.sumsq_data());
+
+  const double gops = 2e-6 * FLAGS_M * FLAGS_N * FLAGS_K;
+  LOG(INFO) << "M = " << FLAGS_M << ", N = " << FLAGS_N << ", K = "
+      << FLAGS_K;
+  LOG(INFO) << "float:                " << float_ms << " ms, "
+      << gops / float_ms << " GOPS";
+  LOG(INFO) << "int8:                 " << int8_ms << " ms, "
+      << gops / int8_ms << " GOPS, " << float_ms / int8_ms << "x";
+  LOG(INFO) << "int8 + (re)quantize:  " << int8_layer_ms << " ms, "
+      << float_ms / int8_layer_ms << "x";
+  LOG(INFO) << "int8 relative error:  " << error;
+  return 0;
+}
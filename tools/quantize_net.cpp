@@ -0,0 +1,242 @@
+// This program calibrates and writes an INT8 version of a trained net.
+// Usage:
+//   quantize_net [FLAGS] --model=NET_PROTOTXT --weights=NET_CAFFEMODEL
+//       --output_model=INT8_PROTOTXT --output_weights=INT8_CAFFEMODEL
+//
+// The net is run in the TEST phase over --iterations batches to collect the
+// activation range seen by every Convolution and InnerProduct layer. Those
+// layers get a quantization_param { precision: INT8 bottom_scale: ... } in the
+// output prototxt, and their weights are stored as int8 in the output model.
+// If --feature_blob is given, the same batches are run through the INT8 net
+// and the Recall@K of the float and INT8 embeddings is reported side by side.
+// The data layer must produce the same batches on both runs (e.g. no shuffle).
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/algorithm/string.hpp"
+#include "boost/lexical_cast.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "",
+    "The float model definition protocol buffer text file.");
+DEFINE_string(weights, "",
+    "The trained float weights.");
+DEFINE_int32(iterations, 50,
+    "The number of calibration batches to run.");
+DEFINE_string(output_model, "",
+    "Where to write the INT8 model definition.");
+DEFINE_string(output_weights, "",
+    "Where to write the INT8 weights.");
+DEFINE_string(feature_blob, "",
+    "Optional; the embedding blob used to report the Recall@K drift.");
+DEFINE_string(label_blob, "label",
+    "The label blob used to compute Recall@K.");
+DEFINE_string(recall_k, "1,5,10",
+    "The values of K to report Recall@K for, separated by ','.");
+
+static bool IsQuantizable(const Layer<float>& layer) {
+  const string type = layer.type();
+  return type == "Convolution" || type == "InnerProduct";
+}
+
+// Runs the net for FLAGS_iterations batches, layer by layer, and appends the
+// feature and label blobs to features / labels. If max_abs is not NULL, the
+// largest bottom magnitude of every quantizable layer is recorded in it.
+// Returns the time spent in the layers, in milliseconds.
+static float RunNet(Net<float>* net, map<string, float>* max_abs,
+    vector<float>* features, vector<float>* labels, int* feature_dim) {
+  const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = net->bottom_vecs();
+  CPUTimer timer;
+  float forward_ms = 0;
+  for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+    for (int i = 0; i < layers.size(); ++i) {
+      if (max_abs && IsQuantizable(*layers[i])) {
+        const Blob<float>& bottom = *bottom_vecs[i][0];
+        const float scale = caffe_cpu_int8_scale(bottom.count(),
+            bottom.cpu_data());
+        float& layer_max = (*max_abs)[net->layer_names()[i]];
+        layer_max = std::max(layer_max, 127.f / scale);
+      }
+      timer.Start();
+      net->ForwardFromTo(i, i);
+      forward_ms += timer.MilliSeconds();
+    }
+    if (!FLAGS_feature_blob.empty()) {
+      const shared_ptr<Blob<float> > feature =
+          net->blob_by_name(FLAGS_feature_blob);
+      const shared_ptr<Blob<float> > label =
+          net->blob_by_name(FLAGS_label_blob);
+      CHECK(feature) << "Unknown feature blob " << FLAGS_feature_blob;
+      CHECK(label) << "Unknown label blob " << FLAGS_label_blob;
+      CHECK_EQ(feature->num(), label->count());
+      *feature_dim = feature->count() / feature->num();
+      features->insert(features->end(), feature->cpu_data(),
+          feature->cpu_data() + feature->count());
+      labels->insert(labels->end(), label->cpu_data(),
+          label->cpu_data() + label->count());
+    }
+  }
+  return forward_ms;
+}
+
+// Fraction of samples that have a sample of the same label among their k
+// nearest neighbours (squared Euclidean distance, excluding themselves).
+static vector<float> RecallAtK(const vector<float>& features,
+    const vector<float>& labels, const int dim, const vector<int>& ks) {
+  const int num = labels.size();
+  const int max_k = *std::max_element(ks.begin(), ks.end());
+  vector<int> hits(ks.size(), 0);
+  vector<pair<float, int> > dist(num);
+  for (int i = 0; i < num; ++i) {
+    const float* fi = &features[i * dim];
+    for (int j = 0; j < num; ++j) {
+      const float* fj = &features[j * dim];
+      float d = 0;
+      for (int c = 0; c < dim; ++c) {
+        d += (fi[c] - fj[c]) * (fi[c] - fj[c]);
+      }
+      dist[j] = make_pair(i == j ? FLT_MAX : d, j);
+    }
+    const int top = std::min(max_k, num - 1);
+    std::partial_sort(dist.begin(), dist.begin() + top, dist.end());
+    int first_hit = num;
+    for (int r = 0; r < top; ++r) {
+      if (labels[dist[r].second] == labels[i]) {
+        first_hit = r;
+        break;
+      }
+    }
+    for (int k = 0; k < ks.size(); ++k) {
+      hits[k] += first_hit < ks[k];
+    }
+  }
+  vector<float> recall(ks.size());
+  for (int k = 0; k < ks.size(); ++k) {
+    recall[k] = num > 0 ? static_cast<float>(hits[k]) / num : 0;
+  }
+  return recall;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Calibrate a trained net and write its INT8\n"
+        "CPU inference version.\n"
+        "Usage:\n"
+        "    quantize_net [FLAGS] --model=... --weights=...\n"
+        "        --output_model=... --output_weights=...\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_model.empty() || FLAGS_weights.empty() ||
+      FLAGS_output_model.empty() || FLAGS_output_weights.empty()) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/quantize_net");
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+
+  vector<int> ks;
+  vector<string> k_strings;
+  boost::split(k_strings, FLAGS_recall_k, boost::is_any_of(","));
+  for (int i = 0; i < k_strings.size(); ++i) {
+    ks.push_back(boost::lexical_cast<int>(k_strings[i]));
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+  net_param.mutable_state()->set_phase(TEST);
+
+  // Calibrate with the float net.
+  map<string, float> max_abs;
+  vector<float> float_features, float_labels;
+  int feature_dim = 0;
+  NetParameter int8_weights;
+  float float_ms;
+  {
+    Net<float> net(net_param);
+    net.CopyTrainedLayersFrom(FLAGS_weights);
+    LOG(INFO) << "Calibrating over " << FLAGS_iterations << " batches.";
+    float_ms = RunNet(&net, &max_abs, &float_features, &float_labels,
+        &feature_dim);
+    net.ToProto(&int8_weights);
+  }
+  // The float net is destroyed at this point, so the INT8 net's data layer
+  // starts reading from the beginning of the source again.
+
+  NetParameter int8_param(net_param);
+  const int float_bytes = int8_weights.ByteSize();
+  for (int i = 0; i < int8_param.layer_size(); ++i) {
+    LayerParameter* layer_param = int8_param.mutable_layer(i);
+    if (!max_abs.count(layer_param->name())) {
+      continue;
+    }
+    const float range = max_abs[layer_param->name()];
+    QuantizationParameter* quant_param =
+        layer_param->mutable_quantization_param();
+    quant_param->set_precision(QuantizationParameter_Precision_INT8);
+    quant_param->set_bottom_scale(range > 0 ? 127.f / range : 1.f);
+    LOG(INFO) << "Layer " << layer_param->name() << ": bottom range "
+        << range << ", bottom_scale " << quant_param->bottom_scale();
+  }
+  for (int i = 0; i < int8_weights.layer_size(); ++i) {
+    LayerParameter* layer_param = int8_weights.mutable_layer(i);
+    if (max_abs.count(layer_param->name()) && layer_param->blobs_size() > 0) {
+      QuantizeBlobProto(layer_param->mutable_blobs(0));
+    }
+  }
+  LOG(INFO) << "Quantized " << max_abs.size() << " layers; weights "
+      << float_bytes << " -> " << int8_weights.ByteSize() << " bytes.";
+  WriteProtoToTextFile(int8_param, FLAGS_output_model);
+  WriteProtoToBinaryFile(int8_weights, FLAGS_output_weights);
+  LOG(INFO) << "Wrote " << FLAGS_output_model << " and "
+      << FLAGS_output_weights;
+
+  // Run the same batches through the INT8 net to compare.
+  vector<float> int8_features, int8_labels;
+  float int8_ms;
+  {
+    Net<float> net(int8_param);
+    net.CopyTrainedLayersFrom(int8_weights);
+    int8_ms = RunNet(&net, NULL, &int8_features, &int8_labels, &feature_dim);
+  }
+  LOG(INFO) << "Forward time over " << FLAGS_iterations << " batches: float "
+      << float_ms << " ms, INT8 " << int8_ms << " ms ("
+      << float_ms / std::max(int8_ms, 1e-3f) << "x).";
+  if (!FLAGS_feature_blob.empty()) {
+    CHECK(float_labels == int8_labels)
+        << "The data layer produced different batches for the two runs.";
+    const vector<float> float_recall =
+        RecallAtK(float_features, float_labels, feature_dim, ks);
+    const vector<float> int8_recall =
+        RecallAtK(int8_features, int8_labels, feature_dim, ks);
+    for (int k = 0; k < ks.size(); ++k) {
+      LOG(INFO) << "Recall@" << ks[k] << ": float " << float_recall[k]
+          << ", INT8 " << int8_recall[k] << ", drift "
+          << int8_recall[k] - float_recall[k];
+    }
+  }
+  return 0;
+}